@@ -22,7 +22,9 @@
 
 -keepclasseswithmembers class network.path.mobilenode.library.domain.entity.** { *; }
 -keepclasseswithmembers class network.path.mobilenode.library.data.runner.mtr.** { *; }
+-keepclasseswithmembers class network.path.mobilenode.library.data.runner.probe.** { *; }
 
+-keepclasseswithmembers class network.path.mobilenode.library.utils.JniHelper { native <methods>; }
 -dontwarn network.path.mobilenode.library.utils.**
 
 ## KOTLIN
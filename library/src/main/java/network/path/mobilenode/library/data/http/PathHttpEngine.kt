@@ -14,7 +14,6 @@ import network.path.mobilenode.library.domain.PathNativeProcesses
 import network.path.mobilenode.library.domain.PathStorage
 import network.path.mobilenode.library.domain.entity.*
 import network.path.mobilenode.library.utils.CustomThreadPoolManager
-import network.path.mobilenode.library.utils.isPortInUse
 import okhttp3.OkHttpClient
 import retrofit2.Call
 import retrofit2.HttpException
@@ -329,19 +328,16 @@ internal class PathHttpEngine(
 
         Timber.d("HTTP: creating new service [$useProxy]...")
 
-        if (useProxy) {
-            // Start the processes
-            startNativeProcesses()
-        }
+        // Start the processes, ss-local has to be listening before it is used as a proxy
+        val proxyReady = useProxy && startNativeProcesses()
 
-        // Verify that ss-local is actually running before using it as a proxy
-        val client = if (useProxy && isPortInUse(port)) {
-            Timber.d("HTTP: proxy port [$port] is in use, connecting")
+        val client = if (proxyReady) {
+            Timber.d("HTTP: proxy is listening on port [$port], connecting")
             this.useProxy = true
             okHttpClient.newBuilder().addProxy(host, port).build()
         } else {
             if (useProxy) {
-                Timber.d("HTTP: proxy port [$port] is not in use, proxy is not running")
+                Timber.d("HTTP: proxy is not listening on port [$port], proxy is not running")
             } else {
                 Timber.d("HTTP: proxy is not required")
             }
@@ -358,13 +354,14 @@ internal class PathHttpEngine(
         nativeProcesses.stop()
     }
 
-    private fun startNativeProcesses() {
-        nativeProcesses.start()
+    private fun startNativeProcesses(): Boolean {
+        val ready = nativeProcesses.start()
 
         nativeTask?.cancel(true)
         nativeTask = threadManager.run("nativeProcesses", PROXY_RESTART_TIMEOUT) {
             startNativeProcesses()
         }
+        return ready
     }
 
     private fun OkHttpClient.Builder.addProxy(host: String, port: Int): OkHttpClient.Builder =
@@ -8,7 +8,7 @@ import network.path.mobilenode.library.domain.PathNativeProcesses
 import network.path.mobilenode.library.domain.PathStorage
 import network.path.mobilenode.library.utils.Executable
 import network.path.mobilenode.library.utils.GuardedProcessPool
-import network.path.mobilenode.library.utils.isPortInUse
+import network.path.mobilenode.library.utils.JniHelper
 import timber.log.Timber
 import java.io.File
 
@@ -20,13 +20,28 @@ internal class PathNativeProcessesImpl(
         private const val TIMEOUT = 600
         private const val PROXY_PORT = 443
         private const val PROXY_PASSWORD = "PathNetwork"
-        private const val PROXY_ENCRYPTION_METHOD = "aes-256-cfb"
+        private const val OBFS_HTTP = "http"
+        private const val PROXY_METHOD_AUTO = "auto"
+        private const val READY_TIMEOUT_MILLIS = 1000L
+
+        /**
+         * @return [configured] as it is, unless it is "auto": then the AEAD method [preferredAead] reports as the
+         * cheapest on this device. Only servers that accept both aes-256-gcm and chacha20-ietf-poly1305 can take that.
+         */
+        fun proxyMethod(configured: String, preferredAead: () -> String): String =
+            if (configured == PROXY_METHOD_AUTO) preferredAead() else configured
+    }
+
+    private val encryptionMethod by lazy {
+        proxyMethod(BuildConfig.PROXY_METHOD, JniHelper::preferredAeadMethod).also {
+            Timber.d("NATIVE: using [$it]")
+        }
     }
 
     private val ssLocal = GuardedProcessPool()
     private val simpleObfs = GuardedProcessPool()
 
-    override fun start() {
+    override fun start(): Boolean {
         stop()
 
         val host = DomainGenerator.findDomain(storage)
@@ -34,39 +49,45 @@ internal class PathNativeProcessesImpl(
             Timber.d("NATIVE: found proxy domain [$host]")
 
             val libs = context.applicationInfo.nativeLibraryDir
+            if (BuildConfig.PROXY_OBFS == OBFS_HTTP) {
+                // ss-local applies the HTTP obfuscation itself and talks to the server directly. UDP goes straight
+                // to the server too, like next to any SIP003 plugin: obfs only carries TCP.
+                val cmd = ssLocalCommand(libs, host, PROXY_PORT)
+                cmd += listOf(
+                    "--plugin", "obfs-local",
+                    "--plugin-opts", "obfs=$OBFS_HTTP;obfs-host=$host"
+                )
+                ssLocal.start(cmd)
+                // It reports the moment it listens, see jni/supervisor/ready.h
+                val ready = ssLocal.await(JniHelper.READY_LISTENING, READY_TIMEOUT_MILLIS)
+                if (!ready) Timber.w("NATIVE: ss-local is not ready")
+                return ready
+            }
+
             val obfsCmd = mutableListOf(
                 File(libs, Executable.SIMPLE_OBFS).absolutePath,
                 "-s", host,
                 "-p", PROXY_PORT.toString(),
                 "-l", Constants.SIMPLE_OBFS_PORT.toString(),
                 "-t", TIMEOUT.toString(),
-                "--obfs", "http"
+                "--obfs", BuildConfig.PROXY_OBFS
             )
             if (BuildConfig.DEBUG) {
                 obfsCmd.add("-v")
             }
             simpleObfs.start(obfsCmd)
-            waitFor(Constants.SIMPLE_OBFS_PORT)
-
-            val cmd = mutableListOf(
-                File(libs, Executable.SS_LOCAL).absolutePath,
-                "-u",
-                "-s", Constants.LOCALHOST,
-                "-p", Constants.SIMPLE_OBFS_PORT.toString(),
-                "-k", PROXY_PASSWORD,
-                "-m", PROXY_ENCRYPTION_METHOD,
-                "-b", Constants.LOCALHOST,
-                "-l", Constants.SS_LOCAL_PORT.toString(),
-                "-t", TIMEOUT.toString()
-            )
-            if (BuildConfig.DEBUG) {
-                cmd.add("-v")
+            // Both report the moment they listen, see jni/supervisor/ready.h
+            if (!simpleObfs.await(JniHelper.READY_LISTENING, READY_TIMEOUT_MILLIS)) {
+                Timber.w("NATIVE: obfs-local is not ready")
             }
 
-            ssLocal.start(cmd)
-            waitFor(Constants.SS_LOCAL_PORT)
+            ssLocal.start(ssLocalCommand(libs, Constants.LOCALHOST, Constants.SIMPLE_OBFS_PORT))
+            val ready = ssLocal.await(JniHelper.READY_LISTENING, READY_TIMEOUT_MILLIS)
+            if (!ready) Timber.w("NATIVE: ss-local is not ready")
+            return ready
         } else {
             Timber.w("NATIVE: proxy domain not found")
+            return false
         }
     }
 
@@ -74,18 +95,23 @@ internal class PathNativeProcessesImpl(
         Timber.d("NATIVE: stopping native processes and scheduled restart thread")
         simpleObfs.killAll()
         ssLocal.killAll()
-        Executable.killAll(context)
     }
 
-    private fun waitFor(port: Int, delay: Long = 100L) {
-        for (i in 1..3) {
-            if (isPortInUse(port)) break
-
-            try {
-                Thread.sleep(delay)
-            } catch (e: InterruptedException) {
-                break
-            }
+    private fun ssLocalCommand(libs: String, server: String, port: Int): MutableList<String> {
+        val cmd = mutableListOf(
+            File(libs, Executable.SS_LOCAL).absolutePath,
+            "-u",
+            "-s", server,
+            "-p", port.toString(),
+            "-k", PROXY_PASSWORD,
+            "-m", encryptionMethod,
+            "-b", Constants.LOCALHOST,
+            "-l", Constants.SS_LOCAL_PORT.toString(),
+            "-t", TIMEOUT.toString()
+        )
+        if (BuildConfig.DEBUG) {
+            cmd.add("-v")
         }
+        return cmd
     }
 }
@@ -1,12 +1,14 @@
 package network.path.mobilenode.library.data.runner
 
-import android.content.Context
+import android.system.ErrnoException
 import com.google.gson.Gson
+import network.path.mobilenode.library.data.runner.probe.ProbeBatcher
 import network.path.mobilenode.library.domain.PathJobExecutor
 import network.path.mobilenode.library.domain.PathStorage
 import network.path.mobilenode.library.domain.entity.JobRequest
 import network.path.mobilenode.library.domain.entity.JobResult
 import okhttp3.OkHttpClient
+import timber.log.Timber
 import java.util.concurrent.Callable
 import java.util.concurrent.ExecutorService
 import java.util.concurrent.Executors
@@ -16,23 +18,42 @@ import javax.net.SocketFactory
 internal class PathJobExecutorImpl(
     private val okHttpClient: OkHttpClient,
     private val storage: PathStorage,
-    private val context: Context,
     private val gson: Gson,
     private val timeSource: TimeSource
 ) : PathJobExecutor {
     private lateinit var executor: ExecutorService
+    private var batcher: ProbeBatcher? = null
 
     override fun start() {
         executor = Executors.newCachedThreadPool()
+        batcher = createBatcher()
     }
 
-    override fun execute(request: JobRequest): Future<JobResult> =
-        executor.submit(Callable {
-            findRunner(request).runJob(request, timeSource)
+    override fun execute(request: JobRequest): Future<JobResult> {
+        val runner = findRunner(request)
+        val batcher = batcher
+        if (batcher != null && (runner is TcpRunner || runner is UdpRunner)) {
+            return batcher.submit(request, runner.jobType)
+        }
+        return executor.submit(Callable {
+            runner.runJob(request, timeSource)
         })
+    }
 
     override fun stop() {
         executor.shutdown()
+        batcher?.stop()
+        batcher = null
+    }
+
+    private fun createBatcher() = try {
+        ProbeBatcher().apply { start() }
+    } catch (e: LinkageError) {
+        Timber.w(e, "EXECUTOR: native probes are not available, running TCP/UDP jobs on the thread pool")
+        null
+    } catch (e: ErrnoException) {
+        Timber.w(e, "EXECUTOR: cannot set up the native probe loop, running TCP/UDP jobs on the thread pool")
+        null
     }
 
     @Suppress("MemberVisibilityCanBePrivate")
@@ -42,7 +63,7 @@ internal class PathJobExecutorImpl(
             protocol.startsWith(prefix = "http", ignoreCase = true) -> HttpRunner(okHttpClient, storage)
             protocol.startsWith(prefix = "tcp", ignoreCase = true) -> TcpRunner(SocketFactory.getDefault())
             protocol.startsWith(prefix = "udp", ignoreCase = true) -> UdpRunner()
-            method.orEmpty().startsWith(prefix = "traceroute", ignoreCase = true) -> TraceRunner(context, gson)
+            method.orEmpty().startsWith(prefix = "traceroute", ignoreCase = true) -> TraceRunner(gson)
             else -> FallbackRunner
         }
     }
@@ -31,7 +31,7 @@ internal fun computeJobResult(
     }
 
     val duration = responseBody.second ?: requestDurationMillis
-    val status = if (isResponseKnown) calculateJobStatus(duration, jobRequest) else Status.UNKNOWN
+    val status = if (isResponseKnown) calculateJobStatus(duration.toDouble(), jobRequest) else Status.UNKNOWN
 
     Timber.d("RUNNER: [$jobRequest] => $status")
     return JobResult(
@@ -49,7 +49,11 @@ internal inline fun <T> runWithTimeout(timeout: Long, crossinline block: () -> T
     return f.get(timeout, TimeUnit.MILLISECONDS)
 }
 
-internal fun calculateJobStatus(requestDurationMillis: Long, jobRequest: JobRequest): String {
+/**
+ * Takes fractional milliseconds so that sub-millisecond native timings are not truncated before they are
+ * compared against the thresholds.
+ */
+internal fun calculateJobStatus(requestDurationMillis: Double, jobRequest: JobRequest): String {
     val degradedAfterMillis = jobRequest.degradedAfter ?: Constants.DEFAULT_DEGRADED_TIMEOUT_MILLIS
     val criticalAfterMillis = jobRequest.criticalAfter ?: Constants.DEFAULT_CRITICAL_TIMEOUT_MILLIS
 
@@ -1,14 +1,12 @@
 package network.path.mobilenode.library.data.runner
 
-import android.content.Context
 import com.google.gson.Gson
 import network.path.mobilenode.library.Constants
+import network.path.mobilenode.library.data.runner.probe.NativeProbe
+import network.path.mobilenode.library.data.runner.probe.NativeTrace
 import network.path.mobilenode.library.domain.entity.JobRequest
 import network.path.mobilenode.library.domain.entity.JobType
 import network.path.mobilenode.library.domain.entity.endpointHost
-import java.io.BufferedReader
-import java.io.File
-import java.io.InputStreamReader
 
 data class TraceResult(
     val target: String,
@@ -21,9 +19,19 @@ data class TraceResult(
 
 data class Hop(val ip: String, val rtts: List<Double>, val lost: Int)
 
-internal class TraceRunner(private val context: Context, private val gson: Gson) : Runner {
+internal class TraceRunner(private val gson: Gson) : Runner {
+    companion object {
+        private const val MAX_HOPS = 30
+        private const val QUERIES = 10
+        private const val WAIT_MILLIS = 1000
+        private const val PACKET_SIZE = 60
+        private const val UDP_BASE_PORT = 33434
+    }
+
     override val jobType = JobType.TRACEROUTE
 
+    private val probe = NativeProbe
+
     override fun runJob(jobRequest: JobRequest, timeSource: TimeSource) =
         computeJobResult(jobType, jobRequest, timeSource) {
             runWithTimeout(Constants.TRACEROUTE_JOB_TIMEOUT_MILLIS) {
@@ -32,20 +40,26 @@ internal class TraceRunner(private val context: Context, private val gson: Gson)
         }
 
     private fun runTraceJob(jobRequest: JobRequest): Pair<String, Long?> {
-        val libs = context.applicationInfo.nativeLibraryDir
-        val cmd = listOf(
-            File(libs, "libtraceroute.so").absolutePath,
-            "--icmp", "--wait=1,3,10", "-n", "--queries=10", jobRequest.endpointHost
+        val host = jobRequest.endpointHost
+        val trace = probe.traceroute(
+            host, NativeProbe.PROTOCOL_ICMP, UDP_BASE_PORT, MAX_HOPS, QUERIES, WAIT_MILLIS, PACKET_SIZE
         )
 
-        val p = ProcessBuilder(cmd).start()
-        val sb = StringBuilder()
-        BufferedReader(InputStreamReader(p.inputStream)).useLines {
-            it.forEach { line -> sb.append(line) }
-        }
-        p.destroy()
-
-        val result = gson.fromJson(sb.toString(), TraceResult::class.java)
-        return sb.toString() to result.hops.lastOrNull()?.rtts?.average()?.toLong()
+        val result = trace.toTraceResult(host)
+        val lastRtts = result.hops.lastOrNull()?.rtts
+        val duration = if (lastRtts.isNullOrEmpty()) null else lastRtts.average().toLong()
+        return gson.toJson(result) to duration
     }
+
+    private fun NativeTrace.toTraceResult(target: String) = TraceResult(
+        target = target,
+        targetIp = targetIp,
+        maxHops = maxHops,
+        packetSize = packetSize,
+        probesPerHop = probesPerHop,
+        hops = hopIps.mapIndexed { i, ip ->
+            val rtts = rtts.copyOfRange(i * probesPerHop, (i + 1) * probesPerHop).filterNot { it.isNaN() }
+            Hop(ip = ip ?: "*", rtts = rtts, lost = probesPerHop - rtts.size)
+        }
+    )
 }
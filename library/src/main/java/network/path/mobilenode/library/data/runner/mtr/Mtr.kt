@@ -21,5 +21,11 @@ internal data class MtrResult(
 )
 
 internal class Mtr {
+    companion object {
+        init {
+            System.loadLibrary("jni-helper")
+        }
+    }
+
     external fun trace(server: String, port: Int, resolve: Boolean, maxHops: Int, packetSize: Int): MtrSummary?
 }
@@ -0,0 +1,101 @@
+package network.path.mobilenode.library.data.runner.probe
+
+@Suppress("ArrayInDataClass")
+internal data class NativeTrace(
+        val targetIp: String,
+        val protocol: Int,
+        val maxHops: Int,
+        val packetSize: Int,
+        val probesPerHop: Int,
+        val hopIps: Array<String?>,
+        val rtts: DoubleArray // hopIps.size * probesPerHop entries, NaN for lost probes
+)
+
+internal class ProbeTarget(
+        val protocol: Int,
+        val host: String,
+        val port: Int,
+        val payload: ByteArray?,
+        val connectTimeoutMillis: Int,
+        val readTimeoutMillis: Int, // idle time between reads
+        val timeoutMillis: Int,     // whole job from submission, however busy the server keeps it
+        val maxResponseBytes: Int
+)
+
+/**
+ * Native timings are CLOCK_MONOTONIC_RAW nanoseconds taken at the syscall boundary and, except for
+ * [resolveNanos], counted from right before connect()/sendto(). Zero means the step did not happen.
+ */
+internal class ProbeOutcome(
+        val status: Int,
+        val errno: Int,             // errno for STATUS_ERROR, EAI_* code for STATUS_UNKNOWN_HOST
+        val resolveNanos: Long,
+        val connectNanos: Long,
+        val handshakeNanos: Long,   // kernel-measured SYN/SYN-ACK round trip, TCP only
+        val firstByteNanos: Long,
+        val totalNanos: Long,
+        val response: ByteArray?
+)
+
+/**
+ * Native event loop that [ProbeBatcher] keeps running: targets join it while others are still in flight and host
+ * names are resolved on helper threads, so neither [submitProbe] nor the loop waits for DNS.
+ */
+internal interface BatchLoop {
+    fun newBatchLoop(): Long
+
+    /**
+     * Callable from any thread. Returns false once the loop is stopping, the target is not probed then.
+     */
+    fun submitProbe(loop: Long, id: Int, target: ProbeTarget): Boolean
+
+    /**
+     * Runs the loop until [stopBatchLoop], reporting every accepted target exactly once to
+     * [ProbeBatcher.onProbeOutcome] on the calling thread. Targets still in flight finish as
+     * [NativeProbe.STATUS_CANCELLED].
+     */
+    fun runBatchLoop(loop: Long, batcher: ProbeBatcher)
+
+    fun stopBatchLoop(loop: Long)
+
+    /**
+     * Only once [runBatchLoop] returned and no [submitProbe] call can still be in progress.
+     */
+    fun freeBatchLoop(loop: Long)
+}
+
+internal object NativeProbe : BatchLoop {
+    const val PROTOCOL_ICMP = 0
+    const val PROTOCOL_UDP = 1
+    const val PROTOCOL_TCP = 2
+
+    const val STATUS_OK = 1
+    const val STATUS_TIMEOUT = 2
+    const val STATUS_ERROR = 3
+    const val STATUS_UNKNOWN_HOST = 4
+    const val STATUS_CANCELLED = 5
+
+    init {
+        System.loadLibrary("jni-helper")
+    }
+
+    external fun traceroute(
+            host: String,
+            protocol: Int,
+            port: Int,
+            maxHops: Int,
+            queries: Int,
+            waitMillis: Int,
+            packetSize: Int
+    ): NativeTrace
+
+    external override fun newBatchLoop(): Long
+
+    external override fun submitProbe(loop: Long, id: Int, target: ProbeTarget): Boolean
+
+    external override fun runBatchLoop(loop: Long, batcher: ProbeBatcher)
+
+    external override fun stopBatchLoop(loop: Long)
+
+    external override fun freeBatchLoop(loop: Long)
+}
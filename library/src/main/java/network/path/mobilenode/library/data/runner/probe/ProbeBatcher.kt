@@ -0,0 +1,157 @@
+package network.path.mobilenode.library.data.runner.probe
+
+import android.system.ErrnoException
+import network.path.mobilenode.library.Constants
+import network.path.mobilenode.library.data.runner.Status
+import network.path.mobilenode.library.data.runner.calculateJobStatus
+import network.path.mobilenode.library.domain.entity.JobRequest
+import network.path.mobilenode.library.domain.entity.JobResult
+import network.path.mobilenode.library.domain.entity.JobType
+import network.path.mobilenode.library.domain.entity.endpointHost
+import network.path.mobilenode.library.domain.entity.endpointPortOrDefault
+import network.path.mobilenode.library.utils.thread
+import timber.log.Timber
+import java.io.IOException
+import java.net.SocketTimeoutException
+import java.net.UnknownHostException
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.Future
+import java.util.concurrent.RejectedExecutionException
+import java.util.concurrent.atomic.AtomicInteger
+import java.util.concurrent.locks.ReentrantReadWriteLock
+import kotlin.concurrent.read
+import kotlin.concurrent.write
+
+/**
+ * Runs TCP and UDP jobs on one native event loop that keeps running on its own thread: every submitted job
+ * joins it right away, next to whatever is still in flight.
+ */
+internal class ProbeBatcher(private val probe: BatchLoop = NativeProbe) {
+    companion object {
+        private const val NANOS_PER_MILLI = 1_000_000.0
+    }
+
+    private class Pending(val request: JobRequest, val jobType: JobType) {
+        val future = ResultFuture<JobResult>()
+    }
+
+    private val pending = ConcurrentHashMap<Int, Pending>()
+    private val ids = AtomicInteger()
+    // Held for reading around submitProbe() so that stop() can free the loop once nobody is using it
+    private val lock = ReentrantReadWriteLock()
+    private var loop = 0L
+    @Volatile
+    private var worker: Thread? = null
+
+    /**
+     * Throws [ErrnoException] if the native loop cannot be set up.
+     */
+    fun start() = lock.write {
+        val loop = probe.newBatchLoop()
+        this.loop = loop
+        worker = thread("ProbeBatcher") {
+            try {
+                probe.runBatchLoop(loop, this)
+            } catch (e: ErrnoException) {
+                Timber.e(e, "BATCHER: native loop failed")
+            }
+        }
+    }
+
+    /**
+     * Jobs still in flight complete as cancelled.
+     */
+    fun stop() {
+        val (worker, loop) = lock.write {
+            val worker = worker ?: return
+            this.worker = null
+            probe.stopBatchLoop(loop)
+            worker to loop
+        }
+        worker.join()
+        probe.freeBatchLoop(loop)
+    }
+
+    fun submit(request: JobRequest, jobType: JobType): Future<JobResult> = lock.read {
+        if (worker == null) throw RejectedExecutionException("ProbeBatcher is stopped")
+        val job = Pending(request, jobType)
+        val target = try {
+            job.toTarget()
+        } catch (e: IOException) {
+            job.complete(e.toString())
+            return job.future
+        }
+
+        val id = ids.incrementAndGet()
+        pending[id] = job
+        if (!probe.submitProbe(loop, id, target)) {
+            pending.remove(id)
+            job.complete(InterruptedException().toString())
+        }
+        job.future
+    }
+
+    /**
+     * Called by the native loop on the worker thread, once for every submitted job.
+     */
+    fun onProbeOutcome(id: Int, outcome: ProbeOutcome) {
+        val job = pending.remove(id) ?: return
+        try {
+            job.complete(outcome)
+        } catch (e: Exception) {
+            job.complete(e.toString())
+        }
+    }
+
+    private fun Pending.toTarget(): ProbeTarget {
+        val isTcp = jobType == JobType.TCP
+        return ProbeTarget(
+            protocol = if (isTcp) NativeProbe.PROTOCOL_TCP else NativeProbe.PROTOCOL_UDP,
+            host = request.endpointHost,
+            port = request.endpointPortOrDefault(if (isTcp) Constants.DEFAULT_TCP_PORT else Constants.DEFAULT_UDP_PORT),
+            payload = request.payload?.toByteArray(),
+            connectTimeoutMillis = Constants.JOB_TIMEOUT_MILLIS.toInt(),
+            readTimeoutMillis = Constants.TCP_UDP_READ_WRITE_TIMEOUT_MILLIS.toInt(),
+            timeoutMillis = Constants.JOB_TIMEOUT_MILLIS.toInt(),
+            maxResponseBytes = Constants.RESPONSE_LENGTH_BYTES_MAX
+        )
+    }
+
+    private fun Pending.complete(outcome: ProbeOutcome) {
+        // A bare TCP connect reports when connect() completed, measured like the other steps. The kernel's
+        // handshake RTT (outcome.handshakeNanos) only covers SYN to SYN-ACK and is not a response time.
+        val durationNanos = when {
+            jobType == JobType.UDP -> outcome.connectNanos
+            request.payload != null -> outcome.totalNanos
+            else -> outcome.connectNanos
+        }
+        val durationMillis = durationNanos / NANOS_PER_MILLI
+        val duration = Math.round(durationMillis)
+        val totalMillis = Math.round(outcome.totalNanos / NANOS_PER_MILLI)
+        val body = when (outcome.status) {
+            NativeProbe.STATUS_OK -> when {
+                jobType == JobType.UDP -> "UDP packet sent successfully"
+                request.payload == null -> "TCP connection established successfully"
+                else -> outcome.response?.let { String(it) }.orEmpty()
+            }
+            NativeProbe.STATUS_TIMEOUT -> return complete(SocketTimeoutException().toString(), totalMillis)
+            NativeProbe.STATUS_CANCELLED -> return complete(InterruptedException().toString(), totalMillis)
+            NativeProbe.STATUS_UNKNOWN_HOST -> return complete(UnknownHostException(request.endpointHost).toString(), totalMillis)
+            else -> return complete(ErrnoException("probe", outcome.errno).toString(), totalMillis)
+        }
+        complete(body, duration, calculateJobStatus(durationMillis, request))
+    }
+
+    private fun Pending.complete(body: String, duration: Long = 0L, status: String = Status.UNKNOWN) {
+        Timber.d("BATCHER: [$request] => $status")
+        future.set(
+            JobResult(
+                checkType = jobType,
+                executionUuid = request.executionUuid,
+                responseTime = duration,
+                responseBody = body,
+                status = status
+            )
+        )
+    }
+}
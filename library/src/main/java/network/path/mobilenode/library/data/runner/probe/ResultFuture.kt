@@ -0,0 +1,59 @@
+package network.path.mobilenode.library.data.runner.probe
+
+import java.util.concurrent.CancellationException
+import java.util.concurrent.CountDownLatch
+import java.util.concurrent.Future
+import java.util.concurrent.TimeUnit
+import java.util.concurrent.TimeoutException
+import java.util.concurrent.atomic.AtomicInteger
+
+/**
+ * Future completed by whoever produces the value, for work that is not a Callable of its own.
+ * Whichever of [set] and [cancel] comes first wins, the other one is ignored.
+ */
+internal class ResultFuture<T> : Future<T> {
+    companion object {
+        private const val PENDING = 0
+        private const val SET = 1
+        private const val CANCELLED = 2
+    }
+
+    private val latch = CountDownLatch(1)
+    private val state = AtomicInteger(PENDING)
+    @Volatile
+    private var value: T? = null
+
+    fun set(value: T): Boolean {
+        this.value = value
+        if (!state.compareAndSet(PENDING, SET)) return false
+        latch.countDown()
+        return true
+    }
+
+    override fun cancel(mayInterruptIfRunning: Boolean): Boolean {
+        if (!state.compareAndSet(PENDING, CANCELLED)) return false
+        value = null
+        latch.countDown()
+        return true
+    }
+
+    override fun isCancelled() = state.get() == CANCELLED
+
+    override fun isDone() = state.get() != PENDING
+
+    override fun get(): T {
+        latch.await()
+        return result()
+    }
+
+    override fun get(timeout: Long, unit: TimeUnit): T {
+        if (!latch.await(timeout, unit)) throw TimeoutException()
+        return result()
+    }
+
+    private fun result(): T {
+        if (state.get() == CANCELLED) throw CancellationException()
+        @Suppress("UNCHECKED_CAST")
+        return value as T
+    }
+}
@@ -1,6 +1,9 @@
 package network.path.mobilenode.library.domain
 
 internal interface PathNativeProcesses {
-    fun start()
+    /**
+     * @return Whether the local SOCKS proxy is listening.
+     */
+    fun start(): Boolean
     fun stop()
 }
@@ -20,14 +20,6 @@
 
 package network.path.mobilenode.library.utils
 
-import android.content.Context
-import android.system.ErrnoException
-import android.system.Os
-import android.text.TextUtils
-import timber.log.Timber
-import java.io.File
-import java.io.FileNotFoundException
-
 internal object Executable {
     const val REDSOCKS = "libredsocks.so"
     const val SS_LOCAL = "libss-local.so"
@@ -35,25 +27,4 @@ internal object Executable {
     const val TUN2SOCKS = "libtun2socks.so"
     const val OVERTURE = "liboverture.so"
     const val SIMPLE_OBFS = "libobfs-local.so"
-
-    private val EXECUTABLES = setOf(SS_LOCAL, SS_TUNNEL, REDSOCKS, TUN2SOCKS, OVERTURE, SIMPLE_OBFS)
-
-    fun killAll(context: Context) {
-        for (process in File("/proc").listFiles { _, name -> TextUtils.isDigitsOnly(name) }) {
-            val exe = File(
-                try {
-                    File(process, "cmdline").readText()
-                } catch (ignore: FileNotFoundException) {
-                    continue
-                }.split(Character.MIN_VALUE, limit = 2).first()
-            )
-            if (exe.parent == context.applicationInfo.nativeLibraryDir && EXECUTABLES.contains(exe.name)) try {
-                Os.kill(process.name.toInt(), 9)    // SIGKILL
-            } catch (e: ErrnoException) {
-                if (e.errno != 3) {                 // ESRCH
-                    Timber.w(e, "SIGKILL ${exe.absolutePath} (${process.name}) failed")
-                }
-            }
-        }
-    }
 }
@@ -20,128 +20,65 @@
 
 package network.path.mobilenode.library.utils
 
-import android.os.Build
-import android.os.SystemClock
 import android.system.ErrnoException
-import android.system.Os
-import android.util.Log
 import timber.log.Timber
 import java.io.File
 import java.io.IOException
-import java.io.InputStream
-import java.util.concurrent.ArrayBlockingQueue
-import java.util.concurrent.atomic.AtomicReference
+import java.util.concurrent.TimeUnit
 
-internal class GuardedProcessPool {
-    companion object Dummy : IOException("Oopsie the developer has made a no-no") {
-        private const val TAG = "GuardedProcessPool"
-        private val ProcessImpl by lazy { Class.forName("java/lang/ProcessManager\$ProcessImpl") }
-        private val pid by lazy { ProcessImpl.getField("pid").apply { isAccessible = true } }
-        private val exitValueMutex by lazy { ProcessImpl.getField("exitValueMutex").apply { isAccessible = true } }
+/**
+ * Processes kept running by the native supervisor in jni-helper: a single thread spawns them, forwards their output
+ * to logcat and respawns them when they exit, see [ProcessSupervisor.startProcess].
+ */
+internal class GuardedProcessPool(private val supervisor: ProcessSupervisor = JniHelper) {
+    companion object {
+        private const val GRACE_MILLIS = 500    // between SIGTERM and SIGKILL
     }
 
-    private inner class Guard(private val cmd: List<String>, private val onRestartCallback: (() -> Unit)?) {
-        val cmdName = File(cmd.first()).nameWithoutExtension
-        val excQueue = ArrayBlockingQueue<IOException>(1)   // ArrayBlockingQueue doesn't want null
-        private var pushed = false
+    /**
+     * Snapshot of one process, [state] is one of the JniHelper.PROCESS_ constants and [events] holds JniHelper.READY_
+     * bits.
+     */
+    data class Status(
+        val cmdName: String, val state: Int, val pid: Int, val restarts: Int, val exitCode: Int, val events: Int
+    )
 
-        private fun streamLogger(input: InputStream, logger: (String, String) -> Int) =
-            thread("StreamLogger-$cmdName") {
-                try {
-                    input.bufferedReader().forEachLine { logger(TAG, it) }
-                } catch (_: IOException) {
-                }    // ignore
-            }
+    private val handles = LinkedHashMap<Int, String>()
 
-        private fun pushException(ioException: IOException?) {
-            if (pushed) return
-            excQueue.put(ioException ?: Dummy)
-            pushed = true
+    fun start(cmd: List<String>): GuardedProcessPool {
+        val cmdName = File(cmd.first()).nameWithoutExtension
+        Timber.d("PROCESS: ${Commandline.toString(cmd)}")
+        val handle = try {
+            supervisor.startProcess(cmd.toTypedArray(), cmdName)
+        } catch (e: ErrnoException) {
+            throw IOException("Cannot run $cmdName", e)
         }
+        synchronized(handles) { handles[handle] = cmdName }
+        return this
+    }
 
-        fun looper(host: HashSet<Thread>) {
-            var process: Process? = null
-            try {
-                var callback: (() -> Unit)? = null
-                while (guardThreads.get() === host) {
-                    Timber.d("PROCESS: ${Commandline.toString(cmd)}")
-                    val startTime = SystemClock.elapsedRealtime()
-
-                    process = ProcessBuilder(cmd)
-                        .redirectErrorStream(true)
-                        .start()
-
-                    streamLogger(process.inputStream, Log::i)
-                    streamLogger(process.errorStream, Log::e)
-
-                    if (callback == null) callback = onRestartCallback else callback()
-
-                    pushException(null)
-                    process.waitFor()
-
-                    if (SystemClock.elapsedRealtime() - startTime < 1000) {
-                        Timber.w("PROCESS: exit too fast, stop guard [$cmdName]")
-                        break
-                    }
-                }
-            } catch (_: InterruptedException) {
-                Timber.d("PROCESS: interrupted, destroy process [$cmdName]")
-            } catch (e: IOException) {
-                pushException(e)
-            } finally {
-                if (process != null) {
-                    if (Build.VERSION.SDK_INT < 24) {
-                        val pid = pid.get(process) as Int
-                        try {
-                            Os.kill(pid, 15)            // SIGTERM
-                        } catch (e: ErrnoException) {
-                            if (e.errno != 3) throw e   // ESRCH
-                        }
-                        val mutex = exitValueMutex.get(process) as Object
-                        synchronized(mutex) {
-                            try {
-                                process.exitValue()
-                            } catch (e: IllegalThreadStateException) {
-                                mutex.wait(500)
-                            }
-                        }
-                    }
-                    process.destroy()
-                    process.waitFor()   // ensure the process is destroyed
-                }
-                pushException(null)
-            }
+    fun status(): List<Status> = synchronized(handles) {
+        handles.mapNotNull { (handle, cmdName) ->
+            supervisor.processStatus(handle)?.let { Status(cmdName, it[0], it[1], it[2], it[3], it[4]) }
         }
     }
 
     /**
-     * This is an indication of which thread pool is being active.
-     * Reading/writing this collection still needs an additional lock to prevent concurrent modification.
+     * Waits until every process of the pool reported all JniHelper.READY_ bits in [events], [timeoutMillis] at most
+     * for all of them together.
      */
-    private val guardThreads = AtomicReference<HashSet<Thread>>(HashSet())
-
-    fun start(cmd: List<String>, onRestartCallback: (() -> Unit)? = null): GuardedProcessPool {
-        val guard = Guard(cmd, onRestartCallback)
-        val guardThreads = guardThreads.get()
-        synchronized(guardThreads) {
-            guardThreads.add(thread("GuardThread-${guard.cmdName}") {
-                guard.looper(guardThreads)
-            })
+    fun await(events: Int, timeoutMillis: Long): Boolean {
+        val deadline = System.nanoTime() + TimeUnit.MILLISECONDS.toNanos(timeoutMillis)
+        val handles = synchronized(handles) { handles.keys.toList() }
+        return handles.all {
+            val remaining = TimeUnit.NANOSECONDS.toMillis(deadline - System.nanoTime())
+            remaining > 0 && supervisor.awaitProcess(it, events, remaining.toInt())
         }
-        val ioException = guard.excQueue.take()
-        if (ioException !== Dummy) throw ioException
-        return this
     }
 
     fun killAll() {
-        val guardThreads = guardThreads.getAndSet(HashSet())
-        synchronized(guardThreads) {
-            guardThreads.forEach { it.interrupt() }
-            try {
-                guardThreads.forEach { it.join() }
-            } catch (_: InterruptedException) {
-            }
-        }
+        val handles = synchronized(handles) { handles.keys.toIntArray().also { handles.clear() } }
+        if (handles.isNotEmpty()) supervisor.stopProcesses(handles, GRACE_MILLIS)
     }
 }
 
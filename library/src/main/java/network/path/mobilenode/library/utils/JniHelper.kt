@@ -0,0 +1,81 @@
+package network.path.mobilenode.library.utils
+
+/**
+ * Native process supervisor behind [GuardedProcessPool], see jni/supervisor/supervisor.h.
+ */
+internal interface ProcessSupervisor {
+    /**
+     * Spawns [cmd] on the native supervisor thread, which forwards its output to logcat under [tag] and respawns it
+     * with a growing backoff whenever it exits, giving up after it exited within a second five times in a row. The
+     * process is killed along with the app.
+     *
+     * @return Handle for [stopProcesses] and [processStatus].
+     */
+    fun startProcess(cmd: Array<String>, tag: String): Int
+
+    /**
+     * Sends SIGTERM to all [handles] at once and SIGKILL to those still running after [graceMillis]. Returns once all
+     * of them are gone, the handles are invalid afterwards.
+     */
+    fun stopProcesses(handles: IntArray, graceMillis: Int)
+
+    /**
+     * @return State (one of the PROCESS_ constants), pid (0 unless running), number of respawns, the last exit
+     * code (128 + signal number if killed, -1 before the first exit) and the READY_ bits the running process reported,
+     * or null if [handle] is unknown.
+     */
+    fun processStatus(handle: Int): IntArray?
+
+    /**
+     * Waits up to [timeoutMillis] for the process behind [handle] to report all READY_ bits in [events], across
+     * respawns. Only ss-local and obfs-local report them.
+     *
+     * @return False on timeout, once the process is being stopped or was given up on, or if [handle] is unknown.
+     */
+    fun awaitProcess(handle: Int, events: Int, timeoutMillis: Int): Boolean
+}
+
+internal object JniHelper : ProcessSupervisor {
+    /**
+     * States reported by [ProcessSupervisor.processStatus], see jni/supervisor/supervisor.h.
+     */
+    const val PROCESS_STARTING = 0
+    const val PROCESS_RUNNING = 1
+    const val PROCESS_BACKOFF = 2
+    const val PROCESS_STOPPING = 3
+    const val PROCESS_STOPPED = 4
+    const val PROCESS_FAILED = 5
+
+    /**
+     * Readiness events for [ProcessSupervisor.awaitProcess], see jni/supervisor/ready.h.
+     */
+    const val READY_LISTENING = 1
+
+    init {
+        System.loadLibrary("jni-helper")
+    }
+
+    /**
+     * Hands [fd] over to the process listening on the UNIX socket at [path].
+     */
+    external fun sendFd(fd: Int, path: String)
+
+    /**
+     * @return The raw address bytes of [str] if it is a numeric IPv4 or IPv6 address, null otherwise.
+     */
+    external fun parseNumericAddress(str: String): ByteArray?
+
+    /**
+     * @return The shadowsocks AEAD method that is cheapest on this CPU: aes-256-gcm where the linked AES-GCM runs on
+     * AES-NI, chacha20-ietf-poly1305 everywhere else.
+     */
+    external fun preferredAeadMethod(): String
+
+    external override fun startProcess(cmd: Array<String>, tag: String): Int
+
+    external override fun stopProcesses(handles: IntArray, graceMillis: Int)
+
+    external override fun processStatus(handle: Int): IntArray?
+
+    external override fun awaitProcess(handle: Int, events: Int, timeoutMillis: Int): Boolean
+}
@@ -4,7 +4,6 @@ import okhttp3.Response
 import okhttp3.ResponseBody
 import java.io.ByteArrayOutputStream
 import java.io.IOException
-import java.net.ServerSocket
 import java.net.Socket
 
 internal fun Socket.readText(maxSize: Int): String =
@@ -30,10 +29,3 @@ internal fun Response.getBody(): ResponseBody {
     }
     return body
 }
-
-internal fun isPortInUse(port: Int) = try {
-    ServerSocket(port).close()
-    false
-} catch (e: IOException) {
-    true
-}
@@ -31,7 +31,6 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH)/traceroute
 TRACEROUTE_SOURCE := \
     libsupp/clif.c \
     traceroute/as_lookups.c \
-    traceroute/csum.c \
     traceroute/extension.c \
     traceroute/mod-dccp.c \
     traceroute/mod-icmp.c \
@@ -51,7 +50,10 @@ LOCAL_CFLAGS += -I$(LOCAL_PATH)/traceroute/libsupp \
 
 LOCAL_LDLIBS := -llog
 
-LOCAL_SRC_FILES := $(addprefix traceroute/, $(TRACEROUTE_SOURCE))
+# traceroute/csum.c is replaced by the shared checksum kernels
+LOCAL_SRC_FILES := $(addprefix traceroute/, $(TRACEROUTE_SOURCE)) csum/traceroute_csum.c
+
+LOCAL_STATIC_LIBRARIES := csum cpufeatures
 
 include $(BUILD_SHARED_EXECUTABLE)
 
@@ -59,10 +61,7 @@ include $(BUILD_SHARED_EXECUTABLE)
 ## libsodium
 ########################################################
 
-include $(CLEAR_VARS)
-
 SODIUM_SOURCE := \
-	crypto_aead/aes256gcm/aesni/aead_aes256gcm_aesni.c \
 	crypto_aead/chacha20poly1305/sodium/aead_chacha20poly1305.c \
 	crypto_aead/xchacha20poly1305/sodium/aead_xchacha20poly1305.c \
 	crypto_core/ed25519/ref10/ed25519_ref10.c \
@@ -94,8 +93,7 @@ SODIUM_SOURCE := \
 	sodium/utils.c \
 	sodium/version.c
 
-LOCAL_MODULE := sodium
-LOCAL_CFLAGS += -I$(LOCAL_PATH)/libsodium/src/libsodium/include \
+SODIUM_CFLAGS := -I$(LOCAL_PATH)/libsodium/src/libsodium/include \
 				-I$(LOCAL_PATH)/include \
 				-I$(LOCAL_PATH)/include/sodium \
 				-I$(LOCAL_PATH)/libsodium/src/libsodium/include/sodium \
@@ -138,6 +136,50 @@ LOCAL_CFLAGS += -I$(LOCAL_PATH)/libsodium/src/libsodium/include \
 				-DHAVE_GETPID=1                   \
 				-DCONFIGURED=1
 
+# The SIMD implementations are chosen at runtime by sodium_init(), as upstream does. ARM has none
+# in this libsodium. On x86 the ABI guarantees SSSE3, while the AES-NI and AVX2 sources go into
+# libraries of their own, so their compiler flags cannot leak into code that runs unconditionally.
+ifeq ($(TARGET_ARCH_ABI),x86)
+SODIUM_CFLAGS += -DHAVE_CPUID=1 \
+				-DHAVE_EMMINTRIN_H=1 -DHAVE_TMMINTRIN_H=1 -DHAVE_SMMINTRIN_H=1 \
+				-DHAVE_AVX2INTRIN_H=1 -DHAVE_WMMINTRIN_H=1 \
+				-mssse3
+
+SODIUM_SOURCE += \
+	crypto_onetimeauth/poly1305/sse2/poly1305_sse2.c \
+	crypto_stream/chacha20/dolbeau/chacha20_dolbeau-ssse3.c \
+	crypto_stream/salsa20/xmm6int/salsa20_xmm6int-sse2.c
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := sodium-aesni
+LOCAL_CFLAGS := $(SODIUM_CFLAGS) -maes -mpclmul
+LOCAL_SRC_FILES := libsodium/src/libsodium/crypto_aead/aes256gcm/aesni/aead_aes256gcm_aesni.c
+
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := sodium-avx2
+LOCAL_CFLAGS := $(SODIUM_CFLAGS) -mavx2
+LOCAL_SRC_FILES := $(addprefix libsodium/src/libsodium/, \
+	crypto_stream/chacha20/dolbeau/chacha20_dolbeau-avx2.c \
+	crypto_stream/salsa20/xmm6int/salsa20_xmm6int-avx2.c)
+
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_STATIC_LIBRARIES := sodium-aesni sodium-avx2
+else
+include $(CLEAR_VARS)
+
+# Without AES-NI this only provides crypto_aead_aes256gcm_is_available() returning 0
+SODIUM_SOURCE += crypto_aead/aes256gcm/aesni/aead_aes256gcm_aesni.c
+endif
+
+LOCAL_MODULE := sodium
+LOCAL_CFLAGS := $(SODIUM_CFLAGS)
 LOCAL_SRC_FILES := $(addprefix libsodium/src/libsodium/,$(SODIUM_SOURCE))
 
 include $(BUILD_STATIC_LIBRARY)
@@ -176,44 +218,97 @@ LOCAL_SRC_FILES := $(addprefix libancillary/, $(ANCILLARY_SOURCE))
 include $(BUILD_STATIC_LIBRARY)
 
 ########################################################
-## libbloom
+## ppbloom
+########################################################
+
+include $(CLEAR_VARS)
+
+# Blocked Bloom filter behind the AEAD replay protection of ss-local and ss-tunnel, replaces
+# shadowsocks-libev's ppbloom.c and libbloom. The cap keeps both generations within 512 KiB.
+LOCAL_MODULE := ppbloom
+LOCAL_CFLAGS := -O2 -DPPBLOOM_MAX_BYTES=524288
+LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/bloom
+LOCAL_SRC_FILES := bloom/ppbloom.c
+
+include $(BUILD_STATIC_LIBRARY)
+
+########################################################
+## acl
 ########################################################
 
 include $(CLEAR_VARS)
 
-BLOOM_SOURCE := bloom.c murmur2/MurmurHash2.c
+# Flat-trie backend for shadowsocks-libev's acl.c in place of libipset, see acl/acl_lpm.c
+LOCAL_MODULE := acl
+LOCAL_CFLAGS := -O2 -I$(LOCAL_PATH)/acl -I$(LOCAL_PATH)/acl/include \
+				-I$(LOCAL_PATH)/shadowsocks-libev/libcork/include
+LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/acl/include $(LOCAL_PATH)/acl
+LOCAL_SRC_FILES := acl/lpm.c acl/acl_lpm.c
+
+include $(BUILD_STATIC_LIBRARY)
+
+########################################################
+## rule
+########################################################
 
-LOCAL_MODULE := libbloom
-LOCAL_CFLAGS += -I$(LOCAL_PATH)/shadowsocks-libev/libbloom \
-				-I$(LOCAL_PATH)/shadowsocks-libev/libbloom/murmur2
+include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES := $(addprefix shadowsocks-libev/libbloom/, $(BLOOM_SOURCE))
+# Hostname rule automaton under shadowsocks-libev's rule.c, see rule/rule_hostmatch.c
+LOCAL_MODULE := rule
+LOCAL_CFLAGS := -O2 -DHAVE_CONFIG_H -I$(LOCAL_PATH)/include/shadowsocks-libev \
+				-I$(LOCAL_PATH)/shadowsocks-libev/src \
+				-I$(LOCAL_PATH)/shadowsocks-libev/libcork/include \
+				-I$(LOCAL_PATH)/pcre
+LOCAL_SRC_FILES := rule/hostmatch.c rule/rule_hostmatch.c
 
 include $(BUILD_STATIC_LIBRARY)
 
 ########################################################
-## libipset
+## udp
 ########################################################
 
 include $(CLEAR_VARS)
 
-bdd_src = bdd/assignments.c bdd/basics.c bdd/bdd-iterator.c bdd/expanded.c \
-		  		  bdd/reachable.c bdd/read.c bdd/write.c
-map_src = map/allocation.c map/inspection.c map/ipv4_map.c map/ipv6_map.c \
-		  		  map/storage.c
-set_src = set/allocation.c set/inspection.c set/ipv4_set.c set/ipv6_set.c \
-		  		  set/iterator.c set/storage.c
+# recvmmsg/sendmmsg batching under shadowsocks-libev's udprelay.c, see udp/udp_batch.c, and the
+# session table that stands in for its cache.c, see udp/session_cache.h
+LOCAL_MODULE := udp
+LOCAL_CFLAGS := -O2 -I$(LOCAL_PATH)/libev
+LOCAL_SRC_FILES := udp/udp_batch.c udp/session_cache.c
 
-IPSET_SOURCE := general.c $(bdd_src) $(map_src) $(set_src)
+include $(BUILD_STATIC_LIBRARY)
 
-LOCAL_MODULE := libipset
-LOCAL_CFLAGS += -I$(LOCAL_PATH)/shadowsocks-libev/libipset/include \
-				-I$(LOCAL_PATH)/shadowsocks-libev/libcork/include
+########################################################
+## arena
+########################################################
 
-LOCAL_SRC_FILES := $(addprefix shadowsocks-libev/libipset/src/libipset/,$(IPSET_SOURCE))
+include $(CLEAR_VARS)
+
+# Slab allocator behind utils.c's ss_malloc() in ss-local and obfs-local and behind tun2socks' lwIP,
+# see arena/arena.h
+LOCAL_MODULE := arena
+LOCAL_CFLAGS := -O2
+LOCAL_SRC_FILES := arena/arena.c arena/ss_arena.c arena/lwip_arena.c
 
 include $(BUILD_STATIC_LIBRARY)
 
+ARENA_LDFLAGS := -Wl,--wrap=ss_malloc,--wrap=ss_realloc,--wrap=realloc,--wrap=free
+
+########################################################
+## ready
+########################################################
+
+include $(CLEAR_VARS)
+
+# Readiness events of ss-local and obfs-local for the supervisor that spawned them,
+# see supervisor/ready.h
+LOCAL_MODULE := ready
+LOCAL_CFLAGS := -Wall -O2
+LOCAL_SRC_FILES := supervisor/ready.c
+
+include $(BUILD_STATIC_LIBRARY)
+
+READY_LDFLAGS := -Wl,--wrap=listen
+
 ########################################################
 ## libcork
 ########################################################
@@ -275,12 +370,30 @@ LOCAL_CFLAGS    := -Wall -O2 -fno-strict-aliasing -DMODULE_LOCAL \
                      -I$(LOCAL_PATH)/libev \
                      -I$(LOCAL_PATH)/include/simple-obfs
 
-LOCAL_STATIC_LIBRARIES := libev libcork libancillary
+LOCAL_LDFLAGS   := $(ARENA_LDFLAGS) $(READY_LDFLAGS)
+
+LOCAL_STATIC_LIBRARIES := arena ready libev libcork libancillary
 
 LOCAL_LDLIBS := -llog
 
 include $(BUILD_SHARED_EXECUTABLE)
 
+########################################################
+## splice
+########################################################
+
+include $(CLEAR_VARS)
+
+# splice() relay behind redsocks' bufferevents once a connection is established, see splice/redsocks_splice.c
+LOCAL_MODULE := splice
+LOCAL_CFLAGS := -Wall -O2 -std=gnu99 \
+	-I$(LOCAL_PATH)/redsocks \
+	-I$(LOCAL_PATH)/libevent/include \
+	-I$(LOCAL_PATH)/libevent
+LOCAL_SRC_FILES := splice/splice_relay.c splice/redsocks_splice.c
+
+include $(BUILD_STATIC_LIBRARY)
+
 ########################################################
 ## redsocks
 ########################################################
@@ -292,7 +405,7 @@ REDSOCKS_SOURCES := base.c http-connect.c \
 	base64.c http-auth.c http-relay.c main.c \
 	parser.c redsocks.c socks4.c utils.c
 
-LOCAL_STATIC_LIBRARIES := libevent
+LOCAL_STATIC_LIBRARIES := splice libevent
 
 LOCAL_MODULE := redsocks
 LOCAL_SRC_FILES := $(addprefix redsocks/, $(REDSOCKS_SOURCES)) 
@@ -300,6 +413,8 @@ LOCAL_CFLAGS := -std=gnu99 -DUSE_IPTABLES \
 	-I$(LOCAL_PATH)/redsocks \
 	-I$(LOCAL_PATH)/libevent/include \
 	-I$(LOCAL_PATH)/libevent
+# Established connections are relayed with splice(), see splice/redsocks_splice.c
+LOCAL_LDFLAGS := -Wl,--wrap=redsocks_start_relay
 
 include $(BUILD_SHARED_EXECUTABLE)
 
@@ -310,15 +425,18 @@ include $(BUILD_SHARED_EXECUTABLE)
 include $(CLEAR_VARS)
 
 SHADOWSOCKS_SOURCES := local.c \
-	cache.c udprelay.c utils.c netutils.c json.c jconf.c \
+	udprelay.c utils.c netutils.c json.c jconf.c \
 	acl.c http.c tls.c rule.c \
 	crypto.c aead.c stream.c base64.c \
-	plugin.c ppbloom.c \
+	plugin.c \
 	android.c
 
+# obfs-local's HTTP mode is fused in at the socket call boundary, see obfs/obfs_transport.h.
+# Fortified libc inlines would bypass the wrapped symbols, so they are turned off here.
 LOCAL_MODULE    := ss-local
-LOCAL_SRC_FILES := $(addprefix shadowsocks-libev/src/, $(SHADOWSOCKS_SOURCES))
-LOCAL_CFLAGS    := -Wall -fno-strict-aliasing -DMODULE_LOCAL \
+LOCAL_SRC_FILES := $(addprefix shadowsocks-libev/src/, $(SHADOWSOCKS_SOURCES)) \
+					obfs/obfs_transport.c obfs/obfs_main.c
+LOCAL_CFLAGS    := -Wall -fno-strict-aliasing -DMODULE_LOCAL -U_FORTIFY_SOURCE \
 					-DUSE_CRYPTO_MBEDTLS -DHAVE_CONFIG_H \
 					-DCONNECT_IN_PROGRESS=EINPROGRESS \
 					-I$(LOCAL_PATH)/include/shadowsocks-libev \
@@ -329,11 +447,18 @@ LOCAL_CFLAGS    := -Wall -fno-strict-aliasing -DMODULE_LOCAL \
 					-I$(LOCAL_PATH)/libsodium/src/libsodium/include \
 					-I$(LOCAL_PATH)/libsodium/src/libsodium/include/sodium \
 					-I$(LOCAL_PATH)/shadowsocks-libev/libcork/include \
-					-I$(LOCAL_PATH)/shadowsocks-libev/libipset/include \
-					-I$(LOCAL_PATH)/shadowsocks-libev/libbloom \
+					-I$(LOCAL_PATH)/acl/include \
+					-I$(LOCAL_PATH)/acl \
 					-I$(LOCAL_PATH)/libev
-
-LOCAL_STATIC_LIBRARIES := libev libmbedtls libipset libcork libbloom \
+# acl.c's ACL files are cached as mapped trie images, see acl/acl_lpm.c, its hostname rules are
+# matched by one automaton per list, see rule/rule_hostmatch.c, and udprelay.c's datagrams are
+# batched, see udp/udp_batch.c
+LOCAL_LDFLAGS   := $(ARENA_LDFLAGS) $(READY_LDFLAGS) -Wl,--wrap=main,--wrap=connect,--wrap=send,--wrap=recv,--wrap=close,--wrap=getaddrinfo \
+					-Wl,--wrap=init_acl,--wrap=free_acl \
+					-Wl,--wrap=init_rule,--wrap=add_rule,--wrap=remove_rule,--wrap=lookup_rule \
+					-Wl,--wrap=recvfrom,--wrap=sendto,--wrap=ev_io_stop
+
+LOCAL_STATIC_LIBRARIES := arena ready udp libev libmbedtls acl rule libcork ppbloom \
 	libsodium libancillary libpcre
 
 LOCAL_LDLIBS := -llog
@@ -347,9 +472,9 @@ include $(BUILD_SHARED_EXECUTABLE)
 include $(CLEAR_VARS)
 
 SHADOWSOCKS_SOURCES := tunnel.c \
-	cache.c udprelay.c utils.c netutils.c json.c jconf.c \
+	udprelay.c utils.c netutils.c json.c jconf.c \
 	crypto.c aead.c stream.c base64.c \
-	plugin.c ppbloom.c \
+	plugin.c \
 	android.c
 
 LOCAL_MODULE    := ss-tunnel
@@ -364,15 +489,91 @@ LOCAL_CFLAGS    := -Wall -fno-strict-aliasing -DMODULE_TUNNEL \
 					-I$(LOCAL_PATH)/mbedtls/include \
 					-I$(LOCAL_PATH)/libev \
 					-I$(LOCAL_PATH)/shadowsocks-libev/libcork/include \
-					-I$(LOCAL_PATH)/shadowsocks-libev/libbloom \
 					-I$(LOCAL_PATH)/include/shadowsocks-libev
 
-LOCAL_STATIC_LIBRARIES := libev libmbedtls libsodium libcork libbloom libancillary
+LOCAL_STATIC_LIBRARIES := udp libev libmbedtls libsodium libcork ppbloom libancillary
 
 LOCAL_LDLIBS := -llog
 
 include $(BUILD_SHARED_EXECUTABLE)
 
+########################################################
+## probe
+########################################################
+
+include $(CLEAR_VARS)
+
+PROBE_SOURCES := address.cpp batch.cpp probe.cpp trace.cpp
+
+LOCAL_MODULE := probe
+LOCAL_CFLAGS := -std=c++11 -Wall
+LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/probe
+LOCAL_SRC_FILES := $(addprefix probe/, $(PROBE_SOURCES))
+
+include $(BUILD_STATIC_LIBRARY)
+
+########################################################
+## supervisor
+########################################################
+
+include $(CLEAR_VARS)
+
+# Spawns and watches the helper executables for GuardedProcessPool, see supervisor/supervisor.h
+LOCAL_MODULE := supervisor
+LOCAL_CFLAGS := -std=c++11 -Wall
+LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/supervisor
+LOCAL_SRC_FILES := supervisor/supervisor.cpp
+
+include $(BUILD_STATIC_LIBRARY)
+
+########################################################
+## aead
+########################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := aead
+LOCAL_CFLAGS := -Wall
+LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/crypto
+LOCAL_SRC_FILES := crypto/aead_select.c
+LOCAL_STATIC_LIBRARIES := cpufeatures
+
+include $(BUILD_STATIC_LIBRARY)
+
+########################################################
+## csum
+########################################################
+
+include $(CLEAR_VARS)
+
+# One's complement checksums for tun2socks' lwIP and traceroute, see csum/csum.h
+LOCAL_MODULE := csum
+LOCAL_CFLAGS := -Wall -O2
+LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/csum
+LOCAL_SRC_FILES := csum/csum.c csum/csum_x86.c
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_SRC_FILES += csum/csum_neon.c.neon
+else
+LOCAL_SRC_FILES += csum/csum_neon.c
+endif
+LOCAL_STATIC_LIBRARIES := cpufeatures
+
+include $(BUILD_STATIC_LIBRARY)
+
+########################################################
+## tun
+########################################################
+
+include $(CLEAR_VARS)
+
+# IFF_VNET_HDR batching and sharding under tun2socks' BTap.c, see tun/tun_batch.c and tun/tun_shard.c
+LOCAL_MODULE := tun
+LOCAL_CFLAGS := -Wall -O2 -I$(LOCAL_PATH)/libancillary
+LOCAL_SRC_FILES := tun/tun_batch.c tun/tun_offload.c tun/tun_shard.c
+LOCAL_STATIC_LIBRARIES := csum libancillary
+
+include $(BUILD_STATIC_LIBRARY)
+
 ########################################################
 ## jni-helper
 ########################################################
@@ -389,7 +590,7 @@ LOCAL_SRC_FILES:= jni-helper.cpp
 
 LOCAL_LDLIBS := -ldl -llog
 
-LOCAL_STATIC_LIBRARIES := cpufeatures libancillary
+LOCAL_STATIC_LIBRARIES := cpufeatures libancillary aead probe supervisor
 
 include $(BUILD_SHARED_LIBRARY)
 
@@ -405,8 +606,16 @@ LOCAL_CFLAGS += -DBADVPN_USE_SIGNALFD -DBADVPN_USE_EPOLL
 LOCAL_CFLAGS += -DBADVPN_LITTLE_ENDIAN -DBADVPN_THREAD_SAFE
 LOCAL_CFLAGS += -DNDEBUG -DANDROID
 # LOCAL_CFLAGS += -DTUN2SOCKS_JNI
+# lwIP checksums through csum/, see csum/lwip_csum.h
+LOCAL_CFLAGS += -include $(LOCAL_PATH)/csum/lwip_csum.h
+# lwIP's heap and pools come from the slab arena, see arena/lwip_mem.h
+LOCAL_CFLAGS += -include $(LOCAL_PATH)/arena/lwip_mem.h
+# BTap.c's TUN I/O is batched when it opens the device itself, see tun/tun_batch.c, and
+# --shards runs one stack per core behind a flow-hashing dispatcher, see tun/tun_shard.c
+LOCAL_LDFLAGS := -Wl,--wrap=ioctl,--wrap=read,--wrap=write,--wrap=epoll_wait \
+				-Wl,--wrap=main,--wrap=ancil_recv_fd
 
-LOCAL_STATIC_LIBRARIES := libancillary
+LOCAL_STATIC_LIBRARIES := tun csum arena cpufeatures libancillary
 
 LOCAL_C_INCLUDES:= \
 		$(LOCAL_PATH)/libancillary \
@@ -510,7 +719,8 @@ include $(CLEAR_VARS)
 
 LOCAL_MODULE := pcre
 
-LOCAL_CFLAGS += -DHAVE_CONFIG_H
+# JIT for the hostname rules that do not fit rule/hostmatch.c
+LOCAL_CFLAGS += -DHAVE_CONFIG_H -DSUPPORT_JIT
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/pcre/dist $(LOCAL_PATH)/pcre
 
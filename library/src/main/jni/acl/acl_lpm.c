@@ -0,0 +1,154 @@
+#include <ipset/ipset.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <android/log.h>
+
+#define LOG_TAG "acl"
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+#define IMAGE_SUFFIX ".lpm"
+#define MAX_SETS 16
+
+/*
+ * ss-local is linked with -Wl,--wrap=init_acl,--wrap=free_acl. The first start after the ACL file
+ * changed parses it as usual and saves the resulting sets as <acl>.lpm; later starts map that image
+ * and attach its tables to the sets as acl.c initialises them, so the address lines it still reads
+ * are skipped instead of inserted. Domain rules are always taken from the text.
+ */
+
+int __real_init_acl(const char *path);
+void __real_free_acl(void);
+
+/* ss-local runs a single event loop thread, nothing here needs locking */
+static struct lpm_image *image;
+static int loading;             /* init_acl() is reading a source that the image already covers */
+static struct ip_set *sets[MAX_SETS];
+static size_t n_sets;
+
+void ipset_init_library(void)
+{
+}
+
+void acl_set_init(struct ip_set *set, const char *name)
+{
+    // `name` is the stringified argument, usually "&white_list_ipv4"
+    while (*name == '&' || *name == ' ') ++name;
+    set->name = name;
+    lpm_init(&set->ipv4, AF_INET);
+    lpm_init(&set->ipv6, AF_INET6);
+    if (image != NULL) {
+        lpm_image_find(image, name, AF_INET, &set->ipv4);
+        lpm_image_find(image, name, AF_INET6, &set->ipv6);
+    }
+    if (n_sets < MAX_SETS) sets[n_sets++] = set;
+}
+
+void ipset_done(struct ip_set *set)
+{
+    lpm_free(&set->ipv4);
+    lpm_free(&set->ipv6);
+    for (size_t i = 0; i < n_sets; ++i) {
+        if (sets[i] == set) sets[i] = sets[--n_sets];
+    }
+}
+
+static bool add(struct lpm *lpm, const uint8_t *address, unsigned prefix)
+{
+    bool present = lpm_contains(lpm, address);
+    if (!loading && lpm_add(lpm, address, prefix) == -1) LOGW("cannot add address: %s", strerror(errno));
+    return present;
+}
+
+static bool remove_address(struct lpm *lpm, const uint8_t *address)
+{
+    int removed = lpm_remove(lpm, address);
+    if (removed == -1) LOGW("cannot remove address: %s", strerror(errno));
+    return removed == 1;
+}
+
+bool ipset_ipv4_add(struct ip_set *set, struct cork_ipv4 *elem)
+{
+    return add(&set->ipv4, elem->_.u8, 32);
+}
+
+bool ipset_ipv4_add_network(struct ip_set *set, struct cork_ipv4 *elem, unsigned int cidr_prefix)
+{
+    return add(&set->ipv4, elem->_.u8, cidr_prefix);
+}
+
+bool ipset_ipv4_remove(struct ip_set *set, struct cork_ipv4 *elem)
+{
+    return remove_address(&set->ipv4, elem->_.u8);
+}
+
+bool ipset_ipv6_add(struct ip_set *set, struct cork_ipv6 *elem)
+{
+    return add(&set->ipv6, elem->_.u8, 128);
+}
+
+bool ipset_ipv6_add_network(struct ip_set *set, struct cork_ipv6 *elem, unsigned int cidr_prefix)
+{
+    return add(&set->ipv6, elem->_.u8, cidr_prefix);
+}
+
+bool ipset_ipv6_remove(struct ip_set *set, struct cork_ipv6 *elem)
+{
+    return remove_address(&set->ipv6, elem->_.u8);
+}
+
+bool ipset_contains_ipv4(const struct ip_set *set, struct cork_ipv4 *elem)
+{
+    return lpm_contains(&set->ipv4, elem->_.u8);
+}
+
+bool ipset_contains_ipv6(const struct ip_set *set, struct cork_ipv6 *elem)
+{
+    return lpm_contains(&set->ipv6, elem->_.u8);
+}
+
+static void save_image(const char *path, const struct stat *source)
+{
+    struct lpm_named named[2 * MAX_SETS];
+    size_t count = 0;
+    for (size_t i = 0; i < n_sets; ++i) {
+        named[count].name = sets[i]->name;
+        named[count++].lpm = &sets[i]->ipv4;
+        named[count].name = sets[i]->name;
+        named[count++].lpm = &sets[i]->ipv6;
+    }
+    // Best effort, the next start just parses the text again
+    if (lpm_image_write(path, named, count, (uint64_t) source->st_size,
+                        source->st_mtim.tv_sec * 1000000000LL + source->st_mtim.tv_nsec) == -1) {
+        LOGW("cannot save %s: %s", path, strerror(errno));
+    }
+}
+
+int __wrap_init_acl(const char *path)
+{
+    char image_path[PATH_MAX];
+    struct stat source;
+    int cacheable = stat(path, &source) == 0 &&
+            snprintf(image_path, sizeof(image_path), "%s%s", path, IMAGE_SUFFIX) < (int) sizeof(image_path);
+    if (cacheable) {
+        image = lpm_image_map(image_path, (uint64_t) source.st_size,
+                              source.st_mtim.tv_sec * 1000000000LL + source.st_mtim.tv_nsec);
+    }
+
+    loading = image != NULL;
+    int ret = __real_init_acl(path);
+    loading = 0;
+    if (ret == 0 && cacheable && image == NULL) save_image(image_path, &source);
+    return ret;
+}
+
+void __wrap_free_acl(void)
+{
+    __real_free_acl();
+    lpm_image_unmap(image);
+    image = NULL;
+}
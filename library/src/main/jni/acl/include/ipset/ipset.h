@@ -0,0 +1,48 @@
+#ifndef IPSET_IPSET_H
+#define IPSET_IPSET_H
+
+/*
+ * Stands in for libipset's header when shadowsocks-libev's acl.c is built: the subset of the
+ * libipset API acl.c calls, backed by the flat tries of lpm.h instead of BDDs. Sets remember the
+ * variable name they were initialised with, which is how acl_lpm.c matches them to the sets of a
+ * cached image.
+ */
+
+#include <stdbool.h>
+
+#include <libcork/core.h>
+
+#include "lpm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ip_set {
+    struct lpm ipv4;
+    struct lpm ipv6;
+    const char *name;
+};
+
+void ipset_init_library(void);
+
+void acl_set_init(struct ip_set *set, const char *name);
+#define ipset_init(set) acl_set_init((set), #set)
+void ipset_done(struct ip_set *set);
+
+/* All return whether the element was in the set before the call */
+bool ipset_ipv4_add(struct ip_set *set, struct cork_ipv4 *elem);
+bool ipset_ipv4_add_network(struct ip_set *set, struct cork_ipv4 *elem, unsigned int cidr_prefix);
+bool ipset_ipv4_remove(struct ip_set *set, struct cork_ipv4 *elem);
+bool ipset_ipv6_add(struct ip_set *set, struct cork_ipv6 *elem);
+bool ipset_ipv6_add_network(struct ip_set *set, struct cork_ipv6 *elem, unsigned int cidr_prefix);
+bool ipset_ipv6_remove(struct ip_set *set, struct cork_ipv6 *elem);
+
+bool ipset_contains_ipv4(const struct ip_set *set, struct cork_ipv4 *elem);
+bool ipset_contains_ipv6(const struct ip_set *set, struct cork_ipv6 *elem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
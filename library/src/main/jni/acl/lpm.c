@@ -0,0 +1,341 @@
+#include "lpm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IMAGE_MAGIC "PATHLPM1"
+#define IMAGE_VERSION 1
+#define IMAGE_ALIGN 64
+#define MAX_NAME 32
+#define MAX_SETS 64
+
+struct image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t set_count;
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    uint64_t file_size;
+};
+
+struct image_set {
+    char name[MAX_NAME];
+    uint32_t address_bytes;
+    uint32_t chunk_count;
+    uint64_t root_offset;
+    uint64_t chunks_offset;     /* chunk 0 included, so child indices apply as they are */
+};
+
+struct lpm_image {
+    void *base;
+    size_t size;
+    const struct image_header *header;
+    const struct image_set *sets;
+};
+
+void lpm_init(struct lpm *lpm, int family)
+{
+    memset(lpm, 0, sizeof(*lpm));
+    lpm->address_bytes = family == AF_INET6 ? 16 : 4;
+    lpm->chunk_count = 1;
+}
+
+static int64_t new_chunk(struct lpm *lpm)
+{
+    if (lpm->chunk_count >= lpm->chunk_capacity) {
+        uint32_t capacity = lpm->chunk_capacity == 0 ? 16 : lpm->chunk_capacity * 2;
+        if (capacity > (UINT32_MAX >> 1)) {
+            errno = ENOMEM;
+            return -1;
+        }
+        uint32_t *chunks = realloc(lpm->chunks, (size_t) capacity * LPM_CHUNK_SIZE * sizeof(uint32_t));
+        if (chunks == NULL) return -1;
+        if (lpm->chunk_capacity == 0) memset(chunks, 0, LPM_CHUNK_SIZE * sizeof(uint32_t));
+        lpm->chunks = chunks;
+        lpm->chunk_capacity = capacity;
+    }
+    memset(lpm->chunks + (size_t) lpm->chunk_count * LPM_CHUNK_SIZE, 0, LPM_CHUNK_SIZE * sizeof(uint32_t));
+    return lpm->chunk_count++;
+}
+
+/* Marks the 2^free_bits entries sharing `slot`'s leading bits as covered, dropping any subtrees */
+static void fill(uint32_t *table, uint32_t slot, unsigned free_bits)
+{
+    uint32_t span = 1u << free_bits, start = slot & ~(span - 1);
+    for (uint32_t i = start; i < start + span; ++i) table[i] = LPM_MATCH;
+}
+
+/* Replaces mapped tables with a private copy before they are changed */
+static int own(struct lpm *lpm)
+{
+    if (!lpm->read_only) return 0;
+    size_t chunks_bytes = (size_t) lpm->chunk_count * LPM_CHUNK_SIZE * sizeof(uint32_t);
+    uint32_t *root = malloc(LPM_ROOT_SIZE * sizeof(uint32_t));
+    uint32_t *chunks = malloc(chunks_bytes);
+    if (root == NULL || chunks == NULL) {
+        free(root);
+        free(chunks);
+        return -1;
+    }
+    memcpy(root, lpm->root, LPM_ROOT_SIZE * sizeof(uint32_t));
+    memcpy(chunks, lpm->chunks, chunks_bytes);
+    lpm->root = root;
+    lpm->chunks = chunks;
+    lpm->chunk_capacity = lpm->chunk_count;
+    lpm->read_only = 0;
+    return 0;
+}
+
+int lpm_add(struct lpm *lpm, const uint8_t *address, unsigned prefix)
+{
+    if (own(lpm) == -1) return -1;
+    if (prefix > lpm->address_bytes * 8) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (lpm->root == NULL && (lpm->root = calloc(LPM_ROOT_SIZE, sizeof(uint32_t))) == NULL) return -1;
+
+    uint32_t slot = (uint32_t) address[0] << 8 | address[1];
+    if (prefix <= LPM_ROOT_BITS) {
+        fill(lpm->root, slot, LPM_ROOT_BITS - prefix);
+        return 0;
+    }
+    uint32_t chunk = 0;         /* 0 stands for the root table here */
+    unsigned depth = LPM_ROOT_BITS;
+    for (unsigned byte = 2;; ++byte, depth += 8) {
+        uint32_t *entry = chunk == 0 ? &lpm->root[slot] : &lpm->chunks[(size_t) chunk * LPM_CHUNK_SIZE + slot];
+        if (*entry == LPM_MATCH) return 0;     /* a shorter prefix covers it already */
+        if (*entry == LPM_MISS) {
+            int64_t child = new_chunk(lpm);
+            if (child == -1) return -1;
+            // new_chunk() may have moved the chunks
+            entry = chunk == 0 ? &lpm->root[slot] : &lpm->chunks[(size_t) chunk * LPM_CHUNK_SIZE + slot];
+            *entry = (uint32_t) child << 1;
+        }
+        chunk = *entry >> 1;
+        slot = address[byte];
+        if (prefix - depth <= 8) {
+            fill(lpm->chunks + (size_t) chunk * LPM_CHUNK_SIZE, slot, 8 - (prefix - depth));
+            return 0;
+        }
+    }
+}
+
+int lpm_remove(struct lpm *lpm, const uint8_t *address)
+{
+    if (!lpm_contains(lpm, address)) return 0;
+    if (own(lpm) == -1) return -1;
+    uint32_t chunk = 0, slot = (uint32_t) address[0] << 8 | address[1];
+    for (unsigned byte = 2;; ++byte) {
+        uint32_t *entry = chunk == 0 ? &lpm->root[slot] : &lpm->chunks[(size_t) chunk * LPM_CHUNK_SIZE + slot];
+        if (byte == lpm->address_bytes) {
+            *entry = LPM_MISS;
+            return 1;
+        }
+        if (*entry == LPM_MATCH) {
+            // Split the covering prefix: the child covers everything but the path to `address`
+            int64_t child = new_chunk(lpm);
+            if (child == -1) return -1;
+            entry = chunk == 0 ? &lpm->root[slot] : &lpm->chunks[(size_t) chunk * LPM_CHUNK_SIZE + slot];
+            fill(lpm->chunks + (size_t) child * LPM_CHUNK_SIZE, 0, 8);
+            *entry = (uint32_t) child << 1;
+        }
+        chunk = *entry >> 1;
+        slot = address[byte];
+    }
+}
+
+int lpm_contains(const struct lpm *lpm, const uint8_t *address)
+{
+    if (lpm->root == NULL) return 0;
+    uint32_t entry = lpm->root[(uint32_t) address[0] << 8 | address[1]];
+    // The byte bound only matters for a damaged image, lpm_add() never nests deeper
+    for (unsigned byte = 2; entry > LPM_MATCH && byte < lpm->address_bytes; ++byte) {
+        entry = lpm->chunks[(size_t) (entry >> 1) * LPM_CHUNK_SIZE + address[byte]];
+    }
+    return entry == LPM_MATCH;
+}
+
+void lpm_free(struct lpm *lpm)
+{
+    int family = lpm->address_bytes == 16 ? AF_INET6 : AF_INET;
+    if (!lpm->read_only) {
+        free(lpm->root);
+        free(lpm->chunks);
+    }
+    lpm_init(lpm, family);
+}
+
+static size_t align(size_t offset)
+{
+    return (offset + IMAGE_ALIGN - 1) & ~(size_t) (IMAGE_ALIGN - 1);
+}
+
+static int write_at(int fd, const void *data, size_t length, size_t offset)
+{
+    const char *bytes = data;
+    while (length > 0) {
+        ssize_t n = pwrite(fd, bytes, length, (off_t) offset);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        bytes += n;
+        length -= (size_t) n;
+        offset += (size_t) n;
+    }
+    return 0;
+}
+
+int lpm_image_write(const char *path, const struct lpm_named *sets, size_t count,
+                    uint64_t source_size, int64_t source_mtime_ns)
+{
+    if (count > MAX_SETS) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct image_header header;
+    struct image_set entries[MAX_SETS];
+    memset(&header, 0, sizeof(header));
+    memset(entries, 0, sizeof(entries));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.source_size = source_size;
+    header.source_mtime_ns = source_mtime_ns;
+
+    // Empty sets are left out, lpm_image_find() reports them missing and they stay empty
+    size_t offset = align(sizeof(header) + count * sizeof(struct image_set));
+    for (size_t i = 0; i < count; ++i) {
+        const struct lpm *lpm = sets[i].lpm;
+        if (lpm->root == NULL) continue;
+        struct image_set *entry = &entries[header.set_count++];
+        strncpy(entry->name, sets[i].name, MAX_NAME - 1);
+        entry->address_bytes = lpm->address_bytes;
+        entry->chunk_count = lpm->chunks == NULL ? 1 : lpm->chunk_count;
+        entry->root_offset = offset;
+        entry->chunks_offset = align(offset + LPM_ROOT_SIZE * sizeof(uint32_t));
+        offset = align(entry->chunks_offset + (size_t) entry->chunk_count * LPM_CHUNK_SIZE * sizeof(uint32_t));
+    }
+    header.file_size = offset;
+
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int) getpid()) >= (int) sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) return -1;
+    static const uint32_t empty_chunk[LPM_CHUNK_SIZE];
+    int failed = write_at(fd, &header, sizeof(header), 0) ||
+            write_at(fd, entries, header.set_count * sizeof(struct image_set), sizeof(header)) ||
+            ftruncate(fd, (off_t) header.file_size) == -1;
+    for (size_t i = 0, written = 0; !failed && i < count; ++i) {
+        const struct lpm *lpm = sets[i].lpm;
+        if (lpm->root == NULL) continue;
+        const struct image_set *entry = &entries[written++];
+        failed = write_at(fd, lpm->root, LPM_ROOT_SIZE * sizeof(uint32_t), entry->root_offset) ||
+                (lpm->chunks == NULL
+                 ? write_at(fd, empty_chunk, sizeof(empty_chunk), entry->chunks_offset)
+                 : write_at(fd, lpm->chunks, (size_t) entry->chunk_count * LPM_CHUNK_SIZE * sizeof(uint32_t),
+                            entry->chunks_offset));
+    }
+    if (close(fd) == -1) failed = 1;
+    if (failed || rename(tmp, path) == -1) {
+        int error = errno;
+        unlink(tmp);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/* Every entry must be a leaf or point at an existing chunk */
+static int valid_entries(const uint32_t *entries, size_t length, uint32_t chunk_count)
+{
+    for (size_t i = 0; i < length; ++i) {
+        uint32_t entry = entries[i];
+        if (entry > LPM_MATCH && ((entry & 1) || (entry >> 1) >= chunk_count)) return 0;
+    }
+    return 1;
+}
+
+static int valid_set(const struct lpm_image *image, const struct image_set *set)
+{
+    size_t root_bytes = LPM_ROOT_SIZE * sizeof(uint32_t);
+    size_t chunks_bytes = (size_t) set->chunk_count * LPM_CHUNK_SIZE * sizeof(uint32_t);
+    if ((set->address_bytes != 4 && set->address_bytes != 16) || set->chunk_count == 0 ||
+            set->root_offset % IMAGE_ALIGN || set->chunks_offset % IMAGE_ALIGN ||
+            set->root_offset > image->size || image->size - set->root_offset < root_bytes ||
+            set->chunks_offset > image->size || image->size - set->chunks_offset < chunks_bytes) {
+        return 0;
+    }
+    const char *base = image->base;
+    return valid_entries((const uint32_t *) (base + set->root_offset), LPM_ROOT_SIZE, set->chunk_count) &&
+            valid_entries((const uint32_t *) (base + set->chunks_offset), chunks_bytes / sizeof(uint32_t),
+                          set->chunk_count);
+}
+
+struct lpm_image *lpm_image_map(const char *path, uint64_t source_size, int64_t source_mtime_ns)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+    struct stat st;
+    struct lpm_image *image = calloc(1, sizeof(*image));
+    if (image == NULL || fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct image_header)) {
+        free(image);
+        close(fd);
+        return NULL;
+    }
+    image->size = (size_t) st.st_size;
+    image->base = mmap(NULL, image->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image->base == MAP_FAILED) {
+        free(image);
+        return NULL;
+    }
+    image->header = image->base;
+    image->sets = (const struct image_set *) (image->header + 1);
+
+    const struct image_header *header = image->header;
+    int valid = memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) == 0 &&
+            header->version == IMAGE_VERSION && header->file_size == image->size &&
+            header->source_size == source_size && header->source_mtime_ns == source_mtime_ns &&
+            header->set_count <= MAX_SETS &&
+            sizeof(*header) + header->set_count * sizeof(struct image_set) <= image->size;
+    for (uint32_t i = 0; valid && i < header->set_count; ++i) valid = valid_set(image, &image->sets[i]);
+    if (!valid) {
+        lpm_image_unmap(image);
+        return NULL;
+    }
+    return image;
+}
+
+int lpm_image_find(const struct lpm_image *image, const char *name, int family, struct lpm *lpm)
+{
+    unsigned address_bytes = family == AF_INET6 ? 16 : 4;
+    for (uint32_t i = 0; i < image->header->set_count; ++i) {
+        const struct image_set *set = &image->sets[i];
+        if (set->address_bytes != address_bytes || strncmp(set->name, name, MAX_NAME) != 0) continue;
+        const char *base = image->base;
+        memset(lpm, 0, sizeof(*lpm));
+        lpm->root = (uint32_t *) (base + set->root_offset);
+        lpm->chunks = (uint32_t *) (base + set->chunks_offset);
+        lpm->chunk_count = set->chunk_count;
+        lpm->address_bytes = address_bytes;
+        lpm->read_only = 1;
+        return 0;
+    }
+    return -1;
+}
+
+void lpm_image_unmap(struct lpm_image *image)
+{
+    if (image == NULL) return;
+    munmap(image->base, image->size);
+    free(image);
+}
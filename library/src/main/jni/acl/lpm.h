@@ -0,0 +1,83 @@
+#ifndef PATH_LPM_H
+#define PATH_LPM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Flat multibit trie answering "is this address covered by any prefix in the set".
+ *
+ * The first 16 address bits index a 65536 entry root table, every further byte indexes a 256 entry
+ * chunk, so an IPv4 lookup takes at most three loads and an IPv6 one stops as soon as it leaves the
+ * prefixes' depth (a /48 takes five). Prefixes are expanded into the tables when they are added,
+ * which leaves no backtracking to do on lookup. Entries are LPM_MISS, LPM_MATCH or the index of
+ * a child chunk shifted left by one. All tables are plain arrays, so a set can be written out as is
+ * and mapped back in read-only.
+ */
+
+#define LPM_MISS 0u
+#define LPM_MATCH 1u
+#define LPM_ROOT_BITS 16
+#define LPM_ROOT_SIZE (1u << LPM_ROOT_BITS)
+#define LPM_CHUNK_SIZE 256u
+
+struct lpm {
+    uint32_t *root;             /* NULL while the set is empty */
+    uint32_t *chunks;           /* chunk 0 is never used, child index 0 would read as a leaf */
+    uint32_t chunk_count;
+    uint32_t chunk_capacity;
+    unsigned address_bytes;     /* 4 or 16 */
+    int read_only;              /* tables are mapped from an image, copied on the first change */
+};
+
+/* `family` is AF_INET or AF_INET6 */
+void lpm_init(struct lpm *lpm, int family);
+
+/* Adds `address`/`prefix` (network byte order). Returns 0, or -1 with errno set. */
+int lpm_add(struct lpm *lpm, const uint8_t *address, unsigned prefix);
+
+/* Takes the single `address` out of the set, splitting any prefix that covered it. Returns 1 if it
+ * was covered, 0 if not, -1 with errno set on failure. */
+int lpm_remove(struct lpm *lpm, const uint8_t *address);
+
+/* Returns 1 if `address` falls into any added prefix, 0 otherwise */
+int lpm_contains(const struct lpm *lpm, const uint8_t *address);
+
+/* Frees owned tables, forgets mapped ones */
+void lpm_free(struct lpm *lpm);
+
+/*
+ * Binary images of named sets, written next to the text ACL they were built from. The header
+ * records the source's size and modification time, so a stale image is never used. Images are in
+ * host byte order and only read back by the same build.
+ */
+
+struct lpm_named {
+    const char *name;
+    const struct lpm *lpm;
+};
+
+struct lpm_image;
+
+/* Writes `count` sets to `path` atomically. Returns 0, or -1 with errno set. */
+int lpm_image_write(const char *path, const struct lpm_named *sets, size_t count,
+                    uint64_t source_size, int64_t source_mtime_ns);
+
+/* Maps the image at `path`. Returns NULL if it is missing, malformed or not built from a source
+ * of the given size and modification time. */
+struct lpm_image *lpm_image_map(const char *path, uint64_t source_size, int64_t source_mtime_ns);
+
+/* Points `lpm` at the mapped set `name` of `family`. Returns 0, or -1 if the image has no such set. */
+int lpm_image_find(const struct lpm_image *image, const char *name, int family, struct lpm *lpm);
+
+void lpm_image_unmap(struct lpm_image *image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
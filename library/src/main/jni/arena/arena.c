@@ -0,0 +1,221 @@
+#include "arena.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <android/log.h>
+
+#define LOG_TAG "arena"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+#ifndef ARENA_SLABS
+#if UINTPTR_MAX > 0xffffffffu
+#define ARENA_SLABS 1024        /* 256 MiB of address space */
+#else
+#define ARENA_SLABS 128         /* 32 MiB, address space is scarce in 32 bit processes */
+#endif
+#endif
+
+#define FIRST_REPORT 4          /* slabs at the first high-water mark report, then at every doubling */
+#define NO_CLASS 0xff
+
+/*
+ * 1536 holds one MSS of payload, 16640 a 16383 byte AEAD chunk with its salt, length and tags (or a
+ * TLS record with its header), 33280 two of them, which is what the relays grow to when the peer
+ * is slower than the sender.
+ */
+static const uint32_t class_sizes[ARENA_CLASSES] = {
+    32, 64, 128, 256, 512, 1024, 1536, 2048, 4096, 8192, 16640, 33280,
+};
+
+struct free_object {
+    struct free_object *next;
+};
+
+struct slab {
+    struct free_object *free;   /* freed objects */
+    uint32_t fresh;             /* objects never handed out start at this index */
+    uint32_t in_use;
+    uint8_t size_class;         /* NO_CLASS while the slab is in the empty pool */
+    struct slab *next;          /* in its class' list of slabs with room, or the empty pool */
+    struct slab *prev;
+};
+
+static struct {
+    char *base;                 /* NULL until first use */
+    int failed;
+    struct slab slabs[ARENA_SLABS];
+    uint32_t fresh_slabs;       /* slabs never used start at this index */
+    struct slab *empty;
+    struct slab *partial[ARENA_CLASSES];
+    size_t reported_slabs;
+    struct arena_stats stats;
+} arena;
+
+static int size_class(size_t size)
+{
+    for (int i = 0; i < ARENA_CLASSES; ++i) {
+        if (size <= class_sizes[i]) return i;
+    }
+    return -1;
+}
+
+static char *slab_base(const struct slab *slab)
+{
+    return arena.base + (size_t) (slab - arena.slabs) * ARENA_SLAB_SIZE;
+}
+
+static struct slab *slab_of(const void *ptr)
+{
+    return &arena.slabs[(size_t) ((const char *) ptr - arena.base) / ARENA_SLAB_SIZE];
+}
+
+static void unlink_slab(struct slab **list, struct slab *slab)
+{
+    if (slab->prev != NULL) slab->prev->next = slab->next;
+    else *list = slab->next;
+    if (slab->next != NULL) slab->next->prev = slab->prev;
+    slab->next = slab->prev = NULL;
+}
+
+static void push_slab(struct slab **list, struct slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL) (*list)->prev = slab;
+    *list = slab;
+}
+
+static int reserve(void)
+{
+    // Untouched pages of the range cost no memory, MAP_NORESERVE keeps them out of the commit charge
+    void *base = mmap(NULL, (size_t) ARENA_SLABS * ARENA_SLAB_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        LOGW("cannot reserve %u slabs: %s", ARENA_SLABS, strerror(errno));
+        arena.failed = 1;
+        return -1;
+    }
+    arena.base = base;
+    for (int i = 0; i < ARENA_CLASSES; ++i) arena.stats.classes[i].size = class_sizes[i];
+    return 0;
+}
+
+static void report(void)
+{
+    char classes[ARENA_CLASSES * 24];
+    size_t length = 0;
+    for (int i = 0; i < ARENA_CLASSES && length < sizeof(classes); ++i) {
+        if (arena.stats.classes[i].peak == 0) continue;
+        length += (size_t) snprintf(classes + length, sizeof(classes) - length, " %u:%zu",
+                                    class_sizes[i], arena.stats.classes[i].peak);
+    }
+    LOGI("high-water mark %zu KiB in %zu slabs, peak objects by size%s",
+         arena.stats.peak_bytes_in_use / 1024, arena.stats.peak_slabs_in_use, classes);
+}
+
+static struct slab *take_slab(int size_class)
+{
+    struct slab *slab = arena.empty;
+    if (slab != NULL) unlink_slab(&arena.empty, slab);
+    else if (arena.fresh_slabs < ARENA_SLABS) slab = &arena.slabs[arena.fresh_slabs++];
+    else return NULL;
+    slab->free = NULL;
+    slab->fresh = 0;
+    slab->in_use = 0;
+    slab->size_class = (uint8_t) size_class;
+    push_slab(&arena.partial[size_class], slab);
+
+    if (++arena.stats.slabs_in_use > arena.stats.peak_slabs_in_use) {
+        arena.stats.peak_slabs_in_use = arena.stats.slabs_in_use;
+        if (arena.stats.peak_slabs_in_use >= (arena.reported_slabs == 0 ? FIRST_REPORT : 2 * arena.reported_slabs)) {
+            arena.reported_slabs = arena.stats.peak_slabs_in_use;
+            report();
+        }
+    }
+    return slab;
+}
+
+static void give_slab(struct slab *slab)
+{
+    unlink_slab(&arena.partial[slab->size_class], slab);
+    slab->size_class = NO_CLASS;
+    madvise(slab_base(slab), ARENA_SLAB_SIZE, MADV_DONTNEED);
+    push_slab(&arena.empty, slab);
+    --arena.stats.slabs_in_use;
+}
+
+void *arena_alloc(size_t size)
+{
+    int c = size_class(size);
+    if (c < 0) return NULL;
+    if (arena.base == NULL && (arena.failed || reserve() == -1)) return NULL;
+
+    struct slab *slab = arena.partial[c];
+    if (slab == NULL && (slab = take_slab(c)) == NULL) return NULL;
+    void *ptr;
+    if (slab->free != NULL) {
+        ptr = slab->free;
+        slab->free = slab->free->next;
+    } else {
+        ptr = slab_base(slab) + (size_t) slab->fresh++ * class_sizes[c];
+    }
+    // A full slab leaves the list until one of its objects is freed
+    if (++slab->in_use == ARENA_SLAB_SIZE / class_sizes[c]) unlink_slab(&arena.partial[c], slab);
+
+    arena.stats.bytes_in_use += class_sizes[c];
+    if (arena.stats.bytes_in_use > arena.stats.peak_bytes_in_use) {
+        arena.stats.peak_bytes_in_use = arena.stats.bytes_in_use;
+    }
+    if (++arena.stats.classes[c].in_use > arena.stats.classes[c].peak) {
+        arena.stats.classes[c].peak = arena.stats.classes[c].in_use;
+    }
+    return ptr;
+}
+
+void arena_free(void *ptr)
+{
+    struct slab *slab = slab_of(ptr);
+    int c = slab->size_class;
+    if (slab->in_use == ARENA_SLAB_SIZE / class_sizes[c]) push_slab(&arena.partial[c], slab);
+    struct free_object *object = ptr;
+    object->next = slab->free;
+    slab->free = object;
+    --slab->in_use;
+    arena.stats.bytes_in_use -= class_sizes[c];
+    --arena.stats.classes[c].in_use;
+
+    // Keeps one slab with room per class, so a connection coming and going does not map and unmap
+    if (slab->in_use == 0 && (slab->next != NULL || slab->prev != NULL)) give_slab(slab);
+}
+
+void *arena_realloc(void *ptr, size_t size)
+{
+    size_t old_size = arena_size(ptr);
+    if (size <= old_size && size_class(size) == slab_of(ptr)->size_class) return ptr;
+    void *moved = arena_alloc(size);
+    if (moved == NULL && (moved = malloc(size)) == NULL) return NULL;
+    memcpy(moved, ptr, size < old_size ? size : old_size);
+    arena_free(ptr);
+    return moved;
+}
+
+int arena_owns(const void *ptr)
+{
+    return arena.base != NULL && (const char *) ptr >= arena.base &&
+           (const char *) ptr < arena.base + (size_t) ARENA_SLABS * ARENA_SLAB_SIZE;
+}
+
+size_t arena_size(const void *ptr)
+{
+    return class_sizes[slab_of(ptr)->size_class];
+}
+
+void arena_get_stats(struct arena_stats *stats)
+{
+    *stats = arena.stats;
+    for (int i = 0; i < ARENA_CLASSES; ++i) stats->classes[i].size = class_sizes[i];
+}
@@ -0,0 +1,62 @@
+#ifndef PATH_ARENA_H
+#define PATH_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Slab allocator for the connection state and I/O buffers of one event loop thread.
+ *
+ * Objects come in size classes sized for what the proxies allocate: small context structs, one MSS
+ * of payload, and a full 16 KiB shadowsocks chunk or TLS record with its framing. Every slab is
+ * ARENA_SLAB_SIZE bytes of one address range reserved up front, so ownership of a pointer is a
+ * range check and a slab's class is an array lookup. Freed objects are reused by the next
+ * connection. A slab whose objects are all free goes back to a shared pool, and its pages are
+ * returned to the kernel, so a long-running proxy holds on to no more than its busiest moment
+ * needed. Requests above the largest class, and any once the range is exhausted, get NULL and are
+ * left to malloc().
+ *
+ * Not thread-safe: all calls have to come from the thread that owns the loop.
+ */
+
+#define ARENA_SLAB_SIZE (256u * 1024)
+#define ARENA_CLASSES 12
+
+struct arena_stats {
+    size_t bytes_in_use;        /* sum of the size classes of live objects */
+    size_t peak_bytes_in_use;
+    size_t slabs_in_use;
+    size_t peak_slabs_in_use;
+    struct {
+        uint32_t size;
+        size_t in_use;
+        size_t peak;
+    } classes[ARENA_CLASSES];
+};
+
+/* Returns NULL if `size` is above the largest class or the arena is full */
+void *arena_alloc(size_t size);
+
+/* Resizes in place while `size` stays in the object's class, moves it otherwise. The new object
+ * may come from malloc(); returns NULL, leaving `ptr` alone, if that fails too. */
+void *arena_realloc(void *ptr, size_t size);
+
+void arena_free(void *ptr);
+
+/* Returns 1 if `ptr` points into the arena */
+int arena_owns(const void *ptr);
+
+/* Usable size of an arena object */
+size_t arena_size(const void *ptr);
+
+void arena_get_stats(struct arena_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
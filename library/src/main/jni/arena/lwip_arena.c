@@ -0,0 +1,72 @@
+#include "lwip_mem.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <android/log.h>
+
+#include "arena.h"
+
+#define LOG_TAG "lwip-mem"
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+/*
+ * lwIP's allocator for tun2socks, see lwip_mem.h. lwIP runs on the reactor thread only, the arena
+ * and the counters here need no locking. PCBs, segments and MTU sized pbufs fit the arena's classes,
+ * which grow a slab at a time under a burst of connections and hand empty slabs back to the kernel
+ * once it is over. Larger PBUF_RAM buffers go to malloc().
+ */
+
+static struct lwip_mem_stats stats;
+static size_t reported_failures;
+
+static void *allocated(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        // Logged at the first failure and at every doubling, a burst can fail thousands of times
+        if (++stats.failures >= 2 * reported_failures) {
+            reported_failures = stats.failures;
+            LOGW("out of memory for %zu bytes, %zu allocations failed so far", size, stats.failures);
+        }
+        return NULL;
+    }
+    if (++stats.objects > stats.peak_objects) stats.peak_objects = stats.objects;
+    return ptr;
+}
+
+void *lwip_mem_malloc(size_t size)
+{
+    void *ptr = arena_alloc(size);
+    if (ptr == NULL) {
+        ++stats.fallbacks;
+        ptr = malloc(size);
+    }
+    return allocated(ptr, size);
+}
+
+void *lwip_mem_calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size) return allocated(NULL, SIZE_MAX);
+    void *ptr = lwip_mem_malloc(count * size);
+    if (ptr != NULL) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void lwip_mem_free(void *ptr)
+{
+    if (ptr == NULL) return;
+    --stats.objects;
+    if (arena_owns(ptr)) arena_free(ptr);
+    else free(ptr);
+}
+
+void *lwip_mem_trim(void *ptr, size_t size)
+{
+    (void) size;
+    return ptr;
+}
+
+void lwip_mem_get_stats(struct lwip_mem_stats *out)
+{
+    *out = stats;
+}
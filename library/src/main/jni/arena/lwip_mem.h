@@ -0,0 +1,47 @@
+#ifndef PATH_LWIP_MEM_H
+#define PATH_LWIP_MEM_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Forced into every tun2socks translation unit with -include, ahead of lwipopts.h, like
+ * csum/lwip_csum.h. With MEM_LIBC_MALLOC lwIP's mem.h aliases mem_malloc() and friends to the C
+ * library only when they are left undefined, and with MEMP_MEM_MALLOC memp_malloc() is mem_malloc()
+ * of the pool's object size. So PCBs, segments and pbufs all come from lwip_arena.c instead of
+ * lwIP's heap and pools, and nothing is sized at build time. lwipopts.h sets both options the same.
+ */
+
+#define MEM_LIBC_MALLOC 1
+#define MEMP_MEM_MALLOC 1
+#define mem_malloc lwip_mem_malloc
+#define mem_calloc lwip_mem_calloc
+#define mem_free lwip_mem_free
+#define mem_trim lwip_mem_trim
+
+struct lwip_mem_stats {
+    size_t objects;             /* live, in the arena or from malloc() */
+    size_t peak_objects;
+    size_t fallbacks;           /* allocations left to malloc(): too large, or the arena was full */
+    size_t failures;            /* NULL returned to lwIP, which drops the packet or the connection */
+};
+
+void *lwip_mem_malloc(size_t size);
+
+void *lwip_mem_calloc(size_t count, size_t size);
+
+void lwip_mem_free(void *ptr);
+
+/* Never moves `ptr`, pbuf_realloc() relies on that; the object keeps its size class */
+void *lwip_mem_trim(void *ptr, size_t size);
+
+void lwip_mem_get_stats(struct lwip_mem_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
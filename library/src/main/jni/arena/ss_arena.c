@@ -0,0 +1,44 @@
+#include "arena.h"
+
+#include <stdlib.h>
+
+/*
+ * ss-local and obfs-local are linked with -Wl,--wrap=ss_malloc,--wrap=ss_realloc,--wrap=realloc,
+ * --wrap=free. Everything their utils.c hands out goes to the arena; ss_free() is a macro around
+ * free(), so free() and realloc() check whether the pointer is an arena object and pass anything
+ * else on to libc. Those two also see calls from other threads and libraries, which never hold
+ * arena pointers and only pay for the range check.
+ */
+
+void *__real_ss_malloc(size_t size);
+void *__real_ss_realloc(void *ptr, size_t new_size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_ss_malloc(size_t size)
+{
+    void *ptr = arena_alloc(size);
+    return ptr != NULL ? ptr : __real_ss_malloc(size);
+}
+
+void *__wrap_ss_realloc(void *ptr, size_t new_size)
+{
+    if (ptr == NULL) return __wrap_ss_malloc(new_size);
+    if (!arena_owns(ptr)) return __real_ss_realloc(ptr, new_size);
+    void *moved = arena_realloc(ptr, new_size);
+    // Same as utils.c when realloc() fails
+    if (moved == NULL) exit(EXIT_FAILURE);
+    return moved;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL || !arena_owns(ptr)) return __real_realloc(ptr, size);
+    return arena_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (arena_owns(ptr)) arena_free(ptr);
+    else __real_free(ptr);
+}
@@ -0,0 +1,168 @@
+#include "bench.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "probe.h"
+
+extern char **environ;
+
+namespace bench {
+
+static const size_t ECHO_CHUNK = 64 * 1024;
+static const size_t ECHO_REQUEST = 32;
+
+static std::vector<std::pair<std::string, Benchmark>> &registry() {
+    static std::vector<std::pair<std::string, Benchmark>> benchmarks;
+    return benchmarks;
+}
+
+Registration::Registration(const char *name, Benchmark benchmark) {
+    registry().emplace_back(name, benchmark);
+}
+
+const std::vector<std::pair<std::string, Benchmark>> &benchmarks() {
+    return registry();
+}
+
+Result skip(const std::string &reason) {
+    Result result;
+    result.skipped = reason;
+    return result;
+}
+
+double secondsSince(int64_t startNanos) {
+    return double(probe::nowNanos() - startNanos) / 1e9;
+}
+
+bool expired(int64_t startNanos, int durationMillis) {
+    return probe::nowNanos() - startNanos >= int64_t(durationMillis) * 1000000LL;
+}
+
+int connectLoopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uint16_t(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+bool waitForPort(int port, int timeoutMillis) {
+    int64_t start = probe::nowNanos();
+    while (!expired(start, timeoutMillis)) {
+        int fd = connectLoopback(port);
+        if (fd != -1) {
+            close(fd);
+            return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+bool writeAll(int fd, const void *data, size_t length) {
+    auto bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t n = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        length -= size_t(n);
+    }
+    return true;
+}
+
+bool readExactly(int fd, void *data, size_t length) {
+    auto bytes = static_cast<char*>(data);
+    while (length > 0) {
+        ssize_t n = recv(fd, bytes, length, 0);
+        // EAGAIN on a blocking socket comes from the obfs transport while the upgrade response is partial
+        if (n == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        length -= size_t(n);
+    }
+    return true;
+}
+
+int freePort() {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    int port = fd != -1 && bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 &&
+            getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length) == 0 ? ntohs(addr.sin_port) : 0;
+    if (fd != -1) close(fd);
+    return port;
+}
+
+double echoThroughput(int fd, int durationMillis) {
+    std::vector<char> out(ECHO_CHUNK, 'x'), in(ECHO_CHUNK);
+    size_t bytes = 0;
+    int64_t start = probe::nowNanos();
+    while (!expired(start, durationMillis)) {
+        if (!writeAll(fd, out.data(), out.size()) || !readExactly(fd, in.data(), in.size())) break;
+        bytes += ECHO_CHUNK;
+    }
+    return bytes / secondsSince(start);
+}
+
+double echoConnectionRate(const std::function<int()> &open, int durationMillis) {
+    char request[ECHO_REQUEST] = {}, reply[ECHO_REQUEST];
+    size_t connections = 0;
+    int64_t start = probe::nowNanos();
+    while (!expired(start, durationMillis)) {
+        int fd = open();
+        bool ok = fd != -1 && writeAll(fd, request, sizeof(request)) && readExactly(fd, reply, sizeof(reply));
+        if (fd != -1) close(fd);
+        if (!ok) break;
+        ++connections;
+    }
+    return connections / secondsSince(start);
+}
+
+int spawn(const std::vector<std::string> &args, bool verbose) {
+    std::vector<char*> argv;
+    for (auto &arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (!verbose) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    pid_t pid;
+    int error = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    return error == 0 ? pid : -1;
+}
+
+void terminate(int pid) {
+    if (pid <= 0) return;
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+}
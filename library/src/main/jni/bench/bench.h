@@ -0,0 +1,74 @@
+#ifndef PATH_BENCH_BENCH_H
+#define PATH_BENCH_BENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+struct Options {
+    int durationMillis = 2000;  // per measurement
+    bool verbose = false;       // keep the output of spawned helpers
+    // Host builds of the helpers from the submodules, benchmarks that need one are skipped without it
+    std::string ssLocal;
+    std::string obfsLocal;
+    std::string tun2socks;
+    std::string traceroute;
+};
+
+struct Result {
+    std::string name;
+    std::vector<std::pair<std::string, double>> metrics;
+    std::string skipped;    // reason, empty if the benchmark ran
+
+    Result &metric(const std::string &key, double value) {
+        metrics.emplace_back(key, value);
+        return *this;
+    }
+};
+
+typedef Result (*Benchmark)(const Options &options);
+
+struct Registration {
+    Registration(const char *name, Benchmark benchmark);
+};
+
+const std::vector<std::pair<std::string, Benchmark>> &benchmarks();
+
+Result skip(const std::string &reason);
+
+// Wall clock helpers on top of probe::nowNanos() (CLOCK_MONOTONIC_RAW)
+double secondsSince(int64_t startNanos);
+bool expired(int64_t startNanos, int durationMillis);
+
+// Connects a blocking TCP socket to 127.0.0.1:port, -1 on failure
+int connectLoopback(int port);
+// Polls until something accepts on 127.0.0.1:port
+bool waitForPort(int port, int timeoutMillis);
+bool writeAll(int fd, const void *data, size_t length);
+bool readExactly(int fd, void *data, size_t length);
+// Grabs an ephemeral loopback port nobody listens on yet, for helpers that want one on the command line
+int freePort();
+
+// Echoes 64 KiB blocks over a connected `fd` for `durationMillis`, returns bytes per second
+double echoThroughput(int fd, int durationMillis);
+// Opens connections with `open` (-1 on failure) and does one small echo round trip on each,
+// returns connections per second
+double echoConnectionRate(const std::function<int()> &open, int durationMillis);
+
+// Runs a helper binary in the background, returns its pid or -1
+int spawn(const std::vector<std::string> &args, bool verbose);
+void terminate(int pid);
+
+}
+
+// Defines and registers a benchmark function: BENCHMARK(name) { ... return result; }
+#define BENCHMARK(name) \
+    static bench::Result name(const bench::Options &options); \
+    static bench::Registration name##Registration(#name, name); \
+    static bench::Result name(const bench::Options &options)
+
+#endif
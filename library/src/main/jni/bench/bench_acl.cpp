@@ -0,0 +1,85 @@
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+#include "lpm.h"
+#include "probe.h"
+
+// The acl trie with a bypass-lan/china-list sized set: ~8000 IPv4 prefixes, ~1500 IPv6 ones
+BENCHMARK(acl_lookup) {
+    static const int IPV4_PREFIXES = 8000, IPV6_PREFIXES = 1500;
+    srand(1);
+    auto random32 = [] { return uint32_t(rand()) << 16 ^ uint32_t(rand()); };
+
+    int64_t start = probe::nowNanos();
+    lpm v4, v6;
+    lpm_init(&v4, AF_INET);
+    lpm_init(&v6, AF_INET6);
+    for (int i = 0; i < IPV4_PREFIXES; ++i) {
+        uint32_t address = random32();
+        lpm_add(&v4, reinterpret_cast<uint8_t *>(&address), 12 + rand() % 21);
+    }
+    for (int i = 0; i < IPV6_PREFIXES; ++i) {
+        uint8_t address[16] = { 0x24, uint8_t(rand()) };
+        for (int j = 2; j < 6; ++j) address[j] = uint8_t(rand());
+        lpm_add(&v6, address, 20 + rand() % 29);
+    }
+    double buildElapsed = bench::secondsSince(start);
+
+    char path[] = "/tmp/path-bench-acl-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) return bench::skip("mkstemp failed");
+    close(fd);
+    lpm_named named[] = { { "bench", &v4 }, { "bench", &v6 } };
+    start = probe::nowNanos();
+    int written = lpm_image_write(path, named, 2, 1, 1);
+    double writeElapsed = bench::secondsSince(start);
+    start = probe::nowNanos();
+    lpm_image *image = written == 0 ? lpm_image_map(path, 1, 1) : nullptr;
+    double mapElapsed = bench::secondsSince(start);
+    unlink(path);
+    if (image == nullptr) {
+        lpm_free(&v4);
+        lpm_free(&v6);
+        return bench::skip("cannot write or map the image");
+    }
+
+    // Lookups go to the mapped copies, the way ss-local sees them after the first start
+    lpm mapped4, mapped6;
+    lpm_image_find(image, "bench", AF_INET, &mapped4);
+    lpm_image_find(image, "bench", AF_INET6, &mapped6);
+    size_t checked4 = 0, hits4 = 0;
+    start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis / 2)) {
+        for (int i = 0; i < 1000; ++i, ++checked4) {
+            uint32_t address = uint32_t(checked4 * 0x9e3779b1u);
+            hits4 += lpm_contains(&mapped4, reinterpret_cast<uint8_t *>(&address));
+        }
+    }
+    double lookup4Elapsed = bench::secondsSince(start);
+    size_t checked6 = 0, hits6 = 0;
+    uint8_t address6[16] = { 0x24 };
+    start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis / 2)) {
+        for (int i = 0; i < 1000; ++i, ++checked6) {
+            uint64_t bits = checked6 * 0x9e3779b97f4a7c15ULL;
+            for (int j = 1; j < 8; ++j) address6[j] = uint8_t(bits >> (8 * j));
+            hits6 += lpm_contains(&mapped6, address6);
+        }
+    }
+    double lookup6Elapsed = bench::secondsSince(start);
+    lpm_image_unmap(image);
+    lpm_free(&v4);
+    lpm_free(&v6);
+
+    bench::Result result;
+    result.metric("build_ms", buildElapsed * 1e3)
+            .metric("image_write_ms", writeElapsed * 1e3)
+            .metric("image_map_ms", mapElapsed * 1e3)
+            .metric("ns_per_ipv4_lookup", lookup4Elapsed * 1e9 / checked4)
+            .metric("ns_per_ipv6_lookup", lookup6Elapsed * 1e9 / checked6)
+            .metric("ipv4_hit_ratio", double(hits4) / checked4)
+            .metric("ipv6_hit_ratio", double(hits6) / checked6);
+    return result;
+}
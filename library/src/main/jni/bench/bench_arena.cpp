@@ -0,0 +1,96 @@
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "arena.h"
+#include "bench.h"
+#include "lwip_mem.h"
+#include "probe.h"
+
+namespace {
+
+// What ss-local allocates per TCP connection: two contexts, two 16 KiB chunk buffers, a request
+struct Connection {
+    void *objects[5];
+};
+
+const size_t CONNECTION_SIZES[] = {224, 224, 16640, 16640, 280};
+
+template<typename Alloc, typename Free>
+double churn(const bench::Options &options, Alloc alloc, Free release, size_t &connections) {
+    // 256 connections open at a time, each replaced by a new one in a random slot
+    std::vector<Connection> open(256);
+    for (auto &connection : open) {
+        for (size_t i = 0; i < 5; ++i) connection.objects[i] = alloc(CONNECTION_SIZES[i]);
+    }
+    uint32_t seed = 1;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis)) {
+        for (int n = 0; n < 1000; ++n, ++connections) {
+            seed = seed * 1103515245u + 12345u;
+            Connection &connection = open[(seed >> 8) % open.size()];
+            for (size_t i = 0; i < 5; ++i) {
+                release(connection.objects[i]);
+                connection.objects[i] = alloc(CONNECTION_SIZES[i]);
+                memset(connection.objects[i], 0, 64);  // touches the header like the relays do
+            }
+        }
+    }
+    double elapsed = bench::secondsSince(start);
+    for (auto &connection : open) {
+        for (size_t i = 0; i < 5; ++i) release(connection.objects[i]);
+    }
+    return elapsed;
+}
+
+}
+
+BENCHMARK(arena) {
+    size_t arenaConnections = 0, mallocConnections = 0;
+    double arenaElapsed = churn(options, arena_alloc, arena_free, arenaConnections);
+    double mallocElapsed = churn(options, malloc, free, mallocConnections);
+    arena_stats stats;
+    arena_get_stats(&stats);
+
+    bench::Result result;
+    result.metric("arena_ns_per_connection", arenaElapsed * 1e9 / arenaConnections)
+            .metric("malloc_ns_per_connection", mallocElapsed * 1e9 / mallocConnections)
+            .metric("peak_slabs", stats.peak_slabs_in_use)
+            .metric("slabs_after", stats.slabs_in_use);
+    return result;
+}
+
+// A burst of connections through tun2socks' lwIP: a PCB, a few segments and pbufs with MTU payloads
+// each, all closed again before the next burst
+BENCHMARK(lwip_mem) {
+    const size_t SIZES[] = {208, 40, 40, 40, 24, 1560, 1560, 1560, 1560};
+    const size_t OBJECTS = sizeof(SIZES) / sizeof(SIZES[0]), CONNECTIONS = 2048;
+    std::vector<void *> burst(CONNECTIONS * OBJECTS);
+    size_t connections = 0, peakSlabs = 0;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis)) {
+        for (size_t i = 0; i < burst.size(); ++i) {
+            burst[i] = lwip_mem_malloc(SIZES[i % OBJECTS]);
+            memset(burst[i], 0, 16);
+        }
+        arena_stats stats;
+        arena_get_stats(&stats);
+        if (stats.slabs_in_use > peakSlabs) peakSlabs = stats.slabs_in_use;
+        for (void *object : burst) lwip_mem_free(object);
+        connections += CONNECTIONS;
+    }
+    double elapsed = bench::secondsSince(start);
+    arena_stats stats;
+    arena_get_stats(&stats);
+    lwip_mem_stats counters;
+    lwip_mem_get_stats(&counters);
+
+    bench::Result result;
+    result.metric("ns_per_connection", elapsed * 1e9 / connections)
+            .metric("burst_slabs", peakSlabs)
+            .metric("idle_slabs", stats.slabs_in_use)
+            .metric("live_objects", counters.objects)
+            .metric("fallbacks", counters.fallbacks)
+            .metric("failures", counters.failures);
+    return result;
+}
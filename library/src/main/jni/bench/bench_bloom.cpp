@@ -0,0 +1,42 @@
+#include <cstring>
+
+#include "bench.h"
+#include "ppbloom.h"
+#include "probe.h"
+
+// ppbloom with ss-local's client parameters: 16 byte salts (aes-128-gcm) up to 32 byte ones
+BENCHMARK(ppbloom) {
+    static const int ENTRIES = 10000;
+    static const double ERROR = 1e-15;
+    if (ppbloom_init(ENTRIES, ERROR) == -1) return bench::skip("ppbloom_init failed");
+
+    uint64_t salt[4] = {};
+    size_t added = 0;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis / 2)) {
+        for (int i = 0; i < 1000; ++i, ++added) {
+            salt[0] = added;
+            ppbloom_add(salt, sizeof(salt));
+        }
+    }
+    double addElapsed = bench::secondsSince(start);
+
+    // Every generation has rotated many times by now, so both halves are full of recent salts
+    size_t checked = 0, hits = 0;
+    start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis / 2)) {
+        for (int i = 0; i < 1000; ++i, ++checked) {
+            salt[0] = checked;
+            salt[1] = 1;    // never added
+            hits += ppbloom_check(salt, sizeof(salt)) == 1;
+        }
+    }
+    double checkElapsed = bench::secondsSince(start);
+    ppbloom_free();
+
+    bench::Result result;
+    result.metric("ns_per_add", addElapsed * 1e9 / added)
+            .metric("ns_per_check", checkElapsed * 1e9 / checked)
+            .metric("false_positives", hits);
+    return result;
+}
@@ -0,0 +1,88 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "csum.h"
+#include "probe.h"
+
+namespace {
+
+// Sums the reference kernel would give, rebuilt here so a broken dispatch cannot hide a mismatch
+uint16_t referenceSum(const unsigned char *data, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        uint16_t word;
+        memcpy(&word, data + i, sizeof(word));
+        sum += word;
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    if (len % 2 != 0) {
+        uint16_t word = 0;
+        memcpy(&word, data + len - 1, 1);
+        sum += word;
+    }
+    sum = (sum & 0xffff) + (sum >> 16);
+    return uint16_t(sum + (sum >> 16));
+}
+
+// Every length up to a few vector widths and odd offsets, then packet sized buffers
+size_t mismatches(const std::vector<unsigned char> &data) {
+    std::vector<unsigned char> copy(data.size());
+    size_t bad = 0;
+    uint32_t seed = 7;
+    for (size_t round = 0; round < 4000; ++round) {
+        seed = seed * 1103515245u + 12345u;
+        size_t offset = seed % 64;
+        size_t len = round < 600 ? round % 300 : (seed >> 8) % (data.size() - 64);
+        uint16_t expected = referenceSum(data.data() + offset, len);
+        bad += csum(data.data() + offset, len) != expected;
+        memset(copy.data(), 0, len + 64);
+        bad += csum_copy(copy.data() + (offset ^ 1), data.data() + offset, len) != expected;
+        bad += memcmp(copy.data() + (offset ^ 1), data.data() + offset, len) != 0;
+    }
+    return bad;
+}
+
+double bytesPerSecond(const std::vector<unsigned char> &data, size_t len, bool copying, int durationMillis) {
+    std::vector<unsigned char> copy(len);
+    size_t bytes = 0;
+    volatile uint16_t sink = 0;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, durationMillis)) {
+        for (int i = 0; i < 256; ++i, bytes += len) {
+            sink = copying ? csum_copy(copy.data(), data.data(), len) : csum(data.data(), len);
+        }
+    }
+    (void) sink;
+    return bytes / bench::secondsSince(start);
+}
+
+}
+
+// Every kernel the CPU supports against the reference, at a TCP ACK, a full MTU and a GSO sized buffer
+BENCHMARK(csum) {
+    static const size_t SIZES[] = {40, 1500, 65536};
+    std::vector<unsigned char> data(65536 + 64);
+    uint32_t seed = 1;
+    for (auto &byte : data) {
+        seed = seed * 1103515245u + 12345u;
+        byte = uint8_t(seed >> 16);
+    }
+    enum csum_impl selected = csum_get_impl();
+
+    bench::Result result;
+    int durationMillis = options.durationMillis / 8;
+    for (int impl = 0; impl < CSUM_IMPLS; ++impl) {
+        if (csum_set_impl(csum_impl(impl)) == -1) continue;
+        std::string name = csum_impl_name(csum_impl(impl));
+        result.metric(name + "_mismatches", mismatches(data));
+        for (size_t size : SIZES) {
+            result.metric(name + "_gbps_" + std::to_string(size),
+                          bytesPerSecond(data, size, false, durationMillis) * 8 / 1e9);
+        }
+        result.metric(name + "_copy_gbps_1500", bytesPerSecond(data, 1500, true, durationMillis) * 8 / 1e9);
+    }
+    csum_set_impl(selected);
+    return result;
+}
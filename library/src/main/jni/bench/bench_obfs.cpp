@@ -0,0 +1,66 @@
+#include <unistd.h>
+
+#include "bench.h"
+#include "obfs_transport.h"
+#include "probe.h"
+#include "servers.h"
+
+/*
+ * The fused obfs transport, measured from the client end the way ss-local drives it. The suite is
+ * linked with the same --wrap flags as ss-local, so every connect/send/recv/close here passes
+ * through the wrappers. Those are single-threaded like ss-local, which is why the stand-ins for these
+ * benchmarks serve from a child process.
+ */
+
+static bool enableTransport(int port) {
+    std::string portText = std::to_string(port);
+    std::vector<std::string> args = { "ss-local", "-s", "127.0.0.1", "-p", portText,
+                                      "--plugin", "obfs-local", "--plugin-opts", "obfs=http;obfs-host=bench.example.com" };
+    std::vector<char*> argv;
+    for (auto &arg : args) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    int argc = int(args.size());
+    return obfs_transport_setup(&argc, argv.data()) == 0;
+}
+
+static void disableTransport() {
+    char name[] = "ss-local";
+    char *argv[] = { name, nullptr };
+    int argc = 1;
+    obfs_transport_setup(&argc, argv);
+}
+
+static double streamRate(int port, int durationMillis) {
+    int fd = bench::connectLoopback(port);
+    if (fd == -1) return 0;
+    double rate = bench::echoThroughput(fd, durationMillis);
+    close(fd);
+    return rate;
+}
+
+static double connectionRate(int port, int durationMillis) {
+    return bench::echoConnectionRate([port] { return bench::connectLoopback(port); }, durationMillis);
+}
+
+BENCHMARK(obfs_transport) {
+    bench::TcpServer plain(bench::echoHandler());
+    bench::TcpServer obfs(bench::obfsEchoHandler());
+    if (!plain.start(true) || !obfs.start(true)) return bench::skip("cannot start loopback stand-ins");
+    if (!bench::waitForPort(plain.port(), 1000) || !bench::waitForPort(obfs.port(), 1000)) {
+        return bench::skip("stand-ins did not come up");
+    }
+
+    double plainStream = streamRate(plain.port(), options.durationMillis);
+    double plainConnections = connectionRate(plain.port(), options.durationMillis);
+    if (!enableTransport(obfs.port())) return bench::skip("obfs_transport_setup failed");
+    double obfsStream = streamRate(obfs.port(), options.durationMillis);
+    double obfsConnections = connectionRate(obfs.port(), options.durationMillis);
+    disableTransport();
+
+    bench::Result result;
+    result.metric("obfs_mb_per_sec", obfsStream / 1e6)
+            .metric("obfs_conn_per_sec", obfsConnections)
+            .metric("plain_mb_per_sec", plainStream / 1e6)
+            .metric("plain_conn_per_sec", plainConnections);
+    return result;
+}
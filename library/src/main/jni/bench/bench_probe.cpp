@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "probe.h"
+#include "servers.h"
+
+// The parser behind JniHelper.parseNumericAddress() and the batch loop's numeric fast path, without the JNI copies
+BENCHMARK(address_parse) {
+    std::vector<std::string> inputs;
+    for (int i = 0; i < 1024; ++i) {
+        char text[64];
+        switch (i % 4) {
+            case 0: snprintf(text, sizeof(text), "%d.%d.%d.%d", 10 + i % 200, i % 256, (i * 7) % 256, (i * 13) % 256); break;
+            case 1: snprintf(text, sizeof(text), "2001:db8:%x::%x:%x", i, i * 3, i * 5); break;
+            case 2: snprintf(text, sizeof(text), "::ffff:192.0.2.%d", i % 256); break;
+            default: snprintf(text, sizeof(text), "host-%d.example.com", i); break;
+        }
+        inputs.push_back(text);
+    }
+
+    uint8_t dst[16];
+    size_t parsed = 0, numeric = 0;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis)) {
+        for (auto &input : inputs) numeric += probe::parseNumericAddress(input.data(), input.size(), dst) != AF_UNSPEC;
+        parsed += inputs.size();
+    }
+    double elapsed = bench::secondsSince(start);
+
+    // Baseline: what the JNI side used before, inet_pton() per family on a NUL-terminated copy
+    size_t baseline = 0;
+    start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis)) {
+        for (auto &input : inputs) {
+            std::string copy(input);
+            numeric += inet_pton(AF_INET, copy.c_str(), dst) == 1 || inet_pton(AF_INET6, copy.c_str(), dst) == 1;
+        }
+        baseline += inputs.size();
+    }
+    double baselineElapsed = bench::secondsSince(start);
+
+    bench::Result result;
+    result.metric("addresses_per_sec", parsed / elapsed)
+            .metric("ns_per_address", elapsed * 1e9 / parsed)
+            .metric("inet_pton_addresses_per_sec", baseline / baselineElapsed)
+            .metric("numeric_fraction", double(numeric) / double(parsed + baseline));
+    return result;
+}
+
+// Connection rate of the probe batch loop against loopback echo and HTTP stand-ins
+BENCHMARK(probe_batch) {
+    bench::TcpServer echo(bench::echoHandler());
+    bench::TcpServer http(bench::httpHandler(512));
+    bench::UdpEchoServer udp;
+    if (!echo.start() || !http.start() || !udp.start()) return bench::skip("cannot bind loopback stand-ins");
+
+    std::vector<probe::BatchTarget> targets;
+    for (int i = 0; i < 64; ++i) {
+        probe::BatchTarget target;
+        switch (i % 3) {
+            case 0:
+                target = { probe::PROTOCOL_TCP, "127.0.0.1", http.port(), "GET / HTTP/1.1\r\nHost: bench\r\n\r\n",
+                           1000, 1000, 2000, 4096 };
+                break;
+            case 1:
+                target = { probe::PROTOCOL_TCP, "127.0.0.1", echo.port(), "ping", 1000, 1000, 2000, 4 };
+                break;
+            default:
+                target = { probe::PROTOCOL_UDP, "127.0.0.1", udp.port(), "ping", 1000, 1000, 2000, 4 };
+                break;
+        }
+        targets.push_back(target);
+    }
+
+    size_t jobs = 0, failed = 0;
+    int64_t connectNanos = 0, firstByteNanos = 0;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis)) {
+        std::vector<probe::BatchOutcome> outcomes;
+        if (probe::runBatch(targets, &outcomes) == -1) return bench::skip(strerror(errno));
+        for (auto &outcome : outcomes) {
+            failed += outcome.status != probe::STATUS_OK;
+            connectNanos += outcome.connectNanos;
+            firstByteNanos += outcome.firstByteNanos;
+        }
+        jobs += outcomes.size();
+    }
+    double elapsed = bench::secondsSince(start);
+
+    bench::Result result;
+    result.metric("jobs_per_sec", jobs / elapsed)
+            .metric("batches_per_sec", jobs / targets.size() / elapsed)
+            .metric("mean_connect_us", connectNanos / 1e3 / jobs)
+            .metric("mean_first_byte_us", firstByteNanos / 1e3 / jobs)
+            .metric("failed", failed);
+    return result;
+}
+
+// Latency of a job joining the loop ProbeBatcher keeps running while a server drips one byte every 50 ms
+// into another job, which only its absolute deadline ends
+BENCHMARK(probe_batch_join) {
+    bench::TcpServer echo(bench::echoHandler());
+    bench::TcpServer drip([](int fd) {
+        char request[64];
+        if (recv(fd, request, sizeof(request), 0) <= 0) return;
+        while (send(fd, "x", 1, MSG_NOSIGNAL) == 1) usleep(50000);
+    });
+    if (!echo.start() || !drip.start()) return bench::skip("cannot bind loopback stand-ins");
+
+    probe::BatchLoop *loop = probe::newBatchLoop();
+    if (loop == nullptr) return bench::skip(strerror(errno));
+    std::mutex lock;
+    std::condition_variable changed;
+    std::map<uint64_t, probe::BatchOutcome> outcomes;
+    std::thread worker([&] {
+        probe::runBatchLoop(loop, [&](uint64_t id, probe::BatchOutcome &outcome) {
+            std::lock_guard<std::mutex> guard(lock);
+            outcomes[id] = std::move(outcome);
+            changed.notify_all();
+        });
+    });
+
+    const int dripTimeoutMillis = std::max(options.durationMillis / 2, 200);
+    probe::submitBatch(loop, 0, { probe::PROTOCOL_TCP, "127.0.0.1", drip.port(), "GET", 1000, 1000,
+                                  dripTimeoutMillis, 1 << 20 });
+    std::vector<double> joinMicros;
+    uint64_t id = 1;
+    int64_t begin = probe::nowNanos();
+    while (!bench::expired(begin, options.durationMillis)) {
+        int64_t start = probe::nowNanos();
+        probe::submitBatch(loop, id, { probe::PROTOCOL_TCP, "127.0.0.1", echo.port(), "ping", 1000, 1000, 1000, 4 });
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return outcomes.count(id) != 0; });
+        if (outcomes[id].status == probe::STATUS_OK) joinMicros.push_back((probe::nowNanos() - start) / 1e3);
+        outcomes.erase(id++);
+    }
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return outcomes.count(0) != 0; });
+    }
+    probe::stopBatchLoop(loop);
+    worker.join();
+    probe::freeBatchLoop(loop);
+
+    const probe::BatchOutcome &dripped = outcomes[0];
+    std::sort(joinMicros.begin(), joinMicros.end());
+    bench::Result result;
+    result.metric("joined", double(joinMicros.size()))
+            .metric("join_median_us", joinMicros.empty() ? 0 : joinMicros[joinMicros.size() / 2])
+            .metric("drip_timed_out", dripped.status == probe::STATUS_TIMEOUT)
+            .metric("drip_total_ms", dripped.totalNanos / 1e6)
+            .metric("drip_bytes", double(dripped.response.size()));
+    return result;
+}
+
+// Wall time of NativeProbe.traceroute() to loopback: one hop, so this is mostly setup and teardown
+BENCHMARK(trace_loopback) {
+    sockaddr_storage target;
+    probe::resolve("127.0.0.1", &target);
+    probe::TraceOptions traceOptions;
+    traceOptions.protocol = probe::PROTOCOL_UDP;
+    traceOptions.maxHops = 4;
+    traceOptions.intervalMillis = 0;
+    traceOptions.waitMillis = 200;
+
+    std::vector<double> walls;
+    int64_t start = probe::nowNanos();
+    while (walls.empty() || !bench::expired(start, options.durationMillis)) {
+        probe::Trace trace;
+        int64_t run = probe::nowNanos();
+        if (probe::trace(target, traceOptions, &trace) == -1) return bench::skip(strerror(errno));
+        walls.push_back((probe::nowNanos() - run) / 1e6);
+    }
+    double mean = 0;
+    for (double wall : walls) mean += wall / walls.size();
+
+    bench::Result result;
+    result.metric("mean_wall_ms", mean).metric("runs", walls.size());
+    return result;
+}
+
+// Same trace through the executable the in-process probe replaced
+BENCHMARK(traceroute_exec) {
+    if (options.traceroute.empty()) return bench::skip("no --traceroute binary given");
+    std::vector<double> walls;
+    int64_t start = probe::nowNanos();
+    while (walls.empty() || !bench::expired(start, options.durationMillis)) {
+        int64_t run = probe::nowNanos();
+        int pid = bench::spawn({ options.traceroute, "-n", "-q", "3", "-w", "1", "-m", "4", "127.0.0.1" },
+                               options.verbose);
+        int status;
+        if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            return bench::skip("traceroute failed");
+        }
+        walls.push_back((probe::nowNanos() - run) / 1e6);
+    }
+    double mean = 0;
+    for (double wall : walls) mean += wall / walls.size();
+
+    bench::Result result;
+    result.metric("mean_wall_ms", mean).metric("runs", walls.size());
+    return result;
+}
@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <cstring>
+#include <regex.h>
+
+#include "bench.h"
+#include "hostmatch.h"
+#include "probe.h"
+
+// Hostname rules the way gfwlist-style ACLs write them, looked up with hosts that mostly miss
+BENCHMARK(rule_lookup) {
+    static const int RULES = 5000;
+    static const char *const TLDS[] = { "com", "net", "org", "io", "co\\.jp" };
+    std::vector<std::string> patterns;
+    for (int i = 0; i < RULES; ++i) {
+        char pattern[64];
+        snprintf(pattern, sizeof(pattern), "(^|\\.)site%dx%d\\.%s$", i, i * 7919 % 1000, TLDS[i % 5]);
+        patterns.push_back(pattern);
+    }
+    static const char *const HOSTS[] = {
+        "www.google.com", "i.ytimg.com", "graph.facebook.com", "cdn.site4242x398.org", "api.path.network",
+    };
+
+    int64_t start = probe::nowNanos();
+    hostmatch *matcher = hostmatch_new();
+    for (int i = 0; i < RULES; ++i) hostmatch_add(matcher, patterns[i].c_str(), i);
+    if (hostmatch_build(matcher) == -1) return bench::skip("hostmatch_build failed");
+    double buildElapsed = bench::secondsSince(start);
+
+    size_t looked = 0, hits = 0;
+    start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis / 2)) {
+        for (int i = 0; i < 1000; ++i, ++looked) {
+            const char *host = HOSTS[looked % 5];
+            hits += hostmatch_find(matcher, host, strlen(host)) != HOSTMATCH_NONE;
+        }
+    }
+    double lookupElapsed = bench::secondsSince(start);
+    size_t states = hostmatch_states(matcher);
+    hostmatch_free(matcher);
+
+    // What rule.c does, one regex after another; POSIX regex stands in for PCRE on the host
+    static const int REGEX_RULES = 500;
+    std::vector<regex_t> regexes(REGEX_RULES);
+    for (int i = 0; i < REGEX_RULES; ++i) regcomp(&regexes[i], patterns[i].c_str(), REG_EXTENDED | REG_NOSUB);
+    size_t scanned = 0;
+    start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis / 2)) {
+        for (int i = 0; i < 10; ++i, ++scanned) {
+            for (auto &regex : regexes) {
+                if (regexec(&regex, HOSTS[scanned % 5], 0, nullptr, 0) == 0) break;
+            }
+        }
+    }
+    double scanElapsed = bench::secondsSince(start);
+    for (auto &regex : regexes) regfree(&regex);
+
+    bench::Result result;
+    result.metric("build_ms", buildElapsed * 1e3)
+            .metric("states", states)
+            .metric("ns_per_lookup", lookupElapsed * 1e9 / looked)
+            .metric("hit_ratio", double(hits) / looked)
+            .metric("ns_per_lookup_regex_list", scanElapsed * 1e9 / scanned * RULES / REGEX_RULES);
+    return result;
+}
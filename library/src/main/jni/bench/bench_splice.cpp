@@ -0,0 +1,188 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.h"
+#include "probe.h"
+
+#ifdef BENCH_HAVE_LIBEVENT
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+
+#include "splice_relay.h"
+
+namespace {
+
+const size_t BLOCK = 64 * 1024, HIGH_WATER = 128 * 1024;
+
+// Two ends of a loopback TCP connection
+bool tcpPair(int &a, int &b) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (listener == -1 || bind(listener, (sockaddr *) &addr, sizeof(addr)) == -1 || listen(listener, 1) == -1 ||
+        getsockname(listener, (sockaddr *) &addr, &len) == -1) {
+        if (listener != -1) close(listener);
+        return false;
+    }
+    a = socket(AF_INET, SOCK_STREAM, 0);
+    bool ok = a != -1 && connect(a, (sockaddr *) &addr, sizeof(addr)) == 0 && (b = accept(listener, nullptr, nullptr)) != -1;
+    close(listener);
+    if (!ok && a != -1) close(a);
+    return ok;
+}
+
+double threadCpuSeconds() {
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// What redsocks' bufferevent relay does with established connections, in one direction at a time
+struct BuffereventRelay {
+    bufferevent *sides[2];
+    bool eof[2] = {false, false};
+    int finished = 0;
+    event_base *base;
+
+    bufferevent *other(bufferevent *bev) { return bev == sides[0] ? sides[1] : sides[0]; }
+    int index(bufferevent *bev) { return bev == sides[0] ? 0 : 1; }
+
+    void finishIfDrained(bufferevent *from) {
+        bufferevent *to = other(from);
+        if (!eof[index(from)] || evbuffer_get_length(bufferevent_get_output(to)) > 0) return;
+        shutdown(bufferevent_getfd(to), SHUT_WR);
+        eof[index(from)] = false;
+        if (++finished == 2) event_base_loopbreak(base);
+    }
+
+    static void onRead(bufferevent *bev, void *arg) {
+        auto relay = static_cast<BuffereventRelay *>(arg);
+        evbuffer *output = bufferevent_get_output(relay->other(bev));
+        evbuffer_add_buffer(output, bufferevent_get_input(bev));
+        if (evbuffer_get_length(output) >= HIGH_WATER) bufferevent_disable(bev, EV_READ);
+    }
+
+    static void onWrite(bufferevent *bev, void *arg) {
+        auto relay = static_cast<BuffereventRelay *>(arg);
+        bufferevent *from = relay->other(bev);
+        if (relay->eof[relay->index(from)]) relay->finishIfDrained(from);
+        else bufferevent_enable(from, EV_READ);
+    }
+
+    static void onEvent(bufferevent *bev, short what, void *arg) {
+        auto relay = static_cast<BuffereventRelay *>(arg);
+        if (what & BEV_EVENT_ERROR) {
+            event_base_loopbreak(relay->base);
+            return;
+        }
+        relay->eof[relay->index(bev)] = true;
+        bufferevent_disable(bev, EV_READ);
+        relay->finishIfDrained(bev);
+    }
+};
+
+void spliceDone(splice_relay *, int, void *arg) {
+    event_base_loopbreak(static_cast<event_base *>(arg));
+}
+
+// Pushes data through a relay between two loopback connections for `durationMillis`, returns the
+// bytes that arrived and the relay thread's CPU time
+bool relay(bool spliced, int durationMillis, size_t &bytes, double &seconds, double &cpuSeconds) {
+    int source, in, out, sink;
+    if (!tcpPair(source, in)) return false;
+    if (!tcpPair(out, sink)) {
+        close(source);
+        close(in);
+        return false;
+    }
+    fcntl(in, F_SETFL, O_NONBLOCK);
+    fcntl(out, F_SETFL, O_NONBLOCK);
+
+    int64_t start = probe::nowNanos();
+    std::thread sender([&] {
+        std::vector<char> block(BLOCK, 'x');
+        while (!bench::expired(start, durationMillis) && bench::writeAll(source, block.data(), block.size())) {
+        }
+        shutdown(source, SHUT_WR);
+        char byte;
+        while (read(source, &byte, 1) > 0) {
+        }
+    });
+    bytes = 0;
+    std::thread receiver([&] {
+        std::vector<char> block(BLOCK);
+        ssize_t n;
+        while ((n = read(sink, block.data(), block.size())) > 0) bytes += size_t(n);
+        shutdown(sink, SHUT_WR);
+    });
+
+    event_base *base = event_base_new();
+    double cpuStart = threadCpuSeconds();
+    bool ok = true;
+    if (spliced) {
+        splice_relay *relay = splice_relay_new(base, in, out, spliceDone, base);
+        ok = relay != nullptr;
+        if (ok) {
+            event_base_dispatch(base);
+            splice_relay_free(relay);
+        }
+    } else {
+        BuffereventRelay relay;
+        relay.base = base;
+        relay.sides[0] = bufferevent_socket_new(base, in, 0);
+        relay.sides[1] = bufferevent_socket_new(base, out, 0);
+        for (bufferevent *bev : relay.sides) {
+            bufferevent_setcb(bev, BuffereventRelay::onRead, BuffereventRelay::onWrite, BuffereventRelay::onEvent, &relay);
+            bufferevent_enable(bev, EV_READ | EV_WRITE);
+        }
+        event_base_dispatch(base);
+        for (bufferevent *bev : relay.sides) bufferevent_free(bev);
+    }
+    cpuSeconds = threadCpuSeconds() - cpuStart;
+    if (!ok) {
+        shutdown(in, SHUT_RDWR);
+        shutdown(out, SHUT_RDWR);
+    }
+    sender.join();
+    receiver.join();
+    seconds = bench::secondsSince(start);
+    event_base_free(base);
+    for (int fd : {source, in, out, sink}) close(fd);
+    return ok;
+}
+
+}
+
+// redsocks' relay of an established connection: bufferevents copying through userspace, or splice()
+BENCHMARK(splice_relay) {
+    size_t bufferedBytes, splicedBytes;
+    double bufferedSeconds, splicedSeconds, bufferedCpu, splicedCpu;
+    if (!relay(false, options.durationMillis / 2, bufferedBytes, bufferedSeconds, bufferedCpu) ||
+        !relay(true, options.durationMillis / 2, splicedBytes, splicedSeconds, splicedCpu)) {
+        return bench::skip(strerror(errno));
+    }
+    bench::Result result;
+    result.metric("bufferevent_gbit_per_s", bufferedBytes * 8 / bufferedSeconds / 1e9)
+            .metric("splice_gbit_per_s", splicedBytes * 8 / splicedSeconds / 1e9)
+            .metric("bufferevent_cpu_ns_per_kib", bufferedCpu * 1e9 * 1024 / bufferedBytes)
+            .metric("splice_cpu_ns_per_kib", splicedCpu * 1e9 * 1024 / splicedBytes);
+    return result;
+}
+
+#else
+
+BENCHMARK(splice_relay) {
+    return bench::skip("built without libevent");
+}
+
+#endif
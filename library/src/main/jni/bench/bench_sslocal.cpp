@@ -0,0 +1,69 @@
+#include <unistd.h>
+
+#include "bench.h"
+#include "servers.h"
+
+/*
+ * ss-local relay rate: SOCKS5 client -> ss-local -> shadowsocks stand-in -> echo stand-in, with the
+ * same cipher and, for the obfs variant, the same plugin options PathNativeProcessesImpl uses.
+ * Needs host builds of ss-local (and obfs-local) from the submodules.
+ */
+
+static const char *const METHOD = "chacha20-ietf-poly1305";
+static const char *const PASSWORD = "bench";
+
+static bench::Result runSsLocal(const bench::Options &options, bool obfs) {
+    if (options.ssLocal.empty()) return bench::skip("no --ss-local binary given");
+    if (obfs && options.obfsLocal.empty()) return bench::skip("no --obfs-local binary given");
+    if (!bench::shadowsocksAvailable()) return bench::skip("built without OpenSSL");
+
+    bench::TcpServer echo(bench::echoHandler());
+    bench::ShadowsocksConfig config;
+    config.method = METHOD;
+    config.password = PASSWORD;
+    config.obfsHttp = obfs;
+    bench::TcpServer server(bench::shadowsocksHandler(config));
+    if (!echo.start() || !server.start()) return bench::skip("cannot bind loopback stand-ins");
+
+    int localPort = bench::freePort();
+    std::vector<std::string> args = {
+            options.ssLocal, "-s", "127.0.0.1", "-p", std::to_string(server.port()),
+            "-b", "127.0.0.1", "-l", std::to_string(localPort), "-k", PASSWORD, "-m", METHOD,
+    };
+    if (obfs) {
+        args.insert(args.end(), { "--plugin", options.obfsLocal, "--plugin-opts", "obfs=http;obfs-host=bench.example.com" });
+    }
+    int pid = bench::spawn(args, options.verbose);
+    if (pid == -1) return bench::skip("cannot run " + options.ssLocal);
+    if (!bench::waitForPort(localPort, 2000)) {
+        bench::terminate(pid);
+        return bench::skip("ss-local did not start listening");
+    }
+
+    int echoPort = echo.port();
+    auto open = [localPort, echoPort] {
+        int fd = bench::connectLoopback(localPort);
+        if (fd != -1 && !bench::socksConnect(fd, echoPort)) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    };
+    int fd = open();
+    double stream = fd != -1 ? bench::echoThroughput(fd, options.durationMillis) : 0;
+    if (fd != -1) close(fd);
+    double connections = bench::echoConnectionRate(open, options.durationMillis);
+    bench::terminate(pid);
+
+    bench::Result result;
+    result.metric("mb_per_sec", stream / 1e6).metric("conn_per_sec", connections);
+    return result;
+}
+
+BENCHMARK(ss_local) {
+    return runSsLocal(options, false);
+}
+
+BENCHMARK(ss_local_obfs) {
+    return runSsLocal(options, true);
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench.h"
+#include "probe.h"
+#include "ready.h"
+#include "supervisor.h"
+
+namespace {
+
+double median(std::vector<double> samples) {
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+}
+
+// Start and stop of a helper the way PathNativeProcessesImpl switches the proxy chain, through the supervisor thread
+BENCHMARK(supervisor_restart) {
+    const std::vector<std::string> argv = {"/bin/sleep", "60"};
+    std::vector<double> startMicros, stopMicros;
+    int64_t begin = probe::nowNanos();
+    while (!bench::expired(begin, options.durationMillis)) {
+        int64_t start = probe::nowNanos();
+        int handle = supervisor::start(argv, "sleep");
+        if (handle == -1) return bench::skip(std::string("supervisor::start: ") + strerror(errno));
+        int64_t started = probe::nowNanos();
+        supervisor::stop({handle}, 500);
+        startMicros.push_back((started - start) / 1e3);
+        stopMicros.push_back((probe::nowNanos() - started) / 1e3);
+    }
+
+    // Start until the child reports READY_LISTENING the way ss-local and obfs-local do, instead of polling its port
+    std::vector<double> readyMicros;
+    const std::vector<std::string> listener = {"/bin/sh", "-c", "printf '\\001' >&3; exec sleep 60"};
+    begin = probe::nowNanos();
+    while (!bench::expired(begin, options.durationMillis)) {
+        int64_t start = probe::nowNanos();
+        int handle = supervisor::start(listener, "listener");
+        bool ready = handle != -1 && supervisor::await(handle, READY_LISTENING, 1000);
+        if (ready) readyMicros.push_back((probe::nowNanos() - start) / 1e3);
+        if (handle != -1) supervisor::stop({handle}, 500);
+        if (!ready) return bench::skip("no readiness event from the child");
+    }
+
+    // A child that dies on its own after running longer than a second is respawned right away
+    int handle = supervisor::start(argv, "sleep");
+    supervisor::Status status;
+    if (handle == -1 || !supervisor::status(handle, &status)) return bench::skip("supervisor::start failed");
+    int64_t wait = probe::nowNanos();
+    while (!bench::expired(wait, 1100)) usleep(10000);
+    pid_t old = status.pid;
+    int64_t killed = probe::nowNanos();
+    kill(old, SIGKILL);
+    while (supervisor::status(handle, &status) && (status.pid == old || status.pid == 0) &&
+           !bench::expired(killed, 1000)) usleep(100);
+    double respawnMicros = (probe::nowNanos() - killed) / 1e3;
+    supervisor::stop({handle}, 500);
+
+    bench::Result result;
+    result.metric("cycles", double(startMicros.size()))
+            .metric("start_us", median(startMicros))
+            .metric("stop_us", median(stopMicros))
+            .metric("ready_us", median(readyMicros))
+            .metric("respawn_us", respawnMicros)
+            .metric("restarts", status.restarts);
+    return result;
+}
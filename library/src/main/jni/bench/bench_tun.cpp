@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ancillary.h"
+#include "bench.h"
+#include "probe.h"
+#include "spsc_ring.h"
+#include "tun_offload.h"
+#include "tun_shard.h"
+
+namespace {
+
+const size_t MSS = 1460, HEADERS = 40;
+
+void store16(unsigned char *p, uint32_t v) {
+    p[0] = uint8_t(v >> 8);
+    p[1] = uint8_t(v);
+}
+
+void store32(unsigned char *p, uint32_t v) {
+    store16(p, v >> 16);
+    store16(p + 2, v);
+}
+
+// An IPv4 ACK|PSH segment of one flow, checksums left to tun_offload.c like the kernel leaves them
+size_t segment(unsigned char *p, uint32_t seq, uint16_t id, const unsigned char *data, size_t len) {
+    memset(p, 0, HEADERS);
+    p[0] = 0x45;
+    store16(p + 2, uint32_t(HEADERS + len));
+    store16(p + 4, id);
+    p[6] = 0x40;
+    p[8] = 64;
+    p[9] = 6;
+    store32(p + 12, 0x0a000001);
+    store32(p + 16, 0x0a000002);
+    store16(p + 20, 443);
+    store16(p + 22, 40000);
+    store32(p + 24, seq);
+    store32(p + 28, 1);
+    p[32] = 0x50;
+    p[33] = 0x10;
+    store16(p + 34, 65535);
+    memcpy(p + HEADERS, data, len);
+    return HEADERS + len;
+}
+
+uint32_t sum(const unsigned char *p, size_t len, uint32_t s) {
+    for (size_t i = 0; i + 1 < len; i += 2) s += uint32_t(p[i] << 8 | p[i + 1]);
+    if (len % 2 != 0) s += uint32_t(p[len - 1] << 8);
+    while (s >> 16) s = (s & 0xffff) + (s >> 16);
+    return s;
+}
+
+bool valid(const unsigned char *p, size_t len) {
+    uint32_t pseudo = sum(p + 12, 8, 0) + 6 + uint32_t(len - 20);
+    return sum(p, 20, 0) == 0xffff && sum(p + 20, len - 20, pseudo) == 0xffff;
+}
+
+uint32_t load32(const unsigned char *p) {
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+// A small IPv4 DNS query of the flow from `port`, 8 bytes of payload
+size_t datagram(unsigned char *p, uint16_t port) {
+    memset(p, 0, 36);
+    p[0] = 0x45;
+    store16(p + 2, 36);
+    p[8] = 64;
+    p[9] = 17;
+    store32(p + 12, 0x0a000001);
+    store32(p + 16, 0x08080808);
+    store16(p + 20, port);
+    store16(p + 22, 53);
+    store16(p + 24, 16);
+    return 36;
+}
+
+double median(std::vector<double> samples) {
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// --sock-path of the first tun2socks process, the shards listen on it with ".<shard>" appended
+std::string shardSockPath;
+
+int listenUnix(const char *path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) return -1;
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || listen(sock, 1) == -1) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int connectUnix(const char *path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) return -1;
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Gone or a zombie, for shards that init has to reap
+bool dead(pid_t pid) {
+    char path[32], stat[256];
+    snprintf(path, sizeof(path), "/proc/%d/stat", int(pid));
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) return true;
+    size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+    fclose(file);
+    stat[len] = 0;
+    const char *state = strrchr(stat, ')');
+    return state == nullptr || state[1] == 0 || state[2] == 'Z' || state[2] == 'X';
+}
+
+}
+
+/*
+ * tun2socks is linked with -Wl,--wrap=main,--wrap=ancil_recv_fd and tun_shard.c's __real_ calls end up in
+ * libc and libancillary. Here they go to the stand-ins below, and tun2socks' main to one that echoes what
+ * its shard reads.
+ */
+extern "C" {
+
+int __wrap_main(int argc, char **argv);
+int __wrap_ancil_recv_fd(int sock, int *fd);
+
+ssize_t __real_read(int fd, void *buf, size_t count) {
+    return read(fd, buf, count);
+}
+
+ssize_t __real_write(int fd, const void *buf, size_t count) {
+    return write(fd, buf, count);
+}
+
+int __real_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+    return epoll_wait(epfd, events, maxevents, timeout);
+}
+
+int ancil_send_fd(int sock, int fd) {
+    char data = 0;
+    iovec iov = {&data, 1};
+    union {
+        cmsghdr header;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+int ancil_recv_fd(int sock, int *fd) {
+    char data;
+    iovec iov = {&data, 1};
+    union {
+        cmsghdr header;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) return -1;
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    return 0;
+}
+
+int __real_ancil_recv_fd(int sock, int *fd) {
+    return ancil_recv_fd(sock, fd);
+}
+
+// tun2socks as far as the shards go: takes its device from --sock-path, then sends every packet back with
+// its shard in the TTL and its pid in the first payload bytes
+int __real_main(int argc, char **argv) {
+    const char *path = nullptr;
+    for (int i = 0; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--sock-path") == 0) path = argv[i + 1];
+    }
+    if (path == nullptr) return EXIT_FAILURE;
+    int shard = shardSockPath == path ? 0 : atoi(strrchr(path, '.') + 1);
+    int server = listenUnix(path);
+    if (server == -1) return EXIT_FAILURE;
+    int conn = accept(server, nullptr, nullptr);
+    int fd;
+    if (conn == -1 || __wrap_ancil_recv_fd(conn, &fd) != 0) return EXIT_FAILURE;
+    close(conn);
+    close(server);
+    unlink(path);
+
+    unsigned char packet[SPSC_RING_SLOT];
+    for (;;) {
+        pollfd ready = {fd, POLLIN, 0};
+        poll(&ready, 1, -1);
+        ssize_t len;
+        while ((len = tun_shard_read(packet, sizeof(packet))) >= 0) {
+            packet[8] = uint8_t(shard);
+            store32(packet + 28, uint32_t(getpid()));
+            tun_shard_write(packet, size_t(len));
+        }
+        tun_shard_flush();
+    }
+}
+
+}
+
+// lwIP's side of a bulk transfer: a 44 segment super-segment cut up on read, the same merged on write
+BENCHMARK(tun_offload) {
+    std::vector<unsigned char> payload(44 * MSS);
+    for (size_t i = 0; i < payload.size(); ++i) payload[i] = uint8_t(i * 31 + 7);
+    std::vector<unsigned char> super(TUN_MAX_PACKET);
+    size_t superLen = segment(super.data(), 1000, 1, payload.data(), payload.size());
+    virtio_net_hdr hdr = {};
+    hdr.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    hdr.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+    hdr.hdr_len = HEADERS;
+    hdr.gso_size = MSS;
+    hdr.csum_start = 20;
+    hdr.csum_offset = 16;
+
+    // Every segment of the split has to check out and carry its slice of the payload
+    unsigned char out[1500];
+    size_t count = tun_gso_count(&hdr, super.data(), superLen), invalid = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = tun_gso_segment(&hdr, super.data(), superLen, i, out, sizeof(out));
+        invalid += !valid(out, len) || memcmp(out + HEADERS, payload.data() + i * MSS, len - HEADERS) != 0;
+    }
+
+    size_t split = 0;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis / 2)) {
+        for (int n = 0; n < 100; ++n) {
+            for (size_t i = 0; i < count; ++i, ++split) {
+                tun_gso_segment(&hdr, super.data(), superLen, i, out, sizeof(out));
+            }
+        }
+    }
+    double splitSeconds = bench::secondsSince(start);
+
+    std::vector<std::vector<unsigned char>> segments(count, std::vector<unsigned char>(1500));
+    std::vector<size_t> lengths(count);
+    for (size_t i = 0; i < count; ++i) {
+        lengths[i] = segment(segments[i].data(), uint32_t(1000 + i * MSS), uint16_t(1 + i), payload.data() + i * MSS, MSS);
+    }
+    static tun_coalescer coalescer;
+    size_t merged = 0, writes = 0;
+    start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis / 2)) {
+        for (int n = 0; n < 100; ++n) {
+            for (size_t i = 0; i < count; ++i, ++merged) {
+                if (!tun_coalesce(&coalescer, segments[i].data(), lengths[i])) {
+                    tun_coalesce_finish(&coalescer, &hdr);
+                    ++writes;
+                    tun_coalesce(&coalescer, segments[i].data(), lengths[i]);
+                }
+            }
+            tun_coalesce_finish(&coalescer, &hdr);
+            ++writes;
+        }
+    }
+    double mergeSeconds = bench::secondsSince(start);
+
+    bench::Result result;
+    result.metric("invalid_segments", invalid)
+            .metric("split_ns_per_segment", splitSeconds * 1e9 / split)
+            .metric("coalesce_ns_per_segment", mergeSeconds * 1e9 / merged)
+            .metric("segments_per_write", double(merged) / writes);
+    return result;
+}
+
+// The sharded tun2socks' hop between the dispatcher and a shard: MTU packets through one ring, producer
+// and consumer on their own threads, yielding where the real ones would block
+BENCHMARK(tun_shard_ring) {
+    static spsc_ring ring;
+    unsigned char packet[1500];
+    for (size_t i = 0; i < sizeof(packet); ++i) packet[i] = uint8_t(i);
+    std::atomic<bool> done(false);
+    size_t popped = 0, corrupt = 0;
+    std::thread consumer([&] {
+        unsigned char in[SPSC_RING_SLOT];
+        for (;;) {
+            ssize_t len = spsc_ring_pop(&ring, in, sizeof(in));
+            if (len < 0) {
+                if (done.load()) break;
+                std::this_thread::yield();
+                continue;
+            }
+            corrupt += size_t(len) != sizeof(packet) || in[len - 1] != packet[len - 1];
+            ++popped;
+        }
+    });
+
+    size_t pushed = 0, full = 0;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis)) {
+        for (int n = 0; n < 1000; ++n) {
+            // A full ring is where the dispatcher would go back to epoll_wait()
+            if (spsc_ring_push(&ring, packet, sizeof(packet))) {
+                ++pushed;
+            } else {
+                ++full;
+                std::this_thread::yield();
+            }
+        }
+    }
+    done = true;
+    consumer.join();
+    double seconds = bench::secondsSince(start);
+
+    bench::Result result;
+    result.metric("lost_packets", double(pushed - popped))
+            .metric("corrupt_packets", corrupt)
+            .metric("mpps", pushed / seconds / 1e6)
+            .metric("gbit_per_s", pushed * sizeof(packet) * 8 / seconds / 1e9)
+            .metric("full_ratio", double(full) / (pushed + full));
+    return result;
+}
+
+// The sharded tun2socks end to end with tun2socks' main swapped for an echo: the device handover to the
+// dispatcher and the shards, round trips through the rings, and one shard's death taking the rest down
+BENCHMARK(tun_shard_handover) {
+    const unsigned SHARDS = 3, FLOWS = 64;
+    shardSockPath = "/tmp/path-bench-shard." + std::to_string(getpid());
+    int device[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, device) == -1) {
+        return bench::skip(std::string("socketpair: ") + strerror(errno));
+    }
+    timeval timeout = {1, 0};
+    setsockopt(device[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    pid_t first = fork();
+    if (first == -1) return bench::skip(std::string("fork: ") + strerror(errno));
+    if (first == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        close(device[0]);
+        close(device[1]);
+        if (!options.verbose) {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDERR_FILENO);
+        }
+        std::string shards = std::to_string(SHARDS), path = shardSockPath;
+        char *argv[] = {const_cast<char*>("tun2socks"), const_cast<char*>("--sock-path"), &path[0],
+                        const_cast<char*>("--shards"), &shards[0], nullptr};
+        _exit(__wrap_main(5, argv));
+    }
+
+    // What VpnService does with the device once tun2socks listens
+    int sock = -1;
+    for (int attempt = 0; attempt < 500 && sock == -1; ++attempt) {
+        if ((sock = connectUnix(shardSockPath.c_str())) == -1) usleep(10000);
+    }
+    bool handedOver = sock != -1 && ancil_send_fd(sock, device[1]) == 0;
+    if (sock != -1) close(sock);
+    close(device[1]);
+
+    std::vector<double> rttMicros;
+    std::map<unsigned, pid_t> pids;
+    size_t misrouted = 0, lost = 0;
+    unsigned char out[64], in[SPSC_RING_SLOT];
+    int64_t begin = probe::nowNanos();
+    while (handedOver && lost == 0 && !bench::expired(begin, options.durationMillis)) {
+        for (unsigned flow = 0; flow < FLOWS; ++flow) {
+            size_t len = datagram(out, uint16_t(40000 + flow));
+            int64_t sent = probe::nowNanos();
+            if (write(device[0], out, len) != ssize_t(len) || read(device[0], in, sizeof(in)) != ssize_t(len)) {
+                ++lost;
+                break;
+            }
+            rttMicros.push_back((probe::nowNanos() - sent) / 1e3);
+            misrouted += in[8] != tun_shard_of(out, len, SHARDS);
+            pids[in[8]] = pid_t(load32(in + 28));
+        }
+    }
+
+    // The last shard dies, the dispatcher takes the first process down and the others follow it
+    int64_t killed = probe::nowNanos();
+    pid_t victim = pids.size() == SHARDS ? pids[SHARDS - 1] : first;
+    kill(victim, SIGKILL);
+    int status = 0;
+    while (waitpid(first, &status, WNOHANG) == 0 && !bench::expired(killed, 2000)) usleep(100);
+    double teardownMillis = (probe::nowNanos() - killed) / 1e6;
+    if (!WIFSIGNALED(status) && !WIFEXITED(status)) {
+        kill(first, SIGKILL);
+        waitpid(first, &status, 0);
+    }
+    size_t survivors = 0;
+    for (auto &shard : pids) {
+        if (shard.second == first || shard.second == victim) continue;
+        while (!dead(shard.second) && !bench::expired(killed, 3000)) usleep(1000);
+        if (!dead(shard.second)) {
+            ++survivors;
+            kill(shard.second, SIGKILL);
+        }
+    }
+    close(device[0]);
+    for (unsigned k = 0; k < SHARDS; ++k) {
+        unlink(k == 0 ? shardSockPath.c_str() : (shardSockPath + "." + std::to_string(k)).c_str());
+    }
+    if (!handedOver) return bench::skip("tun2socks never listened on its --sock-path");
+
+    bench::Result result;
+    result.metric("shards", pids.size())
+            .metric("first_is_shard_0", pids.count(0) != 0 && pids[0] == first)
+            .metric("lost_packets", lost)
+            .metric("misrouted_packets", misrouted)
+            .metric("rtt_us", median(rttMicros))
+            .metric("first_killed_by_sigterm", WIFSIGNALED(status) && WTERMSIG(status) == SIGTERM)
+            .metric("teardown_ms", teardownMillis)
+            .metric("surviving_shards", survivors);
+    return result;
+}
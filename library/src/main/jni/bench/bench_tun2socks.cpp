@@ -0,0 +1,119 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "probe.h"
+#include "servers.h"
+
+/*
+ * tun2socks packet rate: a TCP echo stream addressed into a persistent TUN device that a host build
+ * of tun2socks serves, relayed through a SOCKS stand-in that sends every connection to the echo
+ * stand-in. Packet counts come from the device statistics. Needs root for the TUN device.
+ */
+
+static const char *const TUN_ADDRESS = "10.233.233.1";
+static const char *const NETIF_ADDRESS = "10.233.233.2";
+static const char *const TARGET_ADDRESS = "10.233.233.3";
+static const char *const NETMASK = "255.255.255.0";
+
+static bool setPersistent(const char *name, bool persistent, std::string *created = nullptr) {
+    int fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+    if (fd == -1) return false;
+    ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    bool ok = ioctl(fd, TUNSETIFF, &ifr) == 0 && ioctl(fd, TUNSETPERSIST, persistent ? 1 : 0) == 0;
+    if (ok && created != nullptr) *created = ifr.ifr_name;
+    close(fd);
+    return ok;
+}
+
+static bool configure(const std::string &name) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return false;
+    ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+    auto addr = reinterpret_cast<sockaddr_in*>(&ifr.ifr_addr);
+    addr->sin_family = AF_INET;
+    bool ok = inet_pton(AF_INET, TUN_ADDRESS, &addr->sin_addr) == 1 && ioctl(fd, SIOCSIFADDR, &ifr) == 0 &&
+            inet_pton(AF_INET, NETMASK, &addr->sin_addr) == 1 && ioctl(fd, SIOCSIFNETMASK, &ifr) == 0 &&
+            ioctl(fd, SIOCGIFFLAGS, &ifr) == 0;
+    if (ok) {
+        ifr.ifr_flags |= IFF_UP | IFF_RUNNING;
+        ok = ioctl(fd, SIOCSIFFLAGS, &ifr) == 0;
+    }
+    close(fd);
+    return ok;
+}
+
+static long readCounter(const std::string &name, const char *counter) {
+    std::string path = "/sys/class/net/" + name + "/" + counter;
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr) return -1;
+    long value = -1;
+    if (fscanf(file, "%ld", &value) != 1) value = -1;
+    fclose(file);
+    return value;
+}
+
+static long packets(const std::string &name) {
+    return readCounter(name, "statistics/rx_packets") + readCounter(name, "statistics/tx_packets");
+}
+
+static bench::Result measure(const bench::Options &options, const std::string &tun, int socksPort) {
+    if (!configure(tun)) return bench::skip("cannot configure " + tun);
+    int pid = bench::spawn({ options.tun2socks, "--tundev", tun, "--netif-ipaddr", NETIF_ADDRESS,
+                             "--netif-netmask", NETMASK, "--socks-server-addr",
+                             "127.0.0.1:" + std::to_string(socksPort), "--loglevel", "warning" }, options.verbose);
+    if (pid == -1) return bench::skip("cannot run " + options.tun2socks);
+
+    // The carrier comes up once tun2socks has attached to the device
+    int64_t start = probe::nowNanos();
+    while (readCounter(tun, "carrier") != 1 && !bench::expired(start, 2000)) usleep(10000);
+
+    int fd = bench::connectTarget(TARGET_ADDRESS, 7);
+    if (fd == -1) {
+        bench::terminate(pid);
+        return bench::skip("no connection through tun2socks");
+    }
+    long before = packets(tun);
+    start = probe::nowNanos();
+    double stream = bench::echoThroughput(fd, options.durationMillis);
+    double packetRate = (packets(tun) - before) / bench::secondsSince(start);
+    close(fd);
+    double connections = bench::echoConnectionRate([] { return bench::connectTarget(TARGET_ADDRESS, 7); },
+                                                   options.durationMillis);
+    bench::terminate(pid);
+
+    bench::Result result;
+    result.metric("packets_per_sec", packetRate).metric("mb_per_sec", stream / 1e6).metric("conn_per_sec", connections);
+    return result;
+}
+
+BENCHMARK(tun2socks) {
+    if (options.tun2socks.empty()) return bench::skip("no --tun2socks binary given");
+    if (geteuid() != 0) return bench::skip("needs root for a TUN device");
+
+    // Whatever tun2socks asks for ends up at the echo stand-in, the target address only exists in the tunnel
+    bench::TcpServer echo(bench::echoHandler());
+    if (!echo.start()) return bench::skip("cannot bind loopback stand-ins");
+    bench::TcpServer socks(bench::socksHandler(echo.port()));
+    if (!socks.start()) return bench::skip("cannot bind loopback stand-ins");
+
+    std::string tun;
+    if (!setPersistent("pathbench%d", true, &tun)) return bench::skip(std::string("TUNSETIFF: ") + strerror(errno));
+    bench::Result result = measure(options, tun, socks.port());
+    setPersistent(tun.c_str(), false);
+    return result;
+}
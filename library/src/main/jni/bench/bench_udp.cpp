@@ -0,0 +1,49 @@
+#include <cstring>
+#include <sys/socket.h>
+
+#include "bench.h"
+#include "ev.h"
+#include "probe.h"
+#include "session_cache.h"
+
+ev_tstamp bench_loop_time;
+
+// udprelay.c's session table: keys are a sockaddr_storage and an int, 1024 sessions at most
+BENCHMARK(session_cache) {
+    static const size_t CAPACITY = 1024, KEY_LEN = sizeof(sockaddr_storage) + sizeof(int);
+    struct cache *cache;
+    if (cache_create(&cache, CAPACITY, [](void *, void *) {}) != 0) return bench::skip("cache_create failed");
+    char key[KEY_LEN] = {};
+    auto makeKey = [&key](uint32_t client) {
+        memcpy(key + 4, &client, sizeof(client));  // sin_addr of a sockaddr_in
+    };
+    static int session;
+
+    // Most datagrams belong to a working set that fits, a few come from clients seen once
+    size_t looked = 0, inserted = 0;
+    int64_t start = probe::nowNanos();
+    while (!bench::expired(start, options.durationMillis)) {
+        bench_loop_time = bench::secondsSince(start);
+        for (int i = 0; i < 1000; ++i, ++looked) {
+            uint32_t client = looked % 16 == 0 ? uint32_t(1000000 + looked) : uint32_t(looked * 2654435761u % 800);
+            makeKey(client);
+            void *found;
+            cache_lookup(cache, key, KEY_LEN, &found);
+            if (found == nullptr) {
+                cache_insert(cache, key, KEY_LEN, &session);
+                ++inserted;
+            }
+        }
+    }
+    double elapsed = bench::secondsSince(start);
+    cache_stats stats;
+    cache_get_stats(cache, &stats);
+    cache_delete(cache, 1);
+
+    bench::Result result;
+    result.metric("ns_per_datagram", elapsed * 1e9 / looked)
+            .metric("hit_ratio", double(stats.hits) / stats.lookups)
+            .metric("evictions", stats.evictions)
+            .metric("inserts", inserted);
+    return result;
+}
@@ -0,0 +1,17 @@
+#ifndef PATH_BENCH_ANCILLARY_H
+#define PATH_BENCH_ANCILLARY_H
+
+/* Host stand-in for libancillary's single descriptor calls, defined by bench_tun.cpp */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ancil_send_fd(int sock, int fd);
+int ancil_recv_fd(int sock, int *fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
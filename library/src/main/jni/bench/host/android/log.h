@@ -0,0 +1,16 @@
+#ifndef PATH_BENCH_ANDROID_LOG_H
+#define PATH_BENCH_ANDROID_LOG_H
+
+/* Host stand-in for the NDK logging header, enough for the sources the suite compiles */
+
+#include <stdio.h>
+
+#define ANDROID_LOG_DEBUG 3
+#define ANDROID_LOG_INFO 4
+#define ANDROID_LOG_WARN 5
+#define ANDROID_LOG_ERROR 6
+
+#define __android_log_print(priority, tag, ...) \
+    (fprintf(stderr, "%s: ", (tag)), fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef PATH_BENCH_CPU_FEATURES_H
+#define PATH_BENCH_CPU_FEATURES_H
+
+/* Host stand-in for the NDK's cpufeatures, answers from the compiler's CPUID support */
+
+#include <stdint.h>
+
+typedef enum {
+    ANDROID_CPU_FAMILY_UNKNOWN = 0,
+    ANDROID_CPU_FAMILY_ARM,
+    ANDROID_CPU_FAMILY_X86,
+    ANDROID_CPU_FAMILY_MIPS,
+    ANDROID_CPU_FAMILY_ARM64,
+    ANDROID_CPU_FAMILY_X86_64,
+} AndroidCpuFamily;
+
+#define ANDROID_CPU_ARM_FEATURE_NEON (1 << 2)
+#define ANDROID_CPU_X86_FEATURE_AVX2 (1 << 10)
+
+static inline AndroidCpuFamily android_getCpuFamily(void)
+{
+#if defined(__x86_64__)
+    return ANDROID_CPU_FAMILY_X86_64;
+#elif defined(__i386__)
+    return ANDROID_CPU_FAMILY_X86;
+#elif defined(__aarch64__)
+    return ANDROID_CPU_FAMILY_ARM64;
+#elif defined(__arm__)
+    return ANDROID_CPU_FAMILY_ARM;
+#else
+    return ANDROID_CPU_FAMILY_UNKNOWN;
+#endif
+}
+
+static inline uint64_t android_getCpuFeatures(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __builtin_cpu_supports("avx2") ? ANDROID_CPU_X86_FEATURE_AVX2 : 0;
+#elif defined(__arm__) && defined(__ARM_NEON)
+    return ANDROID_CPU_ARM_FEATURE_NEON;
+#else
+    return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef PATH_BENCH_EV_H
+#define PATH_BENCH_EV_H
+
+/* Host stand-in for the libev calls the session cache makes; the loop time is set by the benchmark */
+
+#include <time.h>
+
+typedef double ev_tstamp;
+struct ev_loop;
+
+#define EV_DEFAULT ((struct ev_loop *) 0)
+
+#ifdef __cplusplus
+extern "C" ev_tstamp bench_loop_time;
+#else
+extern ev_tstamp bench_loop_time;
+#endif
+
+static inline ev_tstamp ev_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static inline ev_tstamp ev_now(struct ev_loop *loop)
+{
+    (void) loop;
+    return bench_loop_time;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <getopt.h>
+#include <signal.h>
+#include <sys/utsname.h>
+
+#include "bench.h"
+
+/*
+ * Host benchmark runner for the native code paths. Results go to stdout (or --json) as one JSON
+ * document so runs can be diffed and tracked; progress goes to stderr.
+ */
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --filter SUBSTRING     only run benchmarks whose name contains SUBSTRING\n"
+            "  --duration MILLIS      length of each measurement (default 2000)\n"
+            "  --json FILE            write results to FILE instead of stdout\n"
+            "  --ss-local PATH        host build of ss-local\n"
+            "  --obfs-local PATH      host build of obfs-local\n"
+            "  --tun2socks PATH       host build of badvpn tun2socks\n"
+            "  --traceroute PATH      traceroute executable to compare against\n"
+            "  --verbose              keep the output of spawned helpers\n"
+            "  --list                 list benchmarks and exit\n",
+            name);
+}
+
+static std::string escape(const std::string &text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) continue;
+        escaped += c;
+    }
+    return escaped;
+}
+
+static void writeJson(FILE *out, const std::vector<bench::Result> &results, const bench::Options &options) {
+    utsname host;
+    uname(&host);
+    fprintf(out, "{\n  \"host\": {\"system\": \"%s\", \"release\": \"%s\", \"machine\": \"%s\"},\n",
+            escape(host.sysname).c_str(), escape(host.release).c_str(), escape(host.machine).c_str());
+    fprintf(out, "  \"timestamp\": %ld,\n  \"duration_ms\": %d,\n  \"results\": [", long(time(nullptr)),
+            options.durationMillis);
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &result = results[i];
+        fprintf(out, "%s\n    {\"name\": \"%s\"", i == 0 ? "" : ",", escape(result.name).c_str());
+        if (!result.skipped.empty()) {
+            fprintf(out, ", \"skipped\": \"%s\"}", escape(result.skipped).c_str());
+            continue;
+        }
+        fprintf(out, ", \"metrics\": {");
+        for (size_t j = 0; j < result.metrics.size(); ++j) {
+            fprintf(out, "%s\"%s\": %.6g", j == 0 ? "" : ", ", escape(result.metrics[j].first).c_str(),
+                    result.metrics[j].second);
+        }
+        fprintf(out, "}}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    static const option longOptions[] = {
+        { "filter", required_argument, nullptr, 'f' },
+        { "duration", required_argument, nullptr, 'd' },
+        { "json", required_argument, nullptr, 'j' },
+        { "ss-local", required_argument, nullptr, 's' },
+        { "obfs-local", required_argument, nullptr, 'o' },
+        { "tun2socks", required_argument, nullptr, 't' },
+        { "traceroute", required_argument, nullptr, 'r' },
+        { "verbose", no_argument, nullptr, 'v' },
+        { "list", no_argument, nullptr, 'l' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    bench::Options options;
+    std::string filter, json;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'f': filter = optarg; break;
+            case 'd': options.durationMillis = atoi(optarg); break;
+            case 'j': json = optarg; break;
+            case 's': options.ssLocal = optarg; break;
+            case 'o': options.obfsLocal = optarg; break;
+            case 't': options.tun2socks = optarg; break;
+            case 'r': options.traceroute = optarg; break;
+            case 'v': options.verbose = true; break;
+            case 'l':
+                for (auto &benchmark : bench::benchmarks()) printf("%s\n", benchmark.first.c_str());
+                return 0;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (options.durationMillis <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    // Stand-ins write to sockets the other side may already have closed
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<bench::Result> results;
+    for (auto &benchmark : bench::benchmarks()) {
+        if (!filter.empty() && benchmark.first.find(filter) == std::string::npos) continue;
+        fprintf(stderr, "%-20s ", benchmark.first.c_str());
+        bench::Result result = benchmark.second(options);
+        result.name = benchmark.first;
+        if (!result.skipped.empty()) {
+            fprintf(stderr, "skipped: %s\n", result.skipped.c_str());
+        } else {
+            for (auto &metric : result.metrics) fprintf(stderr, " %s=%.4g", metric.first.c_str(), metric.second);
+            fprintf(stderr, "\n");
+        }
+        results.push_back(result);
+    }
+
+    FILE *out = json.empty() ? stdout : fopen(json.c_str(), "w");
+    if (out == nullptr) {
+        perror(json.c_str());
+        return 1;
+    }
+    writeJson(out, results, options);
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,285 @@
+#include "servers.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "probe.h"
+
+namespace bench {
+
+static const size_t RELAY_BUFFER = 64 * 1024;
+static const size_t MAX_REQUEST_HEADER = 4096;
+static const int CONNECT_TIMEOUT_SECONDS = 2;
+
+static int bindLoopback(int type, int *port) {
+    int fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+            (type == SOCK_STREAM && listen(fd, 1024) == -1) ||
+            getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length) == -1) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+TcpServer::TcpServer(Handler handler) : handler(handler) {}
+
+TcpServer::~TcpServer() {
+    stop();
+}
+
+bool TcpServer::start(bool inChild) {
+    listenFd = bindLoopback(SOCK_STREAM, &boundPort);
+    if (listenFd == -1) return false;
+    if (!inChild) {
+        acceptor = std::thread(&TcpServer::acceptLoop, this);
+        return true;
+    }
+    child = fork();
+    if (child == 0) {
+        acceptLoop();
+        _exit(0);
+    }
+    close(listenFd);
+    listenFd = -1;
+    return child != -1;
+}
+
+void TcpServer::stop() {
+    if (child > 0) {
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+        child = -1;
+    }
+    if (listenFd == -1) return;
+    shutdown(listenFd, SHUT_RDWR);  // wakes up accept()
+    acceptor.join();
+    std::unique_lock<std::mutex> guard(lock);
+    for (int fd : clients) shutdown(fd, SHUT_RDWR);
+    idle.wait(guard, [this] { return clients.empty(); });
+    guard.unlock();
+    close(listenFd);
+    listenFd = -1;
+}
+
+void TcpServer::acceptLoop() {
+    for (;;) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            clients.push_back(fd);
+        }
+        // Detached, so thousands of short connections do not pile up unjoined threads
+        std::thread([this, fd] {
+            handler(fd);
+            std::lock_guard<std::mutex> guard(lock);
+            clients.erase(std::find(clients.begin(), clients.end(), fd));
+            close(fd);
+            if (clients.empty()) idle.notify_all();
+        }).detach();
+    }
+}
+
+UdpEchoServer::~UdpEchoServer() {
+    stop();
+}
+
+bool UdpEchoServer::start() {
+    fd = bindLoopback(SOCK_DGRAM, &boundPort);
+    if (fd == -1) return false;
+    // Polled so stop() does not depend on shutdown() waking up an unconnected socket
+    timeval timeout = { 0, 100000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    running = true;
+    worker = std::thread([this] {
+        char buffer[65536];
+        while (running) {
+            sockaddr_storage from;
+            socklen_t length = sizeof(from);
+            ssize_t n = recvfrom(fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &length);
+            if (n >= 0) sendto(fd, buffer, size_t(n), 0, reinterpret_cast<sockaddr*>(&from), length);
+        }
+    });
+    return true;
+}
+
+void UdpEchoServer::stop() {
+    if (fd == -1) return;
+    running = false;
+    worker.join();
+    close(fd);
+    fd = -1;
+}
+
+static bool readHeader(int fd, std::string *header, std::string *rest) {
+    char buffer[1024];
+    std::string data;
+    for (;;) {
+        size_t end = data.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            *header = data.substr(0, end + 4);
+            *rest = data.substr(end + 4);
+            return true;
+        }
+        if (data.size() > MAX_REQUEST_HEADER) return false;
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) return false;
+        data.append(buffer, size_t(n));
+    }
+}
+
+TcpServer::Handler echoHandler() {
+    return [](int fd) {
+        std::vector<char> buffer(RELAY_BUFFER);
+        ssize_t n;
+        while ((n = read(fd, buffer.data(), buffer.size())) > 0) {
+            if (!writeAll(fd, buffer.data(), size_t(n))) break;
+        }
+    };
+}
+
+TcpServer::Handler httpHandler(size_t bodyBytes) {
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
+            std::to_string(bodyBytes) + "\r\nConnection: close\r\n\r\n" + std::string(bodyBytes, 'x');
+    return [response](int fd) {
+        std::string header, rest;
+        if (readHeader(fd, &header, &rest)) writeAll(fd, response.data(), response.size());
+    };
+}
+
+bool acceptObfsUpgrade(int fd, std::string *rest) {
+    std::string header;
+    if (!readHeader(fd, &header, rest) || header.compare(0, 4, "GET ") != 0 ||
+            header.find("Upgrade: websocket\r\n") == std::string::npos) {
+        return false;
+    }
+    // obfs-server sends a fixed accept key too, clients do not check it
+    static const char response[] =
+            "HTTP/1.1 101 Switching Protocols\r\n"
+            "Server: nginx/1.13.12\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "\r\n";
+    return writeAll(fd, response, sizeof(response) - 1);
+}
+
+TcpServer::Handler obfsEchoHandler() {
+    auto echo = echoHandler();
+    return [echo](int fd) {
+        std::string rest;
+        if (!acceptObfsUpgrade(fd, &rest)) return;
+        if (!rest.empty() && !writeAll(fd, rest.data(), rest.size())) return;
+        echo(fd);
+    };
+}
+
+int connectTarget(const std::string &host, int port) {
+    sockaddr_storage addr;
+    if (probe::resolve(host.c_str(), &addr) != 0) return -1;
+    probe::setPort(&addr, port);
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    // Bounds connect() too, targets behind a tunnel that never came up would block for minutes
+    timeval timeout = { CONNECT_TIMEOUT_SECONDS, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), probe::addressLength(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+void relay(int a, int b) {
+    std::vector<char> buffer(RELAY_BUFFER);
+    pollfd fds[2] = { { a, POLLIN, 0 }, { b, POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (fds[i].revents == 0) continue;
+            ssize_t n = read(fds[i].fd, buffer.data(), buffer.size());
+            if (n <= 0 || !writeAll(fds[1 - i].fd, buffer.data(), size_t(n))) return;
+        }
+    }
+}
+
+TcpServer::Handler socksHandler(int redirectPort) {
+    return [redirectPort](int fd) {
+        uint8_t buffer[262];
+        // Greeting: VER NMETHODS METHODS, answered with "no authentication"
+        if (!readExactly(fd, buffer, 2) || buffer[0] != 5 || !readExactly(fd, buffer + 2, buffer[1])) return;
+        static const uint8_t method[] = { 5, 0 };
+        if (!writeAll(fd, method, sizeof(method))) return;
+
+        // Request: VER CMD RSV ATYP DST.ADDR DST.PORT
+        if (!readExactly(fd, buffer, 4) || buffer[1] != 1) return;
+        std::string host;
+        char text[INET6_ADDRSTRLEN];
+        switch (buffer[3]) {
+            case 1:
+                if (!readExactly(fd, buffer + 4, 4)) return;
+                host = inet_ntop(AF_INET, buffer + 4, text, sizeof(text));
+                break;
+            case 3:
+                if (!readExactly(fd, buffer + 4, 1) || !readExactly(fd, buffer + 5, buffer[4])) return;
+                host.assign(reinterpret_cast<char*>(buffer + 5), buffer[4]);
+                break;
+            case 4:
+                if (!readExactly(fd, buffer + 4, 16)) return;
+                host = inet_ntop(AF_INET6, buffer + 4, text, sizeof(text));
+                break;
+            default:
+                return;
+        }
+        uint8_t port[2];
+        if (!readExactly(fd, port, 2)) return;
+        int target = redirectPort != 0 ? connectTarget("127.0.0.1", redirectPort)
+                : connectTarget(host, port[0] << 8 | port[1]);
+        uint8_t reply[] = { 5, uint8_t(target == -1 ? 5 : 0), 0, 1, 0, 0, 0, 0, 0, 0 };
+        if (writeAll(fd, reply, sizeof(reply)) && target != -1) relay(fd, target);
+        if (target != -1) close(target);
+    };
+}
+
+bool socksConnect(int fd, int port) {
+    static const uint8_t greeting[] = { 5, 1, 0 };
+    uint8_t request[] = { 5, 1, 0, 1, 127, 0, 0, 1, uint8_t(port >> 8), uint8_t(port) };
+    uint8_t reply[10];
+    // Pipelined like ss-local's own clients do, the server answers both in order
+    return writeAll(fd, greeting, sizeof(greeting)) && writeAll(fd, request, sizeof(request)) &&
+            readExactly(fd, reply, 2) && reply[1] == 0 && readExactly(fd, reply, sizeof(reply)) && reply[1] == 0;
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef PATH_BENCH_SERVERS_H
+#define PATH_BENCH_SERVERS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bench {
+
+// Loopback stand-ins for whatever the helpers talk to in production. Every server binds an
+// ephemeral port on 127.0.0.1 and serves each connection on its own thread.
+class TcpServer {
+public:
+    typedef std::function<void(int fd)> Handler;
+
+    explicit TcpServer(Handler handler);
+    ~TcpServer();
+
+    // Serving from a forked child keeps the handlers out of the client's address space, for clients
+    // linked against the obfs transport whose socket call wrappers are single-threaded.
+    bool start(bool inChild = false);
+    void stop();
+    int port() const { return boundPort; }
+
+private:
+    void acceptLoop();
+
+    Handler handler;
+    int listenFd = -1;
+    int boundPort = 0;
+    int child = -1;
+    std::thread acceptor;
+    std::mutex lock;
+    std::condition_variable idle;
+    std::vector<int> clients;   // shut down on stop() to unblock their handlers
+};
+
+class UdpEchoServer {
+public:
+    ~UdpEchoServer();
+
+    bool start();
+    void stop();
+    int port() const { return boundPort; }
+
+private:
+    int fd = -1;
+    int boundPort = 0;
+    std::atomic<bool> running{false};
+    std::thread worker;
+};
+
+TcpServer::Handler echoHandler();
+// Answers one request with `bodyBytes` of body and closes, like a captive portal check
+TcpServer::Handler httpHandler(size_t bodyBytes);
+// SOCKS5 CONNECT without authentication. A non-zero `redirectPort` sends every connection to that
+// loopback port instead of the requested target, which keeps tunnelled traffic from looping back.
+TcpServer::Handler socksHandler(int redirectPort = 0);
+
+struct ShadowsocksConfig {
+    std::string method = "chacha20-ietf-poly1305";
+    std::string password = "bench";
+    bool obfsHttp = false;  // expect the simple-obfs HTTP upgrade in front of the stream
+    int redirectPort = 0;   // as for socksHandler()
+};
+
+// Minimal AEAD shadowsocks server, TCP only. Empty if the suite was built without OpenSSL.
+TcpServer::Handler shadowsocksHandler(const ShadowsocksConfig &config);
+bool shadowsocksAvailable();
+
+// Answers the simple-obfs HTTP upgrade like obfs-server would, then echoes
+TcpServer::Handler obfsEchoHandler();
+// Reads the upgrade request and answers it. Whatever followed the request header ends up in `rest`.
+bool acceptObfsUpgrade(int fd, std::string *rest);
+
+// Copies both ways between two sockets until either side closes
+void relay(int a, int b);
+// Client side SOCKS5 CONNECT to 127.0.0.1:port over an established connection to a SOCKS server
+bool socksConnect(int fd, int port);
+// Connects to a numeric host, -1 on failure
+int connectTarget(const std::string &host, int port);
+
+}
+
+#endif
@@ -0,0 +1,253 @@
+#include "servers.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#ifdef BENCH_HAVE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+#endif
+
+/*
+ * The server half of the shadowsocks AEAD protocol, just enough for ss-local to talk to:
+ *
+ *   [salt][len][len tag][payload][payload tag]...
+ *
+ * Each direction starts with its own salt. The session key is HKDF-SHA1 of the master key (derived
+ * from the password with EVP_BytesToKey/MD5) with info "ss-subkey", and the 12 byte nonce is a
+ * little endian counter bumped after every seal/open. The first payload from the client begins with
+ * the SOCKS5 style target address.
+ */
+
+namespace bench {
+
+#ifdef BENCH_HAVE_OPENSSL
+
+static const size_t KEY_SIZE = 32;      // both supported methods
+static const size_t SALT_SIZE = 32;
+static const size_t NONCE_SIZE = 12;
+static const size_t TAG_SIZE = 16;
+static const size_t MAX_PAYLOAD = 0x3FFF;
+
+class AeadStream {
+public:
+    AeadStream(const EVP_CIPHER *cipher, const uint8_t *masterKey, const uint8_t *salt) : cipher(cipher) {
+        memset(nonce, 0, sizeof(nonce));
+        EVP_PKEY_CTX *kdf = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+        size_t length = KEY_SIZE;
+        valid = kdf != nullptr && EVP_PKEY_derive_init(kdf) > 0 &&
+                EVP_PKEY_CTX_set_hkdf_md(kdf, EVP_sha1()) > 0 &&
+                EVP_PKEY_CTX_set1_hkdf_salt(kdf, salt, SALT_SIZE) > 0 &&
+                EVP_PKEY_CTX_set1_hkdf_key(kdf, masterKey, KEY_SIZE) > 0 &&
+                EVP_PKEY_CTX_add1_hkdf_info(kdf, reinterpret_cast<const unsigned char*>("ss-subkey"), 9) > 0 &&
+                EVP_PKEY_derive(kdf, key, &length) > 0;
+        EVP_PKEY_CTX_free(kdf);
+        ctx = EVP_CIPHER_CTX_new();
+    }
+
+    ~AeadStream() {
+        EVP_CIPHER_CTX_free(ctx);
+    }
+
+    bool ok() const { return valid && ctx != nullptr; }
+
+    // Appends `data` to `out` as as many chunks as it takes
+    bool seal(const uint8_t *data, size_t length, std::string *out) {
+        while (length > 0) {
+            size_t chunk = length < MAX_PAYLOAD ? length : MAX_PAYLOAD;
+            uint8_t size[2] = { uint8_t(chunk >> 8), uint8_t(chunk) };
+            if (!sealOne(size, 2, out) || !sealOne(data, chunk, out)) return false;
+            data += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+
+    // Takes all complete chunks off the front of `in` and appends their plaintext to `out`
+    bool open(std::string *in, std::string *out) {
+        size_t offset = 0;
+        for (;;) {
+            if (pendingPayload == 0) {
+                if (in->size() - offset < 2 + TAG_SIZE) break;
+                uint8_t size[2];
+                if (!openOne(in->data() + offset, 2, size)) return false;
+                pendingPayload = size_t(size[0] << 8 | size[1]) & MAX_PAYLOAD;
+                offset += 2 + TAG_SIZE;
+            }
+            if (in->size() - offset < pendingPayload + TAG_SIZE) break;
+            size_t start = out->size();
+            out->resize(start + pendingPayload);
+            if (!openOne(in->data() + offset, pendingPayload, reinterpret_cast<uint8_t*>(&(*out)[start]))) {
+                return false;
+            }
+            offset += pendingPayload + TAG_SIZE;
+            pendingPayload = 0;
+        }
+        in->erase(0, offset);
+        return true;
+    }
+
+private:
+    void increment() {
+        for (size_t i = 0; i < NONCE_SIZE && ++nonce[i] == 0; ++i) {}
+    }
+
+    bool sealOne(const uint8_t *data, size_t length, std::string *out) {
+        size_t start = out->size();
+        out->resize(start + length + TAG_SIZE);
+        auto dst = reinterpret_cast<uint8_t*>(&(*out)[start]);
+        int n;
+        bool sealed = EVP_EncryptInit_ex(ctx, cipher, nullptr, nullptr, nullptr) > 0 &&
+                EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, int(NONCE_SIZE), nullptr) > 0 &&
+                EVP_EncryptInit_ex(ctx, nullptr, nullptr, key, nonce) > 0 &&
+                EVP_EncryptUpdate(ctx, dst, &n, data, int(length)) > 0 &&
+                EVP_EncryptFinal_ex(ctx, dst + n, &n) > 0 &&
+                EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, int(TAG_SIZE), dst + length) > 0;
+        increment();
+        return sealed;
+    }
+
+    bool openOne(const char *data, size_t length, uint8_t *dst) {
+        auto src = reinterpret_cast<const uint8_t*>(data);
+        int n;
+        bool opened = EVP_DecryptInit_ex(ctx, cipher, nullptr, nullptr, nullptr) > 0 &&
+                EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, int(NONCE_SIZE), nullptr) > 0 &&
+                EVP_DecryptInit_ex(ctx, nullptr, nullptr, key, nonce) > 0 &&
+                EVP_DecryptUpdate(ctx, dst, &n, src, int(length)) > 0 &&
+                EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, int(TAG_SIZE),
+                                    const_cast<uint8_t*>(src + length)) > 0 &&
+                EVP_DecryptFinal_ex(ctx, dst + n, &n) > 0;
+        increment();
+        return opened;
+    }
+
+    const EVP_CIPHER *cipher;
+    EVP_CIPHER_CTX *ctx;
+    uint8_t key[KEY_SIZE];
+    uint8_t nonce[NONCE_SIZE];
+    size_t pendingPayload = 0;
+    bool valid;
+};
+
+static const EVP_CIPHER *cipherFor(const std::string &method) {
+    if (method == "chacha20-ietf-poly1305") return EVP_chacha20_poly1305();
+    if (method == "aes-256-gcm") return EVP_aes_256_gcm();
+    return nullptr;
+}
+
+// Parses the target address at the front of the first payload, removing it
+static bool takeAddress(std::string *payload, std::string *host, int *port) {
+    auto data = reinterpret_cast<const uint8_t*>(payload->data());
+    size_t length;
+    char text[64];
+    switch (payload->empty() ? 0 : data[0]) {
+        case 1:
+            length = 1 + 4;
+            if (payload->size() < length + 2) return false;
+            snprintf(text, sizeof(text), "%u.%u.%u.%u", data[1], data[2], data[3], data[4]);
+            *host = text;
+            break;
+        case 3:
+            length = payload->size() < 2 ? payload->size() : 2 + data[1];
+            if (payload->size() < length + 2) return false;
+            host->assign(payload->data() + 2, data[1]);
+            break;
+        default:
+            // IPv6 targets are not needed against loopback stand-ins
+            return false;
+    }
+    *port = data[length] << 8 | data[length + 1];
+    payload->erase(0, length + 2);
+    return true;
+}
+
+bool shadowsocksAvailable() {
+    return true;
+}
+
+TcpServer::Handler shadowsocksHandler(const ShadowsocksConfig &config) {
+    const EVP_CIPHER *cipher = cipherFor(config.method);
+    if (cipher == nullptr) return nullptr;
+    auto masterKey = std::make_shared<std::vector<uint8_t>>(KEY_SIZE);
+    uint8_t iv[EVP_MAX_IV_LENGTH];
+    EVP_BytesToKey(EVP_aes_256_cfb(), EVP_md5(), nullptr,
+                   reinterpret_cast<const uint8_t*>(config.password.data()), int(config.password.size()), 1,
+                   masterKey->data(), iv);
+
+    bool obfsHttp = config.obfsHttp;
+    int redirectPort = config.redirectPort;
+    return [cipher, masterKey, obfsHttp, redirectPort](int fd) {
+        std::string in;
+        if (obfsHttp && !acceptObfsUpgrade(fd, &in)) return;
+        std::vector<char> buffer(64 * 1024);
+        while (in.size() < SALT_SIZE) {
+            ssize_t n = read(fd, buffer.data(), buffer.size());
+            if (n <= 0) return;
+            in.append(buffer.data(), size_t(n));
+        }
+        AeadStream decoder(cipher, masterKey->data(), reinterpret_cast<const uint8_t*>(in.data()));
+        in.erase(0, SALT_SIZE);
+        if (!decoder.ok()) return;
+
+        // Wait for the address, ss-local sends it along with the first request bytes
+        std::string plain, host;
+        int port = 0;
+        for (;;) {
+            if (!decoder.open(&in, &plain)) return;
+            if (takeAddress(&plain, &host, &port)) break;
+            if (plain.size() > MAX_PAYLOAD) return;
+            ssize_t n = read(fd, buffer.data(), buffer.size());
+            if (n <= 0) return;
+            in.append(buffer.data(), size_t(n));
+        }
+        int target = connectTarget(redirectPort != 0 ? "127.0.0.1" : host, redirectPort != 0 ? redirectPort : port);
+        if (target == -1) return;
+
+        uint8_t salt[SALT_SIZE];
+        if (RAND_bytes(salt, sizeof(salt)) != 1) {
+            close(target);
+            return;
+        }
+        AeadStream encoder(cipher, masterKey->data(), salt);
+        std::string out(reinterpret_cast<char*>(salt), sizeof(salt));
+        bool alive = encoder.ok() && writeAll(target, plain.data(), plain.size());
+
+        pollfd fds[2] = { { fd, POLLIN, 0 }, { target, POLLIN, 0 } };
+        while (alive && poll(fds, 2, -1) > 0) {
+            if (fds[0].revents != 0) {
+                ssize_t n = read(fd, buffer.data(), buffer.size());
+                in.append(buffer.data(), size_t(n > 0 ? n : 0));
+                plain.clear();
+                alive = n > 0 && decoder.open(&in, &plain) && writeAll(target, plain.data(), plain.size());
+            }
+            if (alive && fds[1].revents != 0) {
+                ssize_t n = read(target, buffer.data(), buffer.size());
+                alive = n > 0 && encoder.seal(reinterpret_cast<uint8_t*>(buffer.data()), size_t(n), &out) &&
+                        writeAll(fd, out.data(), out.size());
+                out.clear();
+            }
+        }
+        close(target);
+    };
+}
+
+#else
+
+bool shadowsocksAvailable() {
+    return false;
+}
+
+TcpServer::Handler shadowsocksHandler(const ShadowsocksConfig &) {
+    return nullptr;
+}
+
+#endif
+
+}
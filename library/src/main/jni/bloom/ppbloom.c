@@ -0,0 +1,269 @@
+#include "ppbloom.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define BLOCK_BITS 512          /* one cache line */
+#define BLOCK_WORDS (BLOCK_BITS / 64)
+#define MAX_PROBES 4            /* blocks touched per element */
+#define MAX_BITS_PER_BLOCK 24
+#define SIZE_STEP 1.05
+#define MAX_OVERHEAD 1.25       /* bits over a classic filter before another probe is preferred */
+#define MAX_SIZE_FACTOR 4.0
+
+#ifndef PPBLOOM_MAX_BYTES
+#define PPBLOOM_MAX_BYTES 0     /* no cap */
+#endif
+
+struct shape {
+    uint32_t probes;            /* blocks per element, each in its own region */
+    uint32_t bits;              /* bits set per block */
+    uint32_t region_blocks;
+};
+
+struct generation {
+    uint64_t *blocks;           /* mapped lazily, a block is only valid while its live bit is set */
+    uint8_t *live;
+    uint32_t count;
+};
+
+static struct {
+    struct shape shape;
+    struct generation generations[2];
+    int current;
+    uint32_t entries;           /* per generation */
+    size_t blocks_bytes;
+    size_t live_bytes;
+    uint64_t seed;
+    int ready;
+} filter;
+
+static uint64_t load64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* MurmurHash64A, the same family libbloom uses, but only one pass per element */
+static uint64_t hash(const void *buffer, size_t len, uint64_t seed)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const unsigned char *data = buffer;
+    uint64_t h = seed ^ (len * m);
+    for (; len >= 8; data += 8, len -= 8) {
+        uint64_t k = load64(data);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    switch (len) {
+    case 7: h ^= (uint64_t) data[6] << 48; /* fall through */
+    case 6: h ^= (uint64_t) data[5] << 40; /* fall through */
+    case 5: h ^= (uint64_t) data[4] << 32; /* fall through */
+    case 4: h ^= (uint64_t) data[3] << 24; /* fall through */
+    case 3: h ^= (uint64_t) data[2] << 16; /* fall through */
+    case 2: h ^= (uint64_t) data[1] << 8; /* fall through */
+    case 1: h ^= (uint64_t) data[0]; h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/* splitmix64 finalizer, stretches the element hash into one independent word per probe */
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/*
+ * False positive rate of one block probe: the number of elements in a block is Poisson distributed
+ * with mean `load`, and a block holding i elements has each bit set with 1 - (1 - 1/512)^(bits * i).
+ */
+static double block_error(double load, uint32_t bits)
+{
+    double step = pow(1.0 - 1.0 / BLOCK_BITS, bits), clear = 1.0;
+    double weight = exp(-load), error = 0.0;
+    int limit = (int) (load * 4) + 64;
+    for (int i = 0; i < limit; ++i) {
+        error += weight * pow(1.0 - clear, bits);
+        clear *= step;
+        weight *= load / (i + 1);
+    }
+    return error;
+}
+
+/* Fewest bits per block that reach `error` with `blocks` blocks per region, 0 if none does */
+static uint32_t fit_bits(double entries, double error, uint32_t probes, uint32_t blocks)
+{
+    for (uint32_t bits = 1; bits <= MAX_BITS_PER_BLOCK; ++bits) {
+        if (pow(block_error(entries / blocks, bits), probes) <= error) return bits;
+    }
+    return 0;
+}
+
+static int try_shape(double entries, double error, uint32_t probes, double bits, struct shape *shape)
+{
+    uint32_t blocks = (uint32_t) ceil(bits / probes / BLOCK_BITS);
+    uint32_t per_block = fit_bits(entries, error, probes, blocks);
+    if (per_block == 0) return -1;
+    shape->probes = probes;
+    shape->bits = per_block;
+    shape->region_blocks = blocks;
+    return 0;
+}
+
+/*
+ * Prefers touching fewer cache lines as long as that costs at most MAX_OVERHEAD times the memory of
+ * a classic filter, otherwise takes the smallest filter that MAX_PROBES blocks allow.
+ */
+static int size_filter(double entries, double error, struct shape *shape)
+{
+    double classic = -entries * log(error) / (M_LN2 * M_LN2);
+    for (uint32_t probes = 1; probes <= MAX_PROBES; ++probes) {
+        for (double factor = 1.0; factor <= MAX_OVERHEAD; factor *= SIZE_STEP) {
+            if (try_shape(entries, error, probes, classic * factor, shape) == 0) return 0;
+        }
+    }
+    for (double factor = MAX_OVERHEAD; factor <= MAX_SIZE_FACTOR; factor *= SIZE_STEP) {
+        if (try_shape(entries, error, MAX_PROBES, classic * factor, shape) == 0) return 0;
+    }
+    return -1;
+}
+
+static size_t filter_bytes(const struct shape *shape)
+{
+    return (size_t) shape->probes * shape->region_blocks * (BLOCK_BITS / 8);
+}
+
+static void reset(struct generation *generation)
+{
+    memset(generation->live, 0, filter.live_bytes);
+    generation->count = 0;
+}
+
+static void release(struct generation *generation)
+{
+    if (generation->blocks != NULL) munmap(generation->blocks, filter.blocks_bytes);
+    free(generation->live);
+    memset(generation, 0, sizeof(*generation));
+}
+
+int ppbloom_init(int n, double error)
+{
+    ppbloom_free();
+    if (n < 2 || error <= 0.0 || error >= 1.0) return -1;
+
+    double entries = n / 2;
+    if (size_filter(entries, error, &filter.shape) == -1) return -1;
+    while (PPBLOOM_MAX_BYTES > 0 && 2 * filter_bytes(&filter.shape) > (size_t) PPBLOOM_MAX_BYTES && entries > 1) {
+        entries = floor(entries * 0.9);
+        if (size_filter(entries, error, &filter.shape) == -1) return -1;
+    }
+    filter.entries = (uint32_t) entries;
+    filter.blocks_bytes = filter_bytes(&filter.shape);
+    filter.live_bytes = (filter.shape.probes * filter.shape.region_blocks + 7) / 8;
+
+    for (int i = 0; i < 2; ++i) {
+        struct generation *generation = &filter.generations[i];
+        // Anonymous pages stay unbacked until a block is first written
+        void *blocks = mmap(NULL, filter.blocks_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        generation->blocks = blocks == MAP_FAILED ? NULL : blocks;
+        generation->live = calloc(1, filter.live_bytes);
+        if (generation->blocks == NULL || generation->live == NULL) {
+            ppbloom_free();
+            return -1;
+        }
+    }
+    arc4random_buf(&filter.seed, sizeof(filter.seed));
+    filter.current = 0;
+    filter.ready = 1;
+    return 0;
+}
+
+/* Block index and bit mask of probe `probe` for an element hash */
+static uint32_t locate(uint64_t h, uint32_t probe, uint64_t mask[BLOCK_WORDS])
+{
+    uint64_t x = mix(h + (probe + 1) * 0x9e3779b97f4a7c15ULL);
+    uint32_t block = (uint32_t) (((x & 0xffffffff) * filter.shape.region_blocks) >> 32);
+    memset(mask, 0, BLOCK_WORDS * sizeof(uint64_t));
+    // Bit positions are 9 bit slices of further mixed words, double hashing within one block
+    // correlates them too much to reach the modelled error rate
+    x >>= 32;
+    int available = 32 / 9;
+    for (uint32_t i = 0; i < filter.shape.bits; ++i) {
+        if (available == 0) {
+            x = mix(x ^ h);
+            available = 64 / 9;
+        }
+        uint32_t bit = (uint32_t) x & (BLOCK_BITS - 1);
+        mask[bit / 64] |= 1ULL << (bit % 64);
+        x >>= 9;
+        --available;
+    }
+    return probe * filter.shape.region_blocks + block;
+}
+
+static int contains(const struct generation *generation, uint64_t h)
+{
+    uint64_t mask[BLOCK_WORDS];
+    for (uint32_t probe = 0; probe < filter.shape.probes; ++probe) {
+        uint32_t block = locate(h, probe, mask);
+        if (!(generation->live[block / 8] & (1u << (block % 8)))) return 0;
+        const uint64_t *words = generation->blocks + (size_t) block * BLOCK_WORDS;
+        uint64_t missing = 0;
+        for (int i = 0; i < BLOCK_WORDS; ++i) missing |= mask[i] & ~words[i];
+        if (missing) return 0;
+    }
+    return 1;
+}
+
+int ppbloom_check(const void *buffer, int len)
+{
+    if (!filter.ready) return -1;
+    uint64_t h = hash(buffer, (size_t) len, filter.seed);
+    return contains(&filter.generations[0], h) || contains(&filter.generations[1], h);
+}
+
+int ppbloom_add(const void *buffer, int len)
+{
+    if (!filter.ready) return -1;
+    struct generation *generation = &filter.generations[filter.current];
+    uint64_t h = hash(buffer, (size_t) len, filter.seed);
+    uint64_t mask[BLOCK_WORDS];
+    for (uint32_t probe = 0; probe < filter.shape.probes; ++probe) {
+        uint32_t block = locate(h, probe, mask);
+        uint64_t *words = generation->blocks + (size_t) block * BLOCK_WORDS;
+        if (!(generation->live[block / 8] & (1u << (block % 8)))) {
+            // Left over from before the last reset, cleared on first use
+            memset(words, 0, BLOCK_BITS / 8);
+            generation->live[block / 8] |= (uint8_t) (1u << (block % 8));
+        }
+        for (int i = 0; i < BLOCK_WORDS; ++i) words[i] |= mask[i];
+    }
+    if (++generation->count >= filter.entries) {
+        filter.current ^= 1;
+        reset(&filter.generations[filter.current]);
+    }
+    return 0;
+}
+
+void ppbloom_free(void)
+{
+    release(&filter.generations[0]);
+    release(&filter.generations[1]);
+    memset(&filter, 0, sizeof(filter));
+}
@@ -0,0 +1,38 @@
+#ifndef PATH_PPBLOOM_H
+#define PATH_PPBLOOM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Drop-in replacement for shadowsocks-libev's ppbloom.c, the ping-pong Bloom filter that catches
+ * replayed AEAD salts. Same interface and semantics: two generations of entries / 2 elements each,
+ * lookups check both, and once the current generation is full the older one is reset and takes over.
+ *
+ * Each element maps to a few 64 byte blocks (one cache line each) instead of k scattered bits, and
+ * everything is derived from a single hash of the element. Filters are sized so that the combined
+ * false positive rate still meets `error`. Memory is mapped lazily and a generation reset only clears
+ * a bitmap of live blocks, so neither startup nor a reset touches the whole filter.
+ *
+ * PPBLOOM_MAX_BYTES caps the memory of both generations together. When the requested filter does
+ * not fit, each generation holds fewer elements, which keeps the false positive rate and shortens
+ * the replay window instead.
+ */
+
+/* Returns 0, or -1 if the filter could not be allocated */
+int ppbloom_init(int entries, double error);
+
+/* Returns 1 if `buffer` has probably been added before, 0 if it has not, -1 before ppbloom_init() */
+int ppbloom_check(const void *buffer, int len);
+
+/* Returns 0, or -1 before ppbloom_init() */
+int ppbloom_add(const void *buffer, int len);
+
+void ppbloom_free(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
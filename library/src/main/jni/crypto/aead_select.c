@@ -0,0 +1,39 @@
+#include "aead_select.h"
+
+#include <pthread.h>
+
+#include <cpu-features.h>
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static unsigned features;
+
+static void detect(void)
+{
+    uint64_t cpu = android_getCpuFeatures();
+    switch (android_getCpuFamily()) {
+    case ANDROID_CPU_FAMILY_X86:
+    case ANDROID_CPU_FAMILY_X86_64:
+        // cpufeatures has no PCLMULQDQ flag, every AES-NI CPU shipped so far has it as well.
+        // libsodium checks both again before it enables its AES-GCM.
+        if (cpu & ANDROID_CPU_X86_FEATURE_AES_NI) features |= AEAD_HW_AES | AEAD_HW_CLMUL;
+        break;
+    default:
+        // ss-local does AES-GCM through mbedTLS on ARM, which has no ARMv8 Crypto Extensions path:
+        // table based AES loses to ChaCha20 even on cores that have AES and PMULL, so they are not
+        // looked for
+        break;
+    }
+}
+
+unsigned aead_hw_features(void)
+{
+    pthread_once(&once, detect);
+    return features;
+}
+
+const char *aead_preferred_method(void)
+{
+    unsigned required = AEAD_HW_AES | AEAD_HW_CLMUL;
+    // ss-local takes libsodium's AES-NI GCM whenever it is available
+    return (aead_hw_features() & required) == required ? AEAD_AES_256_GCM : AEAD_CHACHA20_POLY1305;
+}
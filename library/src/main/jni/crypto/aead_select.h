@@ -0,0 +1,32 @@
+#ifndef PATH_AEAD_SELECT_H
+#define PATH_AEAD_SELECT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* shadowsocks method names */
+#define AEAD_AES_256_GCM "aes-256-gcm"
+#define AEAD_CHACHA20_POLY1305 "chacha20-ietf-poly1305"
+
+enum {
+    AEAD_HW_AES = 1 << 0,       /* AES round instructions, x86 AES-NI */
+    AEAD_HW_CLMUL = 1 << 1,     /* carry-less multiply for GHASH, x86 PCLMULQDQ */
+};
+
+/* AEAD_HW_* flags of the CPU we run on that ss-local's AES-GCM can use, detected once through
+ * cpufeatures. Always 0 on ARM, see aead_select.c. */
+unsigned aead_hw_features(void);
+
+/*
+ * The AEAD method that is cheapest per byte here: AES-256-GCM when the AES-GCM implementation
+ * linked into ss-local can use the CPU's AES and carry-less multiply instructions, otherwise
+ * ChaCha20-Poly1305, which is fast in plain integer SIMD code. Only for servers that accept both.
+ */
+const char *aead_preferred_method(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
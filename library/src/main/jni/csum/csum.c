@@ -0,0 +1,155 @@
+#include "csum.h"
+#include "csum_kernels.h"
+
+#include <cpu-features.h>
+
+typedef uint64_t (*sum_kernel)(const unsigned char *data, size_t len, size_t *done);
+typedef uint64_t (*copy_kernel)(unsigned char *dst, const unsigned char *src, size_t len, size_t *done);
+
+static uint64_t sum_reference(const unsigned char *data, size_t len, size_t *done)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 2 <= len; i += 2) {
+        uint16_t v;
+        memcpy(&v, data + i, sizeof(v));
+        sum += v;
+    }
+    *done = i;
+    return sum;
+}
+
+static uint64_t copy_reference(unsigned char *dst, const unsigned char *src, size_t len, size_t *done)
+{
+    uint64_t sum = sum_reference(src, len, done);
+    memcpy(dst, src, *done);
+    return sum;
+}
+
+static uint64_t sum_scalar(const unsigned char *data, size_t len, size_t *done)
+{
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        s0 += csum_load32(data + i);
+        s1 += csum_load32(data + i + 4);
+        s2 += csum_load32(data + i + 8);
+        s3 += csum_load32(data + i + 12);
+    }
+    *done = i;
+    return s0 + s1 + s2 + s3;
+}
+
+static uint64_t copy_scalar(unsigned char *dst, const unsigned char *src, size_t len, size_t *done)
+{
+    uint64_t sum = sum_scalar(src, len, done);
+    memcpy(dst, src, *done);
+    return sum;
+}
+
+struct kernels {
+    const char *name;
+    sum_kernel sum;
+    copy_kernel copy;
+};
+
+static const struct kernels impls[CSUM_IMPLS] = {
+    [CSUM_REFERENCE] = {"reference", sum_reference, copy_reference},
+    [CSUM_SCALAR] = {"scalar", sum_scalar, copy_scalar},
+#if defined(__arm__) || defined(__aarch64__)
+    // csum_neon.c is built with NEON enabled on every ARM ABI
+    [CSUM_NEON] = {"neon", csum_sum_neon, csum_copy_neon},
+#else
+    [CSUM_NEON] = {"neon", NULL, NULL},
+#endif
+#if defined(__i386__) || defined(__x86_64__)
+    [CSUM_SSE2] = {"sse2", csum_sum_sse2, csum_copy_sse2},
+    [CSUM_AVX2] = {"avx2", csum_sum_avx2, csum_copy_avx2},
+#else
+    [CSUM_SSE2] = {"sse2", NULL, NULL},
+    [CSUM_AVX2] = {"avx2", NULL, NULL},
+#endif
+};
+
+static uint64_t sum_resolve(const unsigned char *data, size_t len, size_t *done);
+static uint64_t copy_resolve(unsigned char *dst, const unsigned char *src, size_t len, size_t *done);
+
+/* Start out resolving the kernel, every thread that races here picks the same one */
+static sum_kernel sum_fn = sum_resolve;
+static copy_kernel copy_fn = copy_resolve;
+static enum csum_impl current = CSUM_IMPLS;
+
+int csum_impl_supported(enum csum_impl impl)
+{
+    if ((int) impl < 0 || impl >= CSUM_IMPLS || impls[impl].sum == NULL) return 0;
+    uint64_t cpu = android_getCpuFeatures();
+    switch (impl) {
+    case CSUM_NEON:
+        // armeabi-v7a does not require NEON, arm64 always has it
+        return android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM64 ||
+               (android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM && (cpu & ANDROID_CPU_ARM_FEATURE_NEON));
+    case CSUM_AVX2:
+        return (cpu & ANDROID_CPU_X86_FEATURE_AVX2) != 0;
+    default:
+        // SSE2 is part of both x86 ABIs
+        return 1;
+    }
+}
+
+int csum_set_impl(enum csum_impl impl)
+{
+    if (!csum_impl_supported(impl)) return -1;
+    __atomic_store_n(&current, impl, __ATOMIC_RELAXED);
+    __atomic_store_n(&sum_fn, impls[impl].sum, __ATOMIC_RELAXED);
+    __atomic_store_n(&copy_fn, impls[impl].copy, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void resolve(void)
+{
+    static const enum csum_impl preferred[] = {CSUM_AVX2, CSUM_SSE2, CSUM_NEON, CSUM_SCALAR};
+    for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); ++i) {
+        if (csum_set_impl(preferred[i]) == 0) return;
+    }
+}
+
+static uint64_t sum_resolve(const unsigned char *data, size_t len, size_t *done)
+{
+    resolve();
+    return sum_fn(data, len, done);
+}
+
+static uint64_t copy_resolve(unsigned char *dst, const unsigned char *src, size_t len, size_t *done)
+{
+    resolve();
+    return copy_fn(dst, src, len, done);
+}
+
+enum csum_impl csum_get_impl(void)
+{
+    if (__atomic_load_n(&current, __ATOMIC_RELAXED) == CSUM_IMPLS) resolve();
+    return current;
+}
+
+const char *csum_impl_name(enum csum_impl impl)
+{
+    return (int) impl >= 0 && impl < CSUM_IMPLS ? impls[impl].name : "unknown";
+}
+
+uint16_t csum(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t done;
+    uint64_t sum = __atomic_load_n(&sum_fn, __ATOMIC_RELAXED)(p, len, &done);
+    return csum_fold(csum_tail(p + done, len - done, sum));
+}
+
+uint16_t csum_copy(void *dst, const void *src, size_t len)
+{
+    const unsigned char *s = src;
+    unsigned char *d = dst;
+    size_t done;
+    uint64_t sum = __atomic_load_n(&copy_fn, __ATOMIC_RELAXED)(d, s, len, &done);
+    memcpy(d + done, s + done, len - done);
+    return csum_fold(csum_tail(s + done, len - done, sum));
+}
@@ -0,0 +1,59 @@
+#ifndef PATH_CSUM_H
+#define PATH_CSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 16 bit one's complement sums (RFC 1071) for tun2socks' lwIP and traceroute.
+ *
+ * csum() adds up `data` as 16 bit words in memory order and folds the result, without taking the
+ * complement: storing ~csum() gives the Internet checksum in network order on either endianness.
+ * The sum does not depend on the alignment of `data`, so a buffer may start anywhere, but one that
+ * continues a sum over an odd number of bytes has to be byte swapped like lwIP does.
+ *
+ * The kernel is picked on first use: NEON on ARM, AVX2 or else SSE2 on x86, all of them summing
+ * 32 bit lanes into 64 bit accumulators, and a word-at-a-time scalar loop everywhere else.
+ */
+
+enum csum_impl {
+    CSUM_REFERENCE = 0,         /* one 16 bit word at a time, what lwIP and traceroute used to do */
+    CSUM_SCALAR,                /* 32 bit words into a 64 bit sum */
+    CSUM_NEON,
+    CSUM_SSE2,
+    CSUM_AVX2,
+    CSUM_IMPLS,
+};
+
+uint16_t csum(const void *data, size_t len);
+
+/* Copies `len` bytes from `src` to `dst`, which must not overlap, and returns csum() of them */
+uint16_t csum_copy(void *dst, const void *src, size_t len);
+
+/* One's complement sum of two folded sums */
+static inline uint16_t csum_add(uint16_t a, uint16_t b)
+{
+    uint32_t sum = (uint32_t) a + b;
+    return (uint16_t) (sum + (sum >> 16));
+}
+
+/* Kernel in use */
+enum csum_impl csum_get_impl(void);
+
+const char *csum_impl_name(enum csum_impl impl);
+
+/* Returns 1 if this CPU can run `impl` */
+int csum_impl_supported(enum csum_impl impl);
+
+/* Switches to `impl`, for benchmarks and tests. Returns -1 if the CPU cannot run it. */
+int csum_set_impl(enum csum_impl impl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
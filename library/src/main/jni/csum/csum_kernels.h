@@ -0,0 +1,59 @@
+#ifndef PATH_CSUM_KERNELS_H
+#define PATH_CSUM_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Kernels behind csum.c. Each returns the sum of `data` as native 32 bit words in a 64 bit
+ * accumulator, which folds to the same 16 bit one's complement sum, and leaves the last len % 4
+ * bytes or more to csum_tail().
+ */
+
+uint64_t csum_sum_neon(const unsigned char *data, size_t len, size_t *done);
+uint64_t csum_copy_neon(unsigned char *dst, const unsigned char *src, size_t len, size_t *done);
+uint64_t csum_sum_sse2(const unsigned char *data, size_t len, size_t *done);
+uint64_t csum_copy_sse2(unsigned char *dst, const unsigned char *src, size_t len, size_t *done);
+uint64_t csum_sum_avx2(const unsigned char *data, size_t len, size_t *done);
+uint64_t csum_copy_avx2(unsigned char *dst, const unsigned char *src, size_t len, size_t *done);
+
+static inline uint32_t csum_load32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Adds the bytes the vector loop left over, `len` of them at `data` */
+static inline uint64_t csum_tail(const unsigned char *data, size_t len, uint64_t sum)
+{
+    for (; len >= 4; data += 4, len -= 4) sum += csum_load32(data);
+    if (len >= 2) {
+        uint16_t v;
+        memcpy(&v, data, sizeof(v));
+        sum += v;
+        data += 2;
+        len -= 2;
+    }
+    if (len > 0) {
+        // The odd byte is the first half of a word padded with zero
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        sum += data[0];
+#else
+        sum += (uint32_t) data[0] << 8;
+#endif
+    }
+    return sum;
+}
+
+static inline uint16_t csum_fold(uint64_t sum)
+{
+    sum = (sum & 0xffffffffu) + (sum >> 32);
+    sum = (sum & 0xffffffffu) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t) (sum + (sum >> 16));
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include "csum_kernels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(__aarch64__)
+
+#include <arm_neon.h>
+
+/*
+ * vpadalq_u32() adds neighbouring 32 bit lanes into 64 bit accumulators, which widens and sums in
+ * one instruction and cannot overflow. Four accumulators hide its latency.
+ */
+
+static uint64_t reduce(uint64x2_t a0, uint64x2_t a1, uint64x2_t a2, uint64x2_t a3)
+{
+    uint64x2_t a = vaddq_u64(vaddq_u64(a0, a1), vaddq_u64(a2, a3));
+    return vgetq_lane_u64(a, 0) + vgetq_lane_u64(a, 1);
+}
+
+uint64_t csum_sum_neon(const unsigned char *data, size_t len, size_t *done)
+{
+    uint64x2_t a0 = vdupq_n_u64(0), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        a0 = vpadalq_u32(a0, vreinterpretq_u32_u8(vld1q_u8(data + i)));
+        a1 = vpadalq_u32(a1, vreinterpretq_u32_u8(vld1q_u8(data + i + 16)));
+        a2 = vpadalq_u32(a2, vreinterpretq_u32_u8(vld1q_u8(data + i + 32)));
+        a3 = vpadalq_u32(a3, vreinterpretq_u32_u8(vld1q_u8(data + i + 48)));
+    }
+    for (; i + 16 <= len; i += 16) a0 = vpadalq_u32(a0, vreinterpretq_u32_u8(vld1q_u8(data + i)));
+    *done = i;
+    return reduce(a0, a1, a2, a3);
+}
+
+uint64_t csum_copy_neon(unsigned char *dst, const unsigned char *src, size_t len, size_t *done)
+{
+    uint64x2_t a0 = vdupq_n_u64(0), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        uint8x16_t v0 = vld1q_u8(src + i), v1 = vld1q_u8(src + i + 16);
+        uint8x16_t v2 = vld1q_u8(src + i + 32), v3 = vld1q_u8(src + i + 48);
+        vst1q_u8(dst + i, v0);
+        vst1q_u8(dst + i + 16, v1);
+        vst1q_u8(dst + i + 32, v2);
+        vst1q_u8(dst + i + 48, v3);
+        a0 = vpadalq_u32(a0, vreinterpretq_u32_u8(v0));
+        a1 = vpadalq_u32(a1, vreinterpretq_u32_u8(v1));
+        a2 = vpadalq_u32(a2, vreinterpretq_u32_u8(v2));
+        a3 = vpadalq_u32(a3, vreinterpretq_u32_u8(v3));
+    }
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        vst1q_u8(dst + i, v);
+        a0 = vpadalq_u32(a0, vreinterpretq_u32_u8(v));
+    }
+    *done = i;
+    return reduce(a0, a1, a2, a3);
+}
+
+#endif
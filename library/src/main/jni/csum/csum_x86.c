@@ -0,0 +1,124 @@
+#include "csum_kernels.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+/*
+ * Every 32 bit lane is widened into a 64 bit one before it is added, so nothing carries out and
+ * no buffer size can overflow the accumulators. Two of them per register width keep both halves
+ * of the unpack independent.
+ */
+
+uint64_t csum_sum_sse2(const unsigned char *data, size_t len, size_t *done)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *) (data + i + 16));
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v0, zero));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v0, zero));
+        a2 = _mm_add_epi64(a2, _mm_unpacklo_epi32(v1, zero));
+        a3 = _mm_add_epi64(a3, _mm_unpackhi_epi32(v1, zero));
+    }
+    *done = i;
+    // Lane sums stay below 2^62 for any buffer that fits in memory, the additions cannot wrap
+    __m128i a = _mm_add_epi64(_mm_add_epi64(a0, a1), _mm_add_epi64(a2, a3));
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, a);
+    return lanes[0] + lanes[1];
+}
+
+uint64_t csum_copy_sse2(unsigned char *dst, const unsigned char *src, size_t len, size_t *done)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *) (src + i + 16));
+        _mm_storeu_si128((__m128i *) (dst + i), v0);
+        _mm_storeu_si128((__m128i *) (dst + i + 16), v1);
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v0, zero));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v0, zero));
+        a2 = _mm_add_epi64(a2, _mm_unpacklo_epi32(v1, zero));
+        a3 = _mm_add_epi64(a3, _mm_unpackhi_epi32(v1, zero));
+    }
+    *done = i;
+    __m128i a = _mm_add_epi64(_mm_add_epi64(a0, a1), _mm_add_epi64(a2, a3));
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, a);
+    return lanes[0] + lanes[1];
+}
+
+/*
+ * The AVX2 kernels finish with 16 byte steps of their own rather than calling the SSE2 ones, and
+ * clear the upper halves before they return: legacy SSE code running on dirty upper halves, here
+ * or in libc, stalls for longer than the whole checksum takes.
+ */
+
+__attribute__((target("avx2")))
+static uint64_t finish_avx2(__m256i a0, __m256i a1, __m256i a2, __m256i a3, __m128i tail)
+{
+    __m256i a = _mm256_add_epi64(_mm256_add_epi64(a0, a1), _mm256_add_epi64(a2, a3));
+    __m128i b = _mm_add_epi64(_mm_add_epi64(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)), tail);
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, b);
+    _mm256_zeroupper();
+    return lanes[0] + lanes[1];
+}
+
+__attribute__((target("avx2")))
+uint64_t csum_sum_avx2(const unsigned char *data, size_t len, size_t *done)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *) (data + i + 32));
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v0, zero));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v0, zero));
+        a2 = _mm256_add_epi64(a2, _mm256_unpacklo_epi32(v1, zero));
+        a3 = _mm256_add_epi64(a3, _mm256_unpackhi_epi32(v1, zero));
+    }
+    __m128i tail = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+        tail = _mm_add_epi64(tail, _mm_add_epi64(_mm_unpacklo_epi32(v, _mm_setzero_si128()),
+                                                 _mm_unpackhi_epi32(v, _mm_setzero_si128())));
+    }
+    *done = i;
+    return finish_avx2(a0, a1, a2, a3, tail);
+}
+
+__attribute__((target("avx2")))
+uint64_t csum_copy_avx2(unsigned char *dst, const unsigned char *src, size_t len, size_t *done)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *) (src + i + 32));
+        _mm256_storeu_si256((__m256i *) (dst + i), v0);
+        _mm256_storeu_si256((__m256i *) (dst + i + 32), v1);
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v0, zero));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v0, zero));
+        a2 = _mm256_add_epi64(a2, _mm256_unpacklo_epi32(v1, zero));
+        a3 = _mm256_add_epi64(a3, _mm256_unpackhi_epi32(v1, zero));
+    }
+    __m128i tail = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+        tail = _mm_add_epi64(tail, _mm_add_epi64(_mm_unpacklo_epi32(v, _mm_setzero_si128()),
+                                                 _mm_unpackhi_epi32(v, _mm_setzero_si128())));
+    }
+    *done = i;
+    return finish_avx2(a0, a1, a2, a3, tail);
+}
+
+#endif
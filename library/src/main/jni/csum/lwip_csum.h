@@ -0,0 +1,16 @@
+#ifndef PATH_LWIP_CSUM_H
+#define PATH_LWIP_CSUM_H
+
+/*
+ * Forced into every tun2socks translation unit with -include, ahead of lwipopts.h: lwIP's
+ * inet_chksum.c only falls back to its own loop when LWIP_CHKSUM is left undefined, and tcp_write()
+ * checksums while it copies into pbufs once LWIP_CHECKSUM_ON_COPY is on.
+ */
+
+#include "csum.h"
+
+#define LWIP_CHKSUM(dataptr, len) csum((dataptr), (size_t) (len))
+#define LWIP_CHECKSUM_ON_COPY 1
+#define LWIP_CHKSUM_COPY(dst, src, len) csum_copy((dst), (src), (size_t) (len))
+
+#endif
@@ -0,0 +1,11 @@
+#include "csum.h"
+
+/*
+ * Replaces traceroute/csum.c in the traceroute build, same contract: the Internet checksum of
+ * `ptr`, with 0 sent as 0xffff.
+ */
+uint16_t in_csum(const void *ptr, size_t len)
+{
+    uint16_t res = (uint16_t) ~csum(ptr, len);
+    return res != 0 ? res : 0xffff;
+}
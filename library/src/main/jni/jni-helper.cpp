@@ -2,14 +2,64 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <cmath>
 
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <sys/un.h>
 #include <ancillary.h>
+#include <netdb.h>
+#include <android/log.h>
+
+#include "aead_select.h"
+#include "probe.h"
+#include "supervisor.h"
 
 using namespace std;
 
+static const int MTR_CYCLES = 5;
+static const int MTR_INTERVAL_MILLIS = 100;
+static const int MTR_WAIT_MILLIS = 1000;
+
+#define LOG_TAG "jni-helper"
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+#define NATIVE_METHOD(name, signature) { #name, signature, reinterpret_cast<void*>(name) }
+
+#define PROBE_PACKAGE "network/path/mobilenode/library/data/runner/probe/"
+#define MTR_PACKAGE "network/path/mobilenode/library/data/runner/mtr/"
+
+// Everything below is resolved once in JNI_OnLoad, native calls never look up classes or members themselves
+static struct {
+    jclass ErrnoException;
+    jmethodID ErrnoExceptionCtor;
+    jclass UnknownHostException;
+    jclass String;
+} java;
+
+static struct {
+    jclass MtrSummary;
+    jmethodID MtrSummaryCtor;
+    jclass MtrResult;
+    jmethodID MtrResultCtor;
+} mtr;
+
+static struct {
+    jclass NativeTrace;
+    jmethodID NativeTraceCtor;
+    jfieldID protocol;
+    jfieldID host;
+    jfieldID port;
+    jfieldID payload;
+    jfieldID connectTimeoutMillis;
+    jfieldID readTimeoutMillis;
+    jfieldID timeoutMillis;
+    jfieldID maxResponseBytes;
+    jclass ProbeOutcome;
+    jmethodID ProbeOutcomeCtor;
+    jmethodID onProbeOutcome;
+} batch;
+
 // Based on: https://android.googlesource.com/platform/libcore/+/564c7e8/luni/src/main/native/libcore_io_Linux.cpp#256
 static void throwException(JNIEnv* env, jclass exceptionClass, jmethodID ctor2, const char* functionName, int error) {
     jstring detailMessage = env->NewStringUTF(functionName);
@@ -24,15 +74,104 @@ static void throwException(JNIEnv* env, jclass exceptionClass, jmethodID ctor2,
 
 static void throwErrnoException(JNIEnv* env, const char* functionName) {
     int error = errno;
-    static jclass ErrnoException = env->FindClass("android/system/ErrnoException");
-    static jmethodID ctor2 = env->GetMethodID(ErrnoException, "<init>", "(Ljava/lang/String;I)V");
-    throwException(env, ErrnoException, ctor2, functionName, error);
+    throwException(env, java.ErrnoException, java.ErrnoExceptionCtor, functionName, error);
+}
+
+static void throwUnknownHostException(JNIEnv* env, const char* host, int error) {
+    char message[256];
+    snprintf(message, sizeof(message), "%s: %s", host, gai_strerror(error));
+    env->ThrowNew(java.UnknownHostException, message);
+}
+
+static jclass findGlobalClass(JNIEnv* env, const char* name) {
+    jclass local = env->FindClass(name);
+    if (local == nullptr) {
+        LOGE("class %s not found", name);
+        return nullptr;
+    }
+    jclass global = reinterpret_cast<jclass>(env->NewGlobalRef(local));
+    env->DeleteLocalRef(local);
+    return global;
+}
+
+static jobject newMtrResult(JNIEnv* env, int ttl, const probe::TraceHop& hop, bool resolve) {
+    if (hop.addr.ss_family == AF_UNSPEC) {
+        jstring empty = env->NewStringUTF("");
+        jobject result = env->NewObject(mtr.MtrResult, mtr.MtrResultCtor, ttl, empty, empty, JNI_TRUE,
+                                        0.0, 0.0, 0.0, nullptr);
+        env->DeleteLocalRef(empty);
+        return result;
+    }
+
+    double sum = 0, min = NAN, max = NAN;
+    int received = 0;
+    for (double rtt : hop.rtts) {
+        if (isnan(rtt)) continue;
+        sum += rtt;
+        min = received == 0 ? rtt : fmin(min, rtt);
+        max = received == 0 ? rtt : fmax(max, rtt);
+        ++received;
+    }
+
+    string address = probe::formatAddress(hop.addr);
+    char name[NI_MAXHOST];
+    const char* host = address.c_str();
+    if (resolve && getnameinfo(reinterpret_cast<const sockaddr*>(&hop.addr), probe::addressLength(hop.addr),
+                               name, sizeof(name), nullptr, 0, NI_NAMEREQD) == 0) {
+        host = name;
+    }
+
+    jstring hostStr = env->NewStringUTF(host);
+    jstring ipStr = env->NewStringUTF(address.c_str());
+    jstring errStr = hop.error != 0 ? env->NewStringUTF(strerror(hop.error)) : nullptr;
+    jobject result = env->NewObject(mtr.MtrResult, mtr.MtrResultCtor, ttl, hostStr, ipStr, JNI_FALSE,
+                                    sum / received, min, max, errStr);
+    if (errStr != nullptr) env->DeleteLocalRef(errStr);
+    env->DeleteLocalRef(ipStr);
+    env->DeleteLocalRef(hostStr);
+    return result;
+}
+
+static void readBatchTarget(JNIEnv* env, jobject target, probe::BatchTarget* out) {
+    out->protocol = probe::Protocol(env->GetIntField(target, batch.protocol));
+    out->port = env->GetIntField(target, batch.port);
+    out->connectTimeoutMillis = env->GetIntField(target, batch.connectTimeoutMillis);
+    out->readTimeoutMillis = env->GetIntField(target, batch.readTimeoutMillis);
+    out->timeoutMillis = env->GetIntField(target, batch.timeoutMillis);
+    out->maxResponseBytes = size_t(max(env->GetIntField(target, batch.maxResponseBytes), 0));
+
+    jstring host = reinterpret_cast<jstring>(env->GetObjectField(target, batch.host));
+    const char* hostStr = env->GetStringUTFChars(host, 0);
+    out->host = hostStr;
+    env->ReleaseStringUTFChars(host, hostStr);
+    env->DeleteLocalRef(host);
+
+    out->payload.clear();
+    jbyteArray payload = reinterpret_cast<jbyteArray>(env->GetObjectField(target, batch.payload));
+    if (payload != nullptr) {
+        out->payload.resize(size_t(env->GetArrayLength(payload)));
+        env->GetByteArrayRegion(payload, 0, jsize(out->payload.size()), reinterpret_cast<jbyte*>(&out->payload[0]));
+        env->DeleteLocalRef(payload);
+    }
+}
+
+static jobject newProbeOutcome(JNIEnv* env, const probe::BatchOutcome& outcome) {
+    jbyteArray response = nullptr;
+    if (!outcome.response.empty()) {
+        response = env->NewByteArray(jsize(outcome.response.size()));
+        env->SetByteArrayRegion(response, 0, jsize(outcome.response.size()),
+                                reinterpret_cast<const jbyte*>(outcome.response.data()));
+    }
+    jobject result = env->NewObject(batch.ProbeOutcome, batch.ProbeOutcomeCtor, jint(outcome.status),
+                                    jint(outcome.error), jlong(outcome.resolveNanos), jlong(outcome.connectNanos),
+                                    jlong(outcome.handshakeNanos), jlong(outcome.firstByteNanos),
+                                    jlong(outcome.totalNanos), response);
+    if (response != nullptr) env->DeleteLocalRef(response);
+    return result;
 }
 
 #pragma clang diagnostic ignored "-Wunused-parameter"
-extern "C" {
-JNIEXPORT void JNICALL
-        Java_com_github_shadowsocks_JniHelper_sendFd(JNIEnv *env, jobject thiz, jint tun_fd, jstring path) {
+static void sendFd(JNIEnv *env, jobject thiz, jint tun_fd, jstring path) {
     int fd;
     struct sockaddr_un addr;
     const char *sock_str = env->GetStringUTFChars(path, 0);
@@ -60,21 +199,286 @@ quit2:
     return;
 }
 
-JNIEXPORT jbyteArray JNICALL
-Java_com_github_shadowsocks_JniHelper_parseNumericAddress(JNIEnv *env, jobject thiz, jstring str) {
-    const char *src = env->GetStringUTFChars(str, 0);
-    jbyte dst[max(sizeof(in_addr), sizeof(in6_addr))];
-    jbyteArray arr = nullptr;
-    if (inet_pton(AF_INET, src, dst) == 1) {
-        arr = env->NewByteArray(sizeof(in_addr));
-        env->SetByteArrayRegion(arr, 0, sizeof(in_addr), dst);
-    } else if (inet_pton(AF_INET6, src, dst) == 1) {
-        arr = env->NewByteArray(sizeof(in6_addr));
-        env->SetByteArrayRegion(arr, 0, sizeof(in6_addr), dst);
+static jstring preferredAeadMethod(JNIEnv *env, jobject thiz) {
+    return env->NewStringUTF(aead_preferred_method());
+}
+
+static jbyteArray parseNumericAddress(JNIEnv *env, jobject thiz, jstring str) {
+    // Region copies go straight into a stack buffer, unlike GetStringUTFChars, but are not NUL-terminated
+    char src[INET6_ADDRSTRLEN];
+    jsize length = env->GetStringUTFLength(str);
+    if (length >= jsize(sizeof(src))) return nullptr;
+    env->GetStringUTFRegion(str, 0, env->GetStringLength(str), src);
+    uint8_t dst[sizeof(in6_addr)];
+    jsize size;
+    switch (probe::parseNumericAddress(src, size_t(length), dst)) {
+        case AF_INET: size = sizeof(in_addr); break;
+        case AF_INET6: size = sizeof(in6_addr); break;
+        default: return nullptr;
     }
-    env->ReleaseStringUTFChars(str, src);
+    jbyteArray arr = env->NewByteArray(size);
+    env->SetByteArrayRegion(arr, 0, size, reinterpret_cast<jbyte*>(dst));
     return arr;
 }
+
+static jobject traceroute(JNIEnv *env, jobject thiz, jstring host, jint protocol, jint port, jint maxHops, jint queries, jint waitMillis, jint packetSize) {
+    const char *hostStr = env->GetStringUTFChars(host, 0);
+    sockaddr_storage target;
+    int err = probe::resolve(hostStr, &target);
+    if (err != 0) {
+        throwUnknownHostException(env, hostStr, err);
+        env->ReleaseStringUTFChars(host, hostStr);
+        return nullptr;
+    }
+    env->ReleaseStringUTFChars(host, hostStr);
+
+    probe::TraceOptions options;
+    options.protocol = probe::Protocol(protocol);
+    options.port = port;
+    options.maxHops = maxHops;
+    options.queries = queries;
+    options.waitMillis = waitMillis;
+    options.packetSize = packetSize;
+
+    probe::Trace trace;
+    if (probe::trace(target, options, &trace) == -1) {
+        throwErrnoException(env, "trace");
+        return nullptr;
+    }
+
+    jobjectArray hopIps = env->NewObjectArray(jsize(trace.hops.size()), java.String, nullptr);
+    jdoubleArray rtts = env->NewDoubleArray(jsize(trace.hops.size() * queries));
+    for (size_t i = 0; i < trace.hops.size(); ++i) {
+        const probe::TraceHop &hop = trace.hops[i];
+        if (hop.addr.ss_family != AF_UNSPEC) {
+            jstring ip = env->NewStringUTF(probe::formatAddress(hop.addr).c_str());
+            env->SetObjectArrayElement(hopIps, jsize(i), ip);
+            env->DeleteLocalRef(ip);
+        }
+        env->SetDoubleArrayRegion(rtts, jsize(i * queries), queries, hop.rtts.data());
+    }
+
+    jstring targetIp = env->NewStringUTF(probe::formatAddress(target).c_str());
+    jobject result = env->NewObject(batch.NativeTrace, batch.NativeTraceCtor, targetIp, jint(trace.protocol), maxHops,
+                                    packetSize, queries, hopIps, rtts);
+    env->DeleteLocalRef(targetIp);
+    env->DeleteLocalRef(rtts);
+    env->DeleteLocalRef(hopIps);
+    return result;
+}
+
+static jobject trace(JNIEnv *env, jobject thiz, jstring server, jint port, jboolean resolve, jint maxHops, jint packetSize) {
+    const char *serverStr = env->GetStringUTFChars(server, 0);
+    sockaddr_storage target;
+    int err = probe::resolve(serverStr, &target);
+    if (err != 0) {
+        throwUnknownHostException(env, serverStr, err);
+        env->ReleaseStringUTFChars(server, serverStr);
+        return nullptr;
+    }
+    env->ReleaseStringUTFChars(server, serverStr);
+
+    // Same as mtr: ICMP echo by default, UDP to a fixed port when one is given
+    probe::TraceOptions options;
+    options.protocol = port > 0 ? probe::PROTOCOL_UDP : probe::PROTOCOL_ICMP;
+    options.port = port;
+    options.fixedPort = true;
+    options.maxHops = maxHops;
+    options.queries = MTR_CYCLES;
+    options.intervalMillis = MTR_INTERVAL_MILLIS;
+    options.waitMillis = MTR_WAIT_MILLIS;
+    options.packetSize = packetSize;
+
+    probe::Trace trace;
+    if (probe::trace(target, options, &trace) == -1) {
+        throwErrnoException(env, "trace");
+        return nullptr;
+    }
+
+    jobjectArray hops = env->NewObjectArray(jsize(trace.hops.size()), mtr.MtrResult, nullptr);
+    for (size_t i = 0; i < trace.hops.size(); ++i) {
+        jobject hop = newMtrResult(env, int(i + 1), trace.hops[i], resolve == JNI_TRUE);
+        env->SetObjectArrayElement(hops, jsize(i), hop);
+        env->DeleteLocalRef(hop);
+    }
+
+    jstring targetIp = env->NewStringUTF(probe::formatAddress(target).c_str());
+    jobject summary = env->NewObject(mtr.MtrSummary, mtr.MtrSummaryCtor, hops, server, targetIp, maxHops, packetSize);
+    env->DeleteLocalRef(targetIp);
+    env->DeleteLocalRef(hops);
+    return summary;
+}
+
+static probe::BatchLoop* toBatchLoop(jlong loop) {
+    return reinterpret_cast<probe::BatchLoop*>(static_cast<intptr_t>(loop));
+}
+
+static jlong newBatchLoop(JNIEnv *env, jobject thiz) {
+    probe::BatchLoop* loop = probe::newBatchLoop();
+    if (loop == nullptr) {
+        throwErrnoException(env, "newBatchLoop");
+        return 0;
+    }
+    return static_cast<jlong>(reinterpret_cast<intptr_t>(loop));
+}
+
+static jboolean submitProbe(JNIEnv *env, jobject thiz, jlong loop, jint id, jobject target) {
+    probe::BatchTarget batchTarget;
+    readBatchTarget(env, target, &batchTarget);
+    // Through uint32_t so that ids past Int.MAX_VALUE never collide with the loop's own wakeup id
+    return jboolean(probe::submitBatch(toBatchLoop(loop), uint32_t(id), batchTarget));
+}
+
+static void runBatchLoop(JNIEnv *env, jobject thiz, jlong loop, jobject batcher) {
+    int result = probe::runBatchLoop(toBatchLoop(loop), [env, batcher](uint64_t id, probe::BatchOutcome& outcome) {
+        jobject probeOutcome = newProbeOutcome(env, outcome);
+        if (probeOutcome != nullptr) {
+            env->CallVoidMethod(batcher, batch.onProbeOutcome, jint(id), probeOutcome);
+            env->DeleteLocalRef(probeOutcome);
+        }
+        if (env->ExceptionCheck()) {
+            // Nothing can be thrown across the loop, the batcher completes the job as failed on its own
+            LOGE("onProbeOutcome(%u) threw", unsigned(id));
+            env->ExceptionClear();
+        }
+    });
+    if (result == -1) throwErrnoException(env, "runBatchLoop");
+}
+
+static void stopBatchLoop(JNIEnv *env, jobject thiz, jlong loop) {
+    probe::stopBatchLoop(toBatchLoop(loop));
+}
+
+static void freeBatchLoop(JNIEnv *env, jobject thiz, jlong loop) {
+    probe::freeBatchLoop(toBatchLoop(loop));
+}
+
+static jint startProcess(JNIEnv *env, jobject thiz, jobjectArray cmd, jstring tag) {
+    jsize count = env->GetArrayLength(cmd);
+    vector<string> argv;
+    argv.reserve(size_t(count));
+    for (jsize i = 0; i < count; ++i) {
+        auto arg = static_cast<jstring>(env->GetObjectArrayElement(cmd, i));
+        const char *str = env->GetStringUTFChars(arg, 0);
+        argv.emplace_back(str);
+        env->ReleaseStringUTFChars(arg, str);
+        env->DeleteLocalRef(arg);
+    }
+    const char *tagStr = env->GetStringUTFChars(tag, 0);
+    int handle = supervisor::start(argv, tagStr);
+    env->ReleaseStringUTFChars(tag, tagStr);
+    if (handle == -1) throwErrnoException(env, "execv");
+    return handle;
+}
+
+static void stopProcesses(JNIEnv *env, jobject thiz, jintArray handles, jint graceMillis) {
+    vector<int> ids(size_t(env->GetArrayLength(handles)));
+    if (ids.empty()) return;
+    env->GetIntArrayRegion(handles, 0, jsize(ids.size()), reinterpret_cast<jint*>(ids.data()));
+    supervisor::stop(ids, graceMillis);
+}
+
+static jintArray processStatus(JNIEnv *env, jobject thiz, jint handle) {
+    supervisor::Status status;
+    if (!supervisor::status(handle, &status)) return nullptr;
+    jint fields[] = { status.state, status.pid, status.restarts, status.exitCode, jint(status.events) };
+    jintArray result = env->NewIntArray(5);
+    if (result != nullptr) env->SetIntArrayRegion(result, 0, 5, fields);
+    return result;
+}
+
+static jboolean awaitProcess(JNIEnv *env, jobject thiz, jint handle, jint events, jint timeoutMillis) {
+    return jboolean(supervisor::await(handle, unsigned(events), timeoutMillis));
+}
+
+static const JNINativeMethod jniHelperMethods[] = {
+    NATIVE_METHOD(sendFd, "(ILjava/lang/String;)V"),
+    NATIVE_METHOD(parseNumericAddress, "(Ljava/lang/String;)[B"),
+    NATIVE_METHOD(preferredAeadMethod, "()Ljava/lang/String;"),
+    NATIVE_METHOD(startProcess, "([Ljava/lang/String;Ljava/lang/String;)I"),
+    NATIVE_METHOD(stopProcesses, "([II)V"),
+    NATIVE_METHOD(processStatus, "(I)[I"),
+    NATIVE_METHOD(awaitProcess, "(III)Z"),
+};
+
+static const JNINativeMethod nativeProbeMethods[] = {
+    NATIVE_METHOD(traceroute, "(Ljava/lang/String;IIIIII)L" PROBE_PACKAGE "NativeTrace;"),
+    NATIVE_METHOD(newBatchLoop, "()J"),
+    NATIVE_METHOD(submitProbe, "(JIL" PROBE_PACKAGE "ProbeTarget;)Z"),
+    NATIVE_METHOD(runBatchLoop, "(JL" PROBE_PACKAGE "ProbeBatcher;)V"),
+    NATIVE_METHOD(stopBatchLoop, "(J)V"),
+    NATIVE_METHOD(freeBatchLoop, "(J)V"),
+};
+
+static const JNINativeMethod mtrMethods[] = {
+    NATIVE_METHOD(trace, "(Ljava/lang/String;IZII)L" MTR_PACKAGE "MtrSummary;"),
+};
+
+static bool registerNatives(JNIEnv* env, const char* className, const JNINativeMethod* methods, size_t count) {
+    jclass clazz = env->FindClass(className);
+    if (clazz == nullptr) {
+        LOGE("class %s not found", className);
+        return false;
+    }
+    bool registered = env->RegisterNatives(clazz, methods, jint(count)) == JNI_OK;
+    if (!registered) LOGE("RegisterNatives failed for %s", className);
+    env->DeleteLocalRef(clazz);
+    return registered;
+}
+
+#define REGISTER_NATIVES(env, className, methods) \
+        registerNatives(env, className, methods, sizeof(methods) / sizeof(methods[0]))
+
+static bool cacheJavaClasses(JNIEnv* env) {
+    java.ErrnoException = findGlobalClass(env, "android/system/ErrnoException");
+    java.UnknownHostException = findGlobalClass(env, "java/net/UnknownHostException");
+    java.String = findGlobalClass(env, "java/lang/String");
+    if (java.ErrnoException == nullptr || java.UnknownHostException == nullptr || java.String == nullptr) return false;
+    java.ErrnoExceptionCtor = env->GetMethodID(java.ErrnoException, "<init>", "(Ljava/lang/String;I)V");
+    return java.ErrnoExceptionCtor != nullptr;
+}
+
+static bool cacheMtrClasses(JNIEnv* env) {
+    mtr.MtrSummary = findGlobalClass(env, MTR_PACKAGE "MtrSummary");
+    mtr.MtrResult = findGlobalClass(env, MTR_PACKAGE "MtrResult");
+    if (mtr.MtrSummary == nullptr || mtr.MtrResult == nullptr) return false;
+    mtr.MtrSummaryCtor = env->GetMethodID(mtr.MtrSummary, "<init>",
+            "([L" MTR_PACKAGE "MtrResult;Ljava/lang/String;Ljava/lang/String;II)V");
+    mtr.MtrResultCtor = env->GetMethodID(mtr.MtrResult, "<init>",
+            "(ILjava/lang/String;Ljava/lang/String;ZDDDLjava/lang/String;)V");
+    return mtr.MtrSummaryCtor != nullptr && mtr.MtrResultCtor != nullptr;
+}
+
+static bool cacheProbeClasses(JNIEnv* env) {
+    batch.NativeTrace = findGlobalClass(env, PROBE_PACKAGE "NativeTrace");
+    if (batch.NativeTrace == nullptr) return false;
+    batch.NativeTraceCtor = env->GetMethodID(batch.NativeTrace, "<init>",
+            "(Ljava/lang/String;IIII[Ljava/lang/String;[D)V");
+    if (batch.NativeTraceCtor == nullptr) return false;
+
+    jclass ProbeTarget = env->FindClass(PROBE_PACKAGE "ProbeTarget");
+    if (ProbeTarget == nullptr) return false;
+    batch.protocol = env->GetFieldID(ProbeTarget, "protocol", "I");
+    batch.host = env->GetFieldID(ProbeTarget, "host", "Ljava/lang/String;");
+    batch.port = env->GetFieldID(ProbeTarget, "port", "I");
+    batch.payload = env->GetFieldID(ProbeTarget, "payload", "[B");
+    batch.connectTimeoutMillis = env->GetFieldID(ProbeTarget, "connectTimeoutMillis", "I");
+    batch.readTimeoutMillis = env->GetFieldID(ProbeTarget, "readTimeoutMillis", "I");
+    batch.timeoutMillis = env->GetFieldID(ProbeTarget, "timeoutMillis", "I");
+    batch.maxResponseBytes = env->GetFieldID(ProbeTarget, "maxResponseBytes", "I");
+    env->DeleteLocalRef(ProbeTarget);
+    if (env->ExceptionCheck()) return false;
+
+    batch.ProbeOutcome = findGlobalClass(env, PROBE_PACKAGE "ProbeOutcome");
+    if (batch.ProbeOutcome == nullptr) return false;
+    batch.ProbeOutcomeCtor = env->GetMethodID(batch.ProbeOutcome, "<init>", "(IIJJJJJ[B)V");
+    if (batch.ProbeOutcomeCtor == nullptr) return false;
+
+    jclass ProbeBatcher = env->FindClass(PROBE_PACKAGE "ProbeBatcher");
+    if (ProbeBatcher == nullptr) return false;
+    batch.onProbeOutcome = env->GetMethodID(ProbeBatcher, "onProbeOutcome", "(IL" PROBE_PACKAGE "ProbeOutcome;)V");
+    env->DeleteLocalRef(ProbeBatcher);
+    return batch.onProbeOutcome != nullptr;
 }
 
 /*
@@ -82,5 +486,14 @@ Java_com_github_shadowsocks_JniHelper_parseNumericAddress(JNIEnv *env, jobject t
  */
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
 jint JNI_OnLoad(JavaVM* vm, void* reserved) {
+    JNIEnv* env;
+    if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) return JNI_ERR;
+
+    if (!cacheJavaClasses(env) || !cacheMtrClasses(env) || !cacheProbeClasses(env)) return JNI_ERR;
+
+    if (!REGISTER_NATIVES(env, "network/path/mobilenode/library/utils/JniHelper", jniHelperMethods) ||
+        !REGISTER_NATIVES(env, PROBE_PACKAGE "NativeProbe", nativeProbeMethods) ||
+        !REGISTER_NATIVES(env, MTR_PACKAGE "Mtr", mtrMethods)) return JNI_ERR;
+
     return JNI_VERSION_1_6;
 }
@@ -0,0 +1,12 @@
+#include <stdlib.h>
+
+#include "obfs_transport.h"
+
+int __real_main(int argc, char **argv);
+
+/* Runs before ss-local's own main(), see obfs_transport.h */
+int __wrap_main(int argc, char **argv)
+{
+    if (obfs_transport_setup(&argc, argv) == -1) return EXIT_FAILURE;
+    return __real_main(argc, argv);
+}
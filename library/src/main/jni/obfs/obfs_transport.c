@@ -0,0 +1,344 @@
+#include "obfs_transport.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <android/log.h>
+
+#define LOG_TAG "obfs-transport"
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+#define MAX_SERVER_ADDRS 16
+#define MAX_RESPONSE_HEADER 4096
+#define KEY_SIZE 16
+
+/* Same request as obfs-local's obfs_http.c, the server side checks for it */
+static const char *const http_request_template =
+    "GET / HTTP/1.1\r\n"
+    "Host: %s\r\n"
+    "User-Agent: curl/7.%d.%d\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: %s\r\n"
+    "Content-Length: %zu\r\n"
+    "\r\n";
+
+int __real_connect(int fd, const struct sockaddr *addr, socklen_t len);
+ssize_t __real_send(int fd, const void *buf, size_t len, int flags);
+ssize_t __real_recv(int fd, void *buf, size_t len, int flags);
+int __real_close(int fd);
+int __real_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints,
+                       struct addrinfo **res);
+
+struct obfs_conn {
+    int request_sent;       /* upgrade request and the payload it announces fully written */
+    char *request;          /* upgrade request followed by a copy of the first payload, built on the first send */
+    size_t header_len;      /* bytes of `request` that belong to the upgrade request itself */
+    size_t request_len;
+    size_t request_off;
+    int response_done;      /* upgrade response fully stripped */
+    char *in;               /* response bytes read so far, then whatever followed the header */
+    size_t in_len;
+    size_t in_off;
+};
+
+static struct {
+    int enabled;
+    char host[NI_MAXHOST + 8];  /* Host header, with the port unless it is 80 */
+    const char *server;         /* -s as given to ss-local */
+    struct sockaddr_storage addrs[MAX_SERVER_ADDRS];
+    size_t n_addrs;
+} config;
+
+/* ss-local runs a single event loop thread, so the table needs no locking */
+static struct obfs_conn **conns;
+static size_t n_conns;
+
+static struct obfs_conn *find_conn(int fd)
+{
+    return fd >= 0 && (size_t) fd < n_conns ? conns[fd] : NULL;
+}
+
+static void free_conn(int fd)
+{
+    struct obfs_conn *conn = find_conn(fd);
+    if (conn == NULL) return;
+    free(conn->request);
+    free(conn->in);
+    free(conn);
+    conns[fd] = NULL;
+}
+
+static struct obfs_conn *add_conn(int fd)
+{
+    if ((size_t) fd >= n_conns) {
+        size_t size = n_conns == 0 ? 64 : n_conns;
+        while (size <= (size_t) fd) size *= 2;
+        struct obfs_conn **grown = realloc(conns, size * sizeof(*conns));
+        if (grown == NULL) return NULL;
+        memset(grown + n_conns, 0, (size - n_conns) * sizeof(*conns));
+        conns = grown;
+        n_conns = size;
+    }
+    free_conn(fd);
+    conns[fd] = calloc(1, sizeof(struct obfs_conn));
+    return conns[fd];
+}
+
+static void add_server_addr(const struct sockaddr *addr, socklen_t len)
+{
+    if (config.n_addrs == MAX_SERVER_ADDRS || len > sizeof(struct sockaddr_storage)) return;
+    memset(&config.addrs[config.n_addrs], 0, sizeof(struct sockaddr_storage));
+    memcpy(&config.addrs[config.n_addrs++], addr, len);
+}
+
+static int is_server_addr(const struct sockaddr *addr)
+{
+    for (size_t i = 0; i < config.n_addrs; ++i) {
+        const struct sockaddr *server = (const struct sockaddr *) &config.addrs[i];
+        if (server->sa_family != addr->sa_family) continue;
+        if (addr->sa_family == AF_INET) {
+            const struct sockaddr_in *a = (const struct sockaddr_in *) addr, *b = (const struct sockaddr_in *) server;
+            if (a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr) return 1;
+        } else if (addr->sa_family == AF_INET6) {
+            const struct sockaddr_in6 *a = (const struct sockaddr_in6 *) addr, *b = (const struct sockaddr_in6 *) server;
+            if (a->sin6_port == b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr)) == 0)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static void base64_encode(const unsigned char *src, size_t len, char *dst)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i;
+    for (i = 0; i + 2 < len; i += 3) {
+        *dst++ = alphabet[src[i] >> 2];
+        *dst++ = alphabet[((src[i] & 0x03) << 4) | (src[i + 1] >> 4)];
+        *dst++ = alphabet[((src[i + 1] & 0x0f) << 2) | (src[i + 2] >> 6)];
+        *dst++ = alphabet[src[i + 2] & 0x3f];
+    }
+    if (i < len) {
+        *dst++ = alphabet[src[i] >> 2];
+        if (i + 1 < len) {
+            *dst++ = alphabet[((src[i] & 0x03) << 4) | (src[i + 1] >> 4)];
+            *dst++ = alphabet[(src[i + 1] & 0x0f) << 2];
+        } else {
+            *dst++ = alphabet[(src[i] & 0x03) << 4];
+            *dst++ = '=';
+        }
+        *dst++ = '=';
+    }
+    *dst = '\0';
+}
+
+// Content-Length announces exactly the payload of this first send, which is why it is copied behind the header
+static int build_request(struct obfs_conn *conn, const void *payload, size_t payload_len)
+{
+    unsigned char key[KEY_SIZE];
+    char encoded_key[(KEY_SIZE + 2) / 3 * 4 + 1];
+    arc4random_buf(key, sizeof(key));
+    base64_encode(key, sizeof(key), encoded_key);
+
+    int major = (int) arc4random_uniform(51), minor = (int) arc4random_uniform(2);
+    int len = snprintf(NULL, 0, http_request_template, config.host, major, minor, encoded_key, payload_len);
+    conn->request = malloc((size_t) len + 1 + payload_len);
+    if (conn->request == NULL) return -1;
+    snprintf(conn->request, (size_t) len + 1, http_request_template, config.host, major, minor, encoded_key,
+             payload_len);
+    memcpy(conn->request + len, payload, payload_len);
+    conn->header_len = (size_t) len;
+    conn->request_len = (size_t) len + payload_len;
+    return 0;
+}
+
+static const char *find_header_end(const char *data, size_t len)
+{
+    for (size_t i = 3; i < len; ++i) {
+        if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r')
+            return data + i + 1;
+    }
+    return NULL;
+}
+
+int obfs_transport_setup(int *argc, char **argv)
+{
+    for (size_t fd = 0; fd < n_conns; ++fd) free_conn((int) fd);
+    free(conns);
+    conns = NULL;
+    n_conns = 0;
+    memset(&config, 0, sizeof(config));
+
+    // Any other plugin is left to ss-local, which runs it as usual
+    const char *plugin = NULL, *plugin_opts = NULL, *port = NULL;
+    for (int i = 0; i + 1 < *argc; ++i) {
+        if (strcmp(argv[i], "--plugin") == 0) plugin = argv[i + 1];
+    }
+    if (plugin == NULL || strcmp(plugin, "obfs-local") != 0) return 0;
+
+    int kept = 0;
+    for (int i = 0; i < *argc; ++i) {
+        if (i + 1 < *argc && strcmp(argv[i], "--plugin") == 0) {
+            ++i;
+            continue;
+        }
+        if (i + 1 < *argc && strcmp(argv[i], "--plugin-opts") == 0) {
+            plugin_opts = argv[++i];
+            continue;
+        }
+        if (i + 1 < *argc && strcmp(argv[i], "-s") == 0) config.server = argv[i + 1];
+        if (i + 1 < *argc && strcmp(argv[i], "-p") == 0) port = argv[i + 1];
+        argv[kept++] = argv[i];
+    }
+    argv[kept] = NULL;
+    *argc = kept;
+
+    if (config.server == NULL || port == NULL) {
+        LOGE("obfs-local needs -s and -p");
+        return -1;
+    }
+
+    const char *host = config.server;
+    char opts[256];
+    strncpy(opts, plugin_opts != NULL ? plugin_opts : "", sizeof(opts) - 1);
+    opts[sizeof(opts) - 1] = '\0';
+    char *save = NULL;
+    for (char *opt = strtok_r(opts, ";", &save); opt != NULL; opt = strtok_r(NULL, ";", &save)) {
+        if (strncmp(opt, "obfs=", 5) == 0 && strcmp(opt + 5, "http") != 0) {
+            // TLS mode frames every record and cannot be applied as a one-off prefix
+            LOGE("unsupported obfs mode %s", opt + 5);
+            return -1;
+        }
+        if (strncmp(opt, "obfs-host=", 10) == 0) host = opt + 10;
+    }
+    if (strcmp(port, "80") == 0) snprintf(config.host, sizeof(config.host), "%s", host);
+    else snprintf(config.host, sizeof(config.host), "%s:%s", host, port);
+
+    // Numeric servers never go through getaddrinfo() in ss-local
+    struct sockaddr_in v4;
+    struct sockaddr_in6 v6;
+    memset(&v4, 0, sizeof(v4));
+    memset(&v6, 0, sizeof(v6));
+    if (inet_pton(AF_INET, config.server, &v4.sin_addr) == 1) {
+        v4.sin_family = AF_INET;
+        v4.sin_port = htons((uint16_t) atoi(port));
+        add_server_addr((struct sockaddr *) &v4, sizeof(v4));
+    } else if (inet_pton(AF_INET6, config.server, &v6.sin6_addr) == 1) {
+        v6.sin6_family = AF_INET6;
+        v6.sin6_port = htons((uint16_t) atoi(port));
+        add_server_addr((struct sockaddr *) &v6, sizeof(v6));
+    }
+    config.enabled = 1;
+    return 0;
+}
+
+int __wrap_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res)
+{
+    int ret = __real_getaddrinfo(node, service, hints, res);
+    if (ret == 0 && config.enabled && node != NULL && strcmp(node, config.server) == 0) {
+        for (struct addrinfo *ai = *res; ai != NULL; ai = ai->ai_next) add_server_addr(ai->ai_addr, ai->ai_addrlen);
+    }
+    return ret;
+}
+
+int __wrap_connect(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    int ret = __real_connect(fd, addr, len);
+    if (config.enabled && (ret == 0 || errno == EINPROGRESS) && is_server_addr(addr)) {
+        int error = errno;
+        if (add_conn(fd) == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        errno = error;
+    }
+    return ret;
+}
+
+ssize_t __wrap_send(int fd, const void *buf, size_t len, int flags)
+{
+    struct obfs_conn *conn = find_conn(fd);
+    if (conn == NULL || conn->request_sent) return __real_send(fd, buf, len, flags);
+
+    if (conn->request == NULL && build_request(conn, buf, len) == -1) {
+        errno = ENOMEM;
+        return -1;
+    }
+    // The caller retries with the payload bytes not reported as sent yet, which are the ones left in `request`.
+    // Never flush more of them than it offers now, the return value could not account for them otherwise.
+    size_t header_left = conn->request_off < conn->header_len ? conn->header_len - conn->request_off : 0;
+    size_t payload_left = conn->request_len - conn->request_off - header_left;
+    size_t chunk = header_left + (len < payload_left ? len : payload_left);
+    ssize_t n = __real_send(fd, conn->request + conn->request_off, chunk, flags);
+    if (n == -1) return -1;
+    conn->request_off += (size_t) n;
+    if (conn->request_off == conn->request_len) {
+        free(conn->request);
+        conn->request = NULL;
+        conn->request_sent = 1;
+    }
+    if ((size_t) n <= header_left) {
+        // None of the caller's bytes are out yet, it will retry once the socket is writable
+        errno = EAGAIN;
+        return -1;
+    }
+    return n - (ssize_t) header_left;
+}
+
+ssize_t __wrap_recv(int fd, void *buf, size_t len, int flags)
+{
+    struct obfs_conn *conn = find_conn(fd);
+    if (conn == NULL || (conn->response_done && conn->in == NULL)) return __real_recv(fd, buf, len, flags);
+
+    if (!conn->response_done) {
+        // Never read more than the caller can take, so whatever follows the header fits in one go
+        char *grown = realloc(conn->in, conn->in_len + len);
+        if (grown == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        conn->in = grown;
+        ssize_t n = __real_recv(fd, conn->in + conn->in_len, len, flags);
+        if (n <= 0) return n;
+        size_t scanned = conn->in_len > 3 ? conn->in_len - 3 : 0;
+        conn->in_len += (size_t) n;
+
+        const char *end = find_header_end(conn->in + scanned, conn->in_len - scanned);
+        if (end == NULL) {
+            if (conn->in_len > MAX_RESPONSE_HEADER || (conn->in_len >= 7 && strncmp(conn->in, "HTTP/1.", 7) != 0)) {
+                errno = EPROTO;
+                return -1;
+            }
+            errno = EAGAIN;
+            return -1;
+        }
+        conn->response_done = 1;
+        conn->in_off = (size_t) (end - conn->in);
+    }
+
+    size_t available = conn->in_len - conn->in_off;
+    size_t copied = available < len ? available : len;
+    memcpy(buf, conn->in + conn->in_off, copied);
+    conn->in_off += copied;
+    if (conn->in_off == conn->in_len) {
+        free(conn->in);
+        conn->in = NULL;
+    }
+    if (copied == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return (ssize_t) copied;
+}
+
+int __wrap_close(int fd)
+{
+    free_conn(fd);
+    return __real_close(fd);
+}
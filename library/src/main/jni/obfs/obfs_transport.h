@@ -0,0 +1,37 @@
+#ifndef PATH_OBFS_TRANSPORT_H
+#define PATH_OBFS_TRANSPORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * simple-obfs HTTP obfuscation fused into ss-local.
+ *
+ * ss-local is linked with -Wl,--wrap for main, connect, send, recv, close and getaddrinfo. Sockets
+ * it connects to the addresses its server name resolved to get the obfs-local HTTP framing applied
+ * in-line: the first request is prefixed with a websocket upgrade request and the upgrade
+ * response is stripped from the first reply. Everything after that passes through untouched, just
+ * like with obfs-local, so no loopback hop and no second process are needed.
+ *
+ * Only obfs=http can be fused this way. obfs=tls frames every record, the app runs the obfs-local
+ * executable in front of ss-local for it.
+ */
+
+/*
+ * Takes the SIP003 plugin options meant for obfs-local out of ss-local's command line:
+ *
+ *   --plugin obfs-local --plugin-opts "obfs=http;obfs-host=example.com"
+ *
+ * and enables the transport for the server given with -s/-p. Without them the transport stays
+ * disabled, and any other plugin is left on the command line for ss-local to run. Starts from
+ * scratch on every call. Returns 0, or -1 if the options ask for something that is not supported
+ * here. obfs_main.c calls it before ss-local's own main() sees its arguments.
+ */
+int obfs_transport_setup(int *argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#include "probe.h"
+
+#include <cstring>
+
+#include <arpa/inet.h>
+
+namespace probe {
+
+// Strict dotted quad, same acceptance as inet_pton(AF_INET): four decimal octets, no leading zeros.
+static bool parseIpv4(const char *str, size_t length, uint8_t *dst) {
+    const char *end = str + length;
+    int octets = 0;
+    while (octets < 4) {
+        if (str == end || *str < '0' || *str > '9') return false;
+        unsigned value = 0;
+        const char *start = str;
+        while (str != end && *str >= '0' && *str <= '9') {
+            if (str - start == 3) return false;
+            value = value * 10 + unsigned(*str++ - '0');
+        }
+        if (value > 255 || (*start == '0' && str - start > 1)) return false;
+        dst[octets++] = uint8_t(value);
+        if (octets < 4) {
+            if (str == end || *str != '.') return false;
+            ++str;
+        }
+    }
+    return str == end;
+}
+
+int parseNumericAddress(const char *str, size_t length, uint8_t *dst) {
+    if (parseIpv4(str, length, dst)) return AF_INET;
+    // Anything that is not a plain dotted quad goes through the libc parser
+    char buf[INET6_ADDRSTRLEN];
+    if (length == 0 || length >= sizeof(buf) || memchr(str, ':', length) == nullptr) return AF_UNSPEC;
+    memcpy(buf, str, length);
+    buf[length] = '\0';
+    return inet_pton(AF_INET6, buf, dst) == 1 ? AF_INET6 : AF_UNSPEC;
+}
+
+}
@@ -0,0 +1,442 @@
+#include "probe.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace probe {
+
+static const int MAX_EVENTS = 64;
+static const size_t READ_CHUNK_SIZE = 4096;
+static const int MAX_RESOLVERS = 4;
+static const uint64_t WAKE_ID = UINT64_MAX;    // epoll data of the eventfd, job ids never get this high
+
+enum State {
+    STATE_RESOLVING,
+    STATE_CONNECTING,
+    STATE_WRITING,
+    STATE_READING,
+    STATE_DONE,
+};
+
+struct Job {
+    BatchTarget target;
+    BatchOutcome outcome;
+    int fd;
+    State state;
+    int64_t startNanos;
+    int64_t stepDeadlineNanos;  // connect timeout, then idle timeout between reads
+    int64_t deadlineNanos;      // whole job, counted from submission
+    size_t written;
+};
+
+struct Submission {
+    uint64_t id;
+    BatchTarget target;
+    int64_t submitNanos;
+};
+
+struct Lookup {
+    uint64_t id;
+    std::string host;
+    int error;
+    sockaddr_storage addr;
+    int64_t resolveNanos;
+};
+
+// What submitting threads and resolver threads hand over to the loop, guarded by `mutex`. Resolvers hold
+// a reference of their own, so a lookup that outlives the loop still has somewhere to land.
+struct Shared {
+    std::mutex mutex;
+    int wakefd = -1;
+    bool stopping = false;
+    int resolvers = 0;
+    std::deque<Submission> submitted;
+    std::deque<Lookup> lookups;
+    std::deque<Lookup> resolved;
+
+    ~Shared() {
+        if (wakefd != -1) close(wakefd);
+    }
+};
+
+struct BatchLoop {
+    std::shared_ptr<Shared> shared;
+    int epfd;
+    std::map<uint64_t, Job> jobs;   // only touched by the thread in runBatchLoop()
+};
+
+static int64_t millisToNanos(int millis) {
+    return int64_t(millis) * 1000000LL;
+}
+
+static void wake(const Shared &shared) {
+    uint64_t one = 1;
+    if (write(shared.wakefd, &one, sizeof(one)) == -1) {
+        // Only EAGAIN, the loop has not drained the previous wakeups yet
+    }
+}
+
+static void finish(Job &job, Status status, int error) {
+    job.outcome.status = status;
+    job.outcome.error = error;
+    job.outcome.totalNanos = nowNanos() - job.startNanos;
+    if (job.fd != -1) close(job.fd);    // also drops it from the epoll set
+    job.fd = -1;
+    job.state = STATE_DONE;
+}
+
+static int watch(int epfd, int op, const Job &job, uint64_t id) {
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = job.state == STATE_READING ? uint32_t(EPOLLIN) : uint32_t(EPOLLOUT);
+    event.data.u64 = id;
+    return epoll_ctl(epfd, op, job.fd, &event);
+}
+
+static void *resolver(void *arg) {
+    std::shared_ptr<Shared> shared(std::move(*static_cast<std::shared_ptr<Shared> *>(arg)));
+    delete static_cast<std::shared_ptr<Shared> *>(arg);
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    while (!shared->stopping && !shared->lookups.empty()) {
+        Lookup lookup = std::move(shared->lookups.front());
+        shared->lookups.pop_front();
+        lock.unlock();
+        int64_t start = nowNanos();
+        lookup.error = resolve(lookup.host.c_str(), &lookup.addr);
+        lookup.resolveNanos = nowNanos() - start;
+        lock.lock();
+        shared->resolved.push_back(std::move(lookup));
+        wake(*shared);
+    }
+    --shared->resolvers;
+    return nullptr;
+}
+
+// Queues a host name for the resolver threads, starting another one while fewer than MAX_RESOLVERS run.
+// Returns 0 or the pthread_create() error if no resolver is around to pick the name up.
+static int lookUp(const std::shared_ptr<Shared> &shared, uint64_t id, const std::string &host) {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    shared->lookups.push_back(Lookup{id, host, 0, sockaddr_storage(), 0});
+    if (shared->resolvers >= MAX_RESOLVERS) return 0;
+
+    auto arg = new std::shared_ptr<Shared>(shared);
+    pthread_t thread;
+    int err = pthread_create(&thread, nullptr, resolver, arg);
+    if (err == 0) {
+        pthread_detach(thread);
+        ++shared->resolvers;
+        return 0;
+    }
+    delete arg;
+    if (shared->resolvers > 0) return 0;
+    shared->lookups.pop_back();
+    return err;
+}
+
+// Opens the socket for a resolved target and fires the datagram or starts connecting.
+static void begin(BatchLoop *loop, uint64_t id, Job &job, const sockaddr_storage &resolved) {
+    sockaddr_storage addr = resolved;
+    setPort(&addr, job.target.port);
+
+    int type = job.target.protocol == PROTOCOL_TCP ? SOCK_STREAM : SOCK_DGRAM;
+    job.fd = socket(addr.ss_family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (job.fd == -1) {
+        finish(job, STATUS_ERROR, errno);
+        return;
+    }
+
+    if (job.target.protocol != PROTOCOL_TCP) {
+        job.startNanos = nowNanos();
+        if (sendto(job.fd, job.target.payload.data(), job.target.payload.size(), 0,
+                   reinterpret_cast<sockaddr *>(&addr), addressLength(addr)) == -1) {
+            finish(job, STATUS_ERROR, errno);
+        } else {
+            job.outcome.connectNanos = nowNanos() - job.startNanos;
+            finish(job, STATUS_OK, 0);
+        }
+        return;
+    }
+
+    job.state = STATE_CONNECTING;
+    job.startNanos = nowNanos();
+    job.stepDeadlineNanos = job.startNanos + millisToNanos(job.target.connectTimeoutMillis);
+    if (connect(job.fd, reinterpret_cast<sockaddr *>(&addr), addressLength(addr)) == -1 && errno != EINPROGRESS) {
+        finish(job, STATUS_ERROR, errno);
+        return;
+    }
+    if (watch(loop->epfd, EPOLL_CTL_ADD, job, id) == -1) finish(job, STATUS_ERROR, errno);
+}
+
+static void resolved(BatchLoop *loop, uint64_t id, Job &job, int error, const sockaddr_storage &addr,
+                     int64_t resolveNanos) {
+    job.outcome.resolveNanos = resolveNanos;
+    if (error != 0) {
+        finish(job, STATUS_UNKNOWN_HOST, error);
+    } else {
+        begin(loop, id, job, addr);
+    }
+}
+
+// Takes over a submitted target. Numeric addresses go straight to begin(), names to the resolver threads.
+static void admit(BatchLoop *loop, Submission &submission, bool stopping) {
+    Job &job = loop->jobs[submission.id];
+    job.target = std::move(submission.target);
+    job.outcome = BatchOutcome{STATUS_PENDING, 0, 0, 0, 0, 0, 0, std::string()};
+    job.fd = -1;
+    job.state = STATE_RESOLVING;
+    job.startNanos = submission.submitNanos;
+    job.stepDeadlineNanos = INT64_MAX;
+    job.deadlineNanos = submission.submitNanos + millisToNanos(job.target.timeoutMillis);
+    job.written = 0;
+    if (stopping) {
+        finish(job, STATUS_CANCELLED, ECANCELED);
+        return;
+    }
+
+    uint8_t numeric[16];
+    const std::string &host = job.target.host;
+    if (parseNumericAddress(host.data(), host.size(), numeric) != AF_UNSPEC) {
+        sockaddr_storage addr;
+        int64_t start = nowNanos();
+        int error = resolve(host.c_str(), &addr);
+        resolved(loop, submission.id, job, error, addr, nowNanos() - start);
+        return;
+    }
+    int err = lookUp(loop->shared, submission.id, host);
+    if (err != 0) finish(job, STATUS_ERROR, err);
+}
+
+// Advances one TCP target after its socket became ready.
+static void advance(BatchLoop *loop, uint64_t id, Job &job) {
+    const BatchTarget &target = job.target;
+    BatchOutcome &outcome = job.outcome;
+    int64_t now = nowNanos();
+    if (job.state == STATE_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(job.fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) err = errno;
+        if (err != 0) {
+            finish(job, STATUS_ERROR, err);
+            return;
+        }
+        outcome.connectNanos = now - job.startNanos;
+        tcp_info info;
+        socklen_t infoLength = sizeof(info);
+        if (getsockopt(job.fd, IPPROTO_TCP, TCP_INFO, &info, &infoLength) == 0 && info.tcpi_rtt != 0) {
+            // The first RTT sample comes from the handshake itself
+            outcome.handshakeNanos = int64_t(info.tcpi_rtt) * 1000;
+        }
+        if (target.payload.empty()) {
+            finish(job, STATUS_OK, 0);
+            return;
+        }
+        job.state = STATE_WRITING;
+    }
+
+    if (job.state == STATE_WRITING) {
+        ssize_t n = send(job.fd, target.payload.data() + job.written, target.payload.size() - job.written,
+                         MSG_NOSIGNAL);
+        if (n == -1 && errno != EAGAIN) {
+            finish(job, STATUS_ERROR, errno);
+            return;
+        }
+        if (n > 0) job.written += size_t(n);
+        if (job.written < target.payload.size()) return;
+
+        job.state = STATE_READING;
+        job.stepDeadlineNanos = now + millisToNanos(target.readTimeoutMillis);
+        if (watch(loop->epfd, EPOLL_CTL_MOD, job, id) == -1) finish(job, STATUS_ERROR, errno);
+        return;
+    }
+
+    char buf[READ_CHUNK_SIZE];
+    for (;;) {
+        size_t room = target.maxResponseBytes - outcome.response.size();
+        ssize_t n = recv(job.fd, buf, std::min(room, sizeof(buf)), 0);
+        if (n == -1) {
+            if (errno == EAGAIN) break;
+            finish(job, STATUS_ERROR, errno);
+            return;
+        }
+        if (n > 0 && outcome.firstByteNanos == 0) outcome.firstByteNanos = nowNanos() - job.startNanos;
+        outcome.response.append(buf, size_t(n));
+        if (n == 0 || outcome.response.size() >= target.maxResponseBytes) {
+            finish(job, STATUS_OK, 0);
+            return;
+        }
+    }
+    // Only the idle timeout moves, deadlineNanos still ends a server that keeps dripping bytes
+    job.stepDeadlineNanos = now + millisToNanos(target.readTimeoutMillis);
+}
+
+// Picks up new submissions and finished lookups. Returns true once the loop is asked to stop.
+static bool collect(BatchLoop *loop) {
+    std::deque<Submission> submitted;
+    std::deque<Lookup> lookups;
+    bool stopping;
+    {
+        std::lock_guard<std::mutex> lock(loop->shared->mutex);
+        submitted.swap(loop->shared->submitted);
+        lookups.swap(loop->shared->resolved);
+        stopping = loop->shared->stopping;
+    }
+
+    for (auto &submission : submitted) admit(loop, submission, stopping);
+    for (auto &lookup : lookups) {
+        auto it = loop->jobs.find(lookup.id);
+        // The job may have timed out while its name was being resolved
+        if (it == loop->jobs.end() || it->second.state != STATE_RESOLVING) continue;
+        resolved(loop, lookup.id, it->second, lookup.error, lookup.addr, lookup.resolveNanos);
+    }
+    return stopping;
+}
+
+// Times out overdue jobs and reports every finished one. Returns the earliest deadline still pending.
+static int64_t sweep(BatchLoop *loop, const BatchCallback &done) {
+    int64_t now = nowNanos();
+    int64_t deadline = INT64_MAX;
+    for (auto it = loop->jobs.begin(); it != loop->jobs.end();) {
+        Job &job = it->second;
+        if (job.state != STATE_DONE) {
+            int64_t jobDeadline = std::min(job.stepDeadlineNanos, job.deadlineNanos);
+            if (jobDeadline > now) {
+                deadline = std::min(deadline, jobDeadline);
+                ++it;
+                continue;
+            }
+            finish(job, STATUS_TIMEOUT, ETIMEDOUT);
+        }
+        done(it->first, job.outcome);
+        it = loop->jobs.erase(it);
+    }
+    return deadline;
+}
+
+BatchLoop *newBatchLoop() {
+    std::unique_ptr<BatchLoop> loop(new BatchLoop());
+    loop->shared = std::make_shared<Shared>();
+    loop->shared->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->shared->wakefd == -1) return nullptr;
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd == -1) return nullptr;
+
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_ID;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->shared->wakefd, &event) == -1) {
+        int err = errno;
+        close(loop->epfd);
+        errno = err;
+        return nullptr;
+    }
+    return loop.release();
+}
+
+bool submitBatch(BatchLoop *loop, uint64_t id, const BatchTarget &target) {
+    int64_t now = nowNanos();
+    std::lock_guard<std::mutex> lock(loop->shared->mutex);
+    if (loop->shared->stopping) return false;
+    loop->shared->submitted.push_back(Submission{id, target, now});
+    wake(*loop->shared);
+    return true;
+}
+
+int runBatchLoop(BatchLoop *loop, const BatchCallback &done) {
+    epoll_event events[MAX_EVENTS];
+    int err = 0;
+    for (;;) {
+        bool stopping = collect(loop);
+        int64_t deadline = sweep(loop, done);
+        if (stopping) break;
+
+        int64_t now = nowNanos();
+        int timeout = deadline == INT64_MAX ? -1 : int((deadline - now + 999999) / 1000000);
+        int n = epoll_wait(loop->epfd, events, MAX_EVENTS, timeout);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            uint64_t id = events[i].data.u64;
+            if (id == WAKE_ID) {
+                uint64_t count;
+                if (read(loop->shared->wakefd, &count, sizeof(count)) == -1) {
+                    // Only EAGAIN, another event already drained it
+                }
+                continue;
+            }
+            auto it = loop->jobs.find(id);
+            if (it == loop->jobs.end() || it->second.state == STATE_DONE) continue;
+            advance(loop, id, it->second);
+        }
+    }
+
+    // Whatever is still in flight or got submitted before the stop is reported as cancelled
+    {
+        std::lock_guard<std::mutex> lock(loop->shared->mutex);
+        loop->shared->stopping = true;
+        loop->shared->lookups.clear();
+    }
+    collect(loop);
+    for (auto &entry : loop->jobs) {
+        if (entry.second.state == STATE_DONE) continue;
+        if (err != 0) {
+            finish(entry.second, STATUS_ERROR, err);
+        } else {
+            finish(entry.second, STATUS_CANCELLED, ECANCELED);
+        }
+    }
+    sweep(loop, done);
+
+    if (err == 0) return 0;
+    errno = err;
+    return -1;
+}
+
+void stopBatchLoop(BatchLoop *loop) {
+    std::lock_guard<std::mutex> lock(loop->shared->mutex);
+    loop->shared->stopping = true;
+    wake(*loop->shared);
+}
+
+void freeBatchLoop(BatchLoop *loop) {
+    close(loop->epfd);
+    delete loop;
+}
+
+int runBatch(const std::vector<BatchTarget> &targets, std::vector<BatchOutcome> *outcomes) {
+    outcomes->assign(targets.size(), BatchOutcome{STATUS_PENDING, 0, 0, 0, 0, 0, 0, std::string()});
+    if (targets.empty()) return 0;
+
+    BatchLoop *loop = newBatchLoop();
+    if (loop == nullptr) return -1;
+    for (size_t i = 0; i < targets.size(); ++i) submitBatch(loop, i, targets[i]);
+
+    size_t remaining = targets.size();
+    int result = runBatchLoop(loop, [&](uint64_t id, BatchOutcome &outcome) {
+        (*outcomes)[id] = std::move(outcome);
+        if (--remaining == 0) stopBatchLoop(loop);
+    });
+    int err = errno;
+    freeBatchLoop(loop);
+    errno = err;
+    return result;
+}
+
+}
@@ -0,0 +1,299 @@
+#include "probe.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netdb.h>
+#include <netinet/icmp6.h>
+#include <netinet/ip_icmp.h>
+#include <unistd.h>
+
+namespace probe {
+
+static const int IPV4_HEADER_SIZE = 20;
+static const int IPV6_HEADER_SIZE = 40;
+static const int ICMP_HEADER_SIZE = 8;
+static const int UDP_HEADER_SIZE = 8;
+static const int MAX_PAYLOAD_SIZE = 1500;
+
+static int64_t toNanos(const timespec &ts) {
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t nowNanos() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return toNanos(ts);
+}
+
+Timestamp timestamp() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    Timestamp result;
+    result.realtimeNanos = toNanos(ts);
+    result.monotonicNanos = nowNanos();
+    return result;
+}
+
+int64_t elapsedNanos(const Timestamp &sent, const Reply &reply) {
+    if (reply.kernelNanos != 0) {
+        int64_t elapsed = reply.kernelNanos - sent.realtimeNanos;
+        if (elapsed >= 0) return elapsed;   // negative if the wall clock was stepped in between
+    }
+    return reply.receivedNanos - sent.monotonicNanos;
+}
+
+int resolve(const char *host, sockaddr_storage *addr) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    addrinfo *result = nullptr;
+    int err = getaddrinfo(host, nullptr, &hints, &result);
+    if (err != 0) return err;
+    memset(addr, 0, sizeof(*addr));
+    memcpy(addr, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+    return 0;
+}
+
+socklen_t addressLength(const sockaddr_storage &addr) {
+    return addr.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+}
+
+void setPort(sockaddr_storage *addr, int port) {
+    if (addr->ss_family == AF_INET6) {
+        reinterpret_cast<sockaddr_in6 *>(addr)->sin6_port = htons(uint16_t(port));
+    } else {
+        reinterpret_cast<sockaddr_in *>(addr)->sin_port = htons(uint16_t(port));
+    }
+}
+
+std::string formatAddress(const sockaddr_storage &addr) {
+    char buf[INET6_ADDRSTRLEN] = {0};
+    if (addr.ss_family == AF_INET6) {
+        inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6 &>(addr).sin6_addr, buf, sizeof(buf));
+    } else if (addr.ss_family == AF_INET) {
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in &>(addr).sin_addr, buf, sizeof(buf));
+    }
+    return buf;
+}
+
+static int openSocket(Protocol protocol, int family) {
+    int type = protocol == PROTOCOL_TCP ? SOCK_STREAM : SOCK_DGRAM;
+    int proto = 0;
+    if (protocol == PROTOCOL_ICMP) proto = family == AF_INET6 ? int(IPPROTO_ICMPV6) : int(IPPROTO_ICMP);
+    return socket(family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, proto);
+}
+
+static int configureSocket(int fd, int family, int ttl) {
+    int on = 1;
+    if (family == AF_INET6) {
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl)) == -1) return -1;
+        return setsockopt(fd, IPPROTO_IPV6, IPV6_RECVERR, &on, sizeof(on));
+    }
+    if (setsockopt(fd, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl)) == -1) return -1;
+    return setsockopt(fd, IPPROTO_IP, IP_RECVERR, &on, sizeof(on));
+}
+
+static void enableTimestamping(int fd) {
+    // Best effort, replies are timed in userspace if the kernel refuses
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+}
+
+static int payloadSize(Protocol protocol, int family, int packetSize) {
+    int headers = (family == AF_INET6 ? IPV6_HEADER_SIZE : IPV4_HEADER_SIZE) +
+                  (protocol == PROTOCOL_ICMP ? ICMP_HEADER_SIZE : UDP_HEADER_SIZE);
+    return std::min(std::max(packetSize - headers, 0), MAX_PAYLOAD_SIZE);
+}
+
+int sendProbe(Protocol protocol, const sockaddr_storage &target, int ttl, int sequence, int packetSize,
+              Timestamp *sent) {
+    int family = target.ss_family;
+    int fd = openSocket(protocol, family);
+    if (fd == -1) return -1;
+    if (configureSocket(fd, family, ttl) == -1) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    if (protocol != PROTOCOL_TCP) enableTimestamping(fd);
+
+    sockaddr_storage dst = target;
+    uint8_t packet[ICMP_HEADER_SIZE + MAX_PAYLOAD_SIZE];
+    size_t length = size_t(payloadSize(protocol, family, packetSize));
+    memset(packet, 0, sizeof(packet));
+
+    int result;
+    switch (protocol) {
+        case PROTOCOL_ICMP: {
+            // Ping sockets fill in the identifier and the checksum themselves
+            if (family == AF_INET6) {
+                auto header = reinterpret_cast<icmp6_hdr *>(packet);
+                header->icmp6_type = ICMP6_ECHO_REQUEST;
+                header->icmp6_seq = htons(uint16_t(sequence));
+            } else {
+                auto header = reinterpret_cast<icmphdr *>(packet);
+                header->type = ICMP_ECHO;
+                header->un.echo.sequence = htons(uint16_t(sequence));
+            }
+            length += ICMP_HEADER_SIZE;
+            *sent = timestamp();
+            result = int(sendto(fd, packet, length, 0, reinterpret_cast<sockaddr *>(&dst), addressLength(dst)));
+            break;
+        }
+        case PROTOCOL_UDP:
+            *sent = timestamp();
+            result = int(sendto(fd, packet, length, 0, reinterpret_cast<sockaddr *>(&dst), addressLength(dst)));
+            break;
+        case PROTOCOL_TCP:
+            *sent = timestamp();
+            result = connect(fd, reinterpret_cast<sockaddr *>(&dst), addressLength(dst));
+            if (result == -1 && errno == EINPROGRESS) result = 0;
+            break;
+        default:
+            errno = EPROTONOSUPPORT;
+            result = -1;
+            break;
+    }
+    if (result == -1) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// Extended error plus room for the offending address that follows it, see SO_EE_OFFENDER
+union ExtendedError {
+    sock_extended_err ee;
+    uint8_t raw[sizeof(sock_extended_err) + sizeof(sockaddr_in6)];
+};
+
+// recvmsg() that also picks up the kernel RX timestamp and, if `error` is given, the IP_RECVERR message.
+// Returns the received length, or -1.
+static ssize_t receive(int fd, void *buf, size_t size, int flags, Reply *reply, ExtendedError *error) {
+    uint8_t control[512];
+    sockaddr_storage name;
+    iovec iov = {buf, size};
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &name;
+    msg.msg_namelen = sizeof(name);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(fd, &msg, flags | MSG_DONTWAIT);
+    if (n == -1) return -1;
+
+    reply->receivedNanos = nowNanos();
+    reply->kernelNanos = 0;
+    if (error != nullptr) memset(error, 0, sizeof(*error));     // ee_origin = SO_EE_ORIGIN_NONE
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            auto ts = reinterpret_cast<const timespec *>(CMSG_DATA(cmsg));
+            reply->kernelNanos = toNanos(ts[0]);    // ts[0] is the software timestamp
+        } else if (error != nullptr && ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                                        (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) {
+            memcpy(error->raw, CMSG_DATA(cmsg), std::min(size_t(cmsg->cmsg_len - CMSG_LEN(0)), sizeof(error->raw)));
+        }
+    }
+    return n;
+}
+
+static bool readErrorQueue(int fd, Reply *reply) {
+    uint8_t data[256];
+    ExtendedError error;
+    if (receive(fd, data, sizeof(data), MSG_ERRQUEUE, reply, &error) == -1) return false;
+    if (error.ee.ee_origin == SO_EE_ORIGIN_NONE) return false;
+
+    sock_extended_err *ee = &error.ee;
+    reply->error = int(ee->ee_errno);
+    memset(&reply->from, 0, sizeof(reply->from));
+
+    if (ee->ee_origin == SO_EE_ORIGIN_ICMP) {
+        memcpy(&reply->from, SO_EE_OFFENDER(ee), sizeof(sockaddr_in));
+        if (ee->ee_type == ICMP_TIME_EXCEEDED) {
+            reply->kind = REPLY_HOP;
+        } else if (ee->ee_type == ICMP_DEST_UNREACH && ee->ee_code == ICMP_PORT_UNREACH) {
+            reply->kind = REPLY_DESTINATION;
+        } else {
+            reply->kind = REPLY_UNREACHABLE;
+        }
+    } else if (ee->ee_origin == SO_EE_ORIGIN_ICMP6) {
+        memcpy(&reply->from, SO_EE_OFFENDER(ee), sizeof(sockaddr_in6));
+        if (ee->ee_type == ICMP6_TIME_EXCEEDED) {
+            reply->kind = REPLY_HOP;
+        } else if (ee->ee_type == ICMP6_DST_UNREACH && ee->ee_code == ICMP6_DST_UNREACH_NOPORT) {
+            reply->kind = REPLY_DESTINATION;
+        } else {
+            reply->kind = REPLY_UNREACHABLE;
+        }
+    } else {
+        // Locally generated error, e.g. EMSGSIZE or a missing route
+        reply->kind = REPLY_UNREACHABLE;
+    }
+    return true;
+}
+
+bool readReply(Protocol protocol, int fd, const sockaddr_storage &target, Reply *reply) {
+    if (readErrorQueue(fd, reply)) return true;
+
+    switch (protocol) {
+        case PROTOCOL_ICMP: {
+            uint8_t buf[ICMP_HEADER_SIZE + MAX_PAYLOAD_SIZE];
+            ssize_t n;
+            while ((n = receive(fd, buf, sizeof(buf), 0, reply, nullptr)) >= ICMP_HEADER_SIZE) {
+                bool echoReply = target.ss_family == AF_INET6
+                        ? buf[0] == ICMP6_ECHO_REPLY
+                        : buf[0] == ICMP_ECHOREPLY;
+                if (!echoReply) continue;
+                reply->kind = REPLY_DESTINATION;
+                reply->from = target;
+                reply->error = 0;
+                return true;
+            }
+            return false;
+        }
+        case PROTOCOL_UDP: {
+            uint8_t buf[1];
+            if (receive(fd, buf, sizeof(buf), MSG_TRUNC, reply, nullptr) == -1) return false;
+            reply->kind = REPLY_DESTINATION;
+            reply->from = target;
+            reply->error = 0;
+            return true;
+        }
+        case PROTOCOL_TCP: {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) return false;
+            if (err == 0) {
+                sockaddr_storage peer;
+                socklen_t peerLength = sizeof(peer);
+                if (getpeername(fd, reinterpret_cast<sockaddr *>(&peer), &peerLength) == -1) return false;
+            }
+            reply->from = target;
+            reply->receivedNanos = nowNanos();
+            reply->kernelNanos = 0;
+            reply->error = err;
+            // A refused connection still proves that the target host is there
+            reply->kind = err == 0 || err == ECONNREFUSED ? REPLY_DESTINATION : REPLY_UNREACHABLE;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,159 @@
+#ifndef PATH_PROBE_PROBE_H
+#define PATH_PROBE_PROBE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace probe {
+
+enum Protocol {
+    PROTOCOL_ICMP = 0,
+    PROTOCOL_UDP = 1,
+    PROTOCOL_TCP = 2,
+};
+
+enum ReplyKind {
+    REPLY_NONE = 0,         // nothing relevant received yet
+    REPLY_HOP,              // TTL expired in transit, `from` is the router
+    REPLY_DESTINATION,      // target answered: echo reply, port unreachable, connect completed or refused
+    REPLY_UNREACHABLE,      // target or router reported that the target cannot be reached
+};
+
+// A point in time taken right at a syscall boundary. Kernel RX timestamps are CLOCK_REALTIME,
+// so both clocks are captured to be able to compare against them.
+struct Timestamp {
+    int64_t monotonicNanos; // CLOCK_MONOTONIC_RAW, immune to NTP slewing
+    int64_t realtimeNanos;  // CLOCK_REALTIME
+};
+
+struct Reply {
+    ReplyKind kind;
+    sockaddr_storage from;
+    int64_t receivedNanos;  // CLOCK_MONOTONIC_RAW when the reply was read
+    int64_t kernelNanos;    // SO_TIMESTAMPING software RX timestamp (CLOCK_REALTIME), 0 if unavailable
+    int error;              // errno derived from the ICMP error for REPLY_UNREACHABLE
+};
+
+struct TraceOptions {
+    Protocol protocol = PROTOCOL_ICMP;
+    int port = 33434;       // base destination port for UDP, fixed port for TCP
+    bool fixedPort = false; // send every UDP probe to `port` instead of incrementing it
+    int maxHops = 30;
+    int queries = 3;        // probe cycles, each one covers all TTLs at once
+    int intervalMillis = 100;   // delay between cycles, keeps routers' ICMP rate limits happy
+    int waitMillis = 1000;  // how long every probe waits for its reply
+    int packetSize = 60;    // full IP packet size, as traceroute counts it
+};
+
+struct TraceHop {
+    sockaddr_storage addr;  // ss_family == AF_UNSPEC if nobody answered
+    std::vector<double> rtts;   // milliseconds, NAN for lost probes
+    int error;              // errno reported by the hop if it declared the target unreachable
+};
+
+struct Trace {
+    Protocol protocol;      // may differ from the requested one, see trace()
+    std::vector<TraceHop> hops;
+};
+
+int64_t nowNanos();
+Timestamp timestamp();
+
+// Round trip from `sent` to `reply`, preferring the kernel RX timestamp over the time it was read.
+int64_t elapsedNanos(const Timestamp &sent, const Reply &reply);
+
+// Resolves `host` (numeric or name) into `addr`. Returns 0 or a getaddrinfo() EAI_* code.
+int resolve(const char *host, sockaddr_storage *addr);
+socklen_t addressLength(const sockaddr_storage &addr);
+void setPort(sockaddr_storage *addr, int port);
+std::string formatAddress(const sockaddr_storage &addr);
+
+// Parses a numeric IPv4/IPv6 address that is not NUL-terminated into `dst` (at least 16 bytes).
+// Returns AF_INET, AF_INET6 or AF_UNSPEC if `str` is not a numeric address.
+int parseNumericAddress(const char *str, size_t length, uint8_t *dst);
+
+// Opens a non-blocking socket with the given TTL and fires one probe at `target`, recording in `sent`
+// the moment right before the probe left. Returns the socket or -1 with errno set.
+int sendProbe(Protocol protocol, const sockaddr_storage &target, int ttl, int sequence, int packetSize,
+              Timestamp *sent);
+
+// Reads whatever is pending on a probe socket. Returns false if nothing relevant arrived yet.
+bool readReply(Protocol protocol, int fd, const sockaddr_storage &target, Reply *reply);
+
+// Protocol that trace() will actually use: ICMP falls back to UDP when the system does not allow
+// unprivileged ping sockets. Returns -1 with errno set on other failures.
+int traceProtocol(const sockaddr_storage &target, Protocol protocol);
+
+// Parallel-TTL traceroute: every cycle sends probes for all TTLs at once, up to a cap on open sockets,
+// and a single epoll loop collects the replies. Hops past the first one that reached the target are
+// dropped. TCP only probes the destination. Returns 0 or -1 with errno set.
+int trace(const sockaddr_storage &target, const TraceOptions &options, Trace *trace);
+
+enum Status {
+    STATUS_PENDING = 0,
+    STATUS_OK,
+    STATUS_TIMEOUT,
+    STATUS_ERROR,           // `error` holds the errno
+    STATUS_UNKNOWN_HOST,    // `error` holds the EAI_* code
+    STATUS_CANCELLED,       // the loop stopped before the target finished
+};
+
+struct BatchTarget {
+    Protocol protocol;      // TCP connects and optionally exchanges a payload, UDP sends one datagram
+    std::string host;
+    int port;
+    std::string payload;
+    int connectTimeoutMillis;
+    int readTimeoutMillis;  // idle timeout between reads, like SO_TIMEOUT
+    int timeoutMillis;      // whole job from submission, however busy the server keeps the connection
+    size_t maxResponseBytes;
+};
+
+// All durations except resolveNanos are measured from right before connect()/sendto() was issued,
+// with CLOCK_MONOTONIC_RAW. Zero means the step did not happen.
+struct BatchOutcome {
+    Status status;
+    int error;
+    int64_t resolveNanos;   // time spent in getaddrinfo()
+    int64_t connectNanos;   // until connect() completed or the datagram was handed to the kernel
+    int64_t handshakeNanos; // kernel-measured SYN to SYN-ACK round trip from TCP_INFO
+    int64_t firstByteNanos; // until the first response byte was read
+    int64_t totalNanos;     // until the last byte or the failure
+    std::string response;
+};
+
+// Long-lived epoll loop that targets join while others are still in flight. Host names are resolved on
+// up to four helper threads, so neither submitting nor the loop itself waits for getaddrinfo().
+struct BatchLoop;
+
+typedef std::function<void(uint64_t id, BatchOutcome &outcome)> BatchCallback;
+
+// Returns nullptr with errno set.
+BatchLoop *newBatchLoop();
+
+// Queues `target` from any thread, `id` comes back with its outcome. Returns false once the loop is stopping.
+bool submitBatch(BatchLoop *loop, uint64_t id, const BatchTarget &target);
+
+// Runs the loop on the calling thread until stopBatchLoop() and reports every accepted target to `done`
+// exactly once, from this thread. Targets still in flight when it stops finish as STATUS_CANCELLED.
+// Returns 0 or -1 with errno set if the loop itself failed, those targets finish as STATUS_ERROR then.
+int runBatchLoop(BatchLoop *loop, const BatchCallback &done);
+
+// Safe from any thread, including from `done`.
+void stopBatchLoop(BatchLoop *loop);
+
+// Only once runBatchLoop() returned and no submitBatch() call can still be in progress.
+void freeBatchLoop(BatchLoop *loop);
+
+// Runs all targets concurrently on a loop of their own and returns once every one of them finished.
+// Returns 0 or -1 with errno set if the loop itself could not run.
+int runBatch(const std::vector<BatchTarget> &targets, std::vector<BatchOutcome> *outcomes);
+
+}
+
+#endif
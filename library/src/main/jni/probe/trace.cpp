@@ -0,0 +1,181 @@
+#include "probe.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace probe {
+
+static const int MAX_EVENTS = 64;
+// Probes in flight at once, each one holds a socket: 30 hops of 10 queries would otherwise open 300
+static const int MAX_OPEN = 64;
+
+struct Slot {
+    int fd;
+    Timestamp sent;
+};
+
+int traceProtocol(const sockaddr_storage &target, Protocol protocol) {
+    if (protocol != PROTOCOL_ICMP) return protocol;
+    // Unprivileged ICMP needs the app's group in net.ipv4.ping_group_range
+    int family = target.ss_family;
+    int fd = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, family == AF_INET6 ? int(IPPROTO_ICMPV6) : int(IPPROTO_ICMP));
+    if (fd != -1) {
+        close(fd);
+        return PROTOCOL_ICMP;
+    }
+    if (errno == EACCES || errno == EPERM || errno == EPROTONOSUPPORT) return PROTOCOL_UDP;
+    return -1;
+}
+
+static int64_t millisToNanos(int millis) {
+    return int64_t(millis) * 1000000LL;
+}
+
+// Fires the probes of `cycle` from TTL `*nextTtl` on, skipping TTLs beyond an already known destination and
+// stopping once MAX_OPEN probes are in flight. `*nextTtl` is left at the first TTL not tried yet.
+// Returns the number of probes sent or -1 with errno set if not a single one could be sent.
+static int sendCycle(int epfd, const sockaddr_storage &target, const TraceOptions &options, Protocol protocol,
+                     int cycle, int *nextTtl, int lastTtl, int inFlight, std::vector<Slot> &slots) {
+    int sent = 0;
+    int error = 0;
+    for (; *nextTtl <= lastTtl && inFlight + sent < MAX_OPEN; ++*nextTtl) {
+        int ttl = *nextTtl;
+        int sequence = cycle * options.maxHops + ttl - 1;
+        sockaddr_storage dst = target;
+        if (protocol == PROTOCOL_UDP) setPort(&dst, options.fixedPort ? options.port : options.port + sequence);
+        else if (protocol == PROTOCOL_TCP) setPort(&dst, options.port);
+
+        Slot &slot = slots[size_t((ttl - 1) * options.queries + cycle)];
+        slot.fd = sendProbe(protocol, dst, ttl, sequence, options.packetSize, &slot.sent);
+        if (slot.fd == -1) {
+            error = errno;
+            continue;
+        }
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | (protocol == PROTOCOL_TCP ? uint32_t(EPOLLOUT) : 0u);
+        event.data.u32 = uint32_t((ttl - 1) * options.queries + cycle);
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, slot.fd, &event) == -1) {
+            error = errno;
+            close(slot.fd);
+            slot.fd = -1;
+            continue;
+        }
+        ++sent;
+    }
+    if (sent == 0 && error != 0) {
+        errno = error;
+        return -1;
+    }
+    return sent;
+}
+
+int trace(const sockaddr_storage &target, const TraceOptions &options, Trace *trace) {
+    int protocol = traceProtocol(target, options.protocol);
+    if (protocol == -1) return -1;
+    trace->protocol = Protocol(protocol);
+
+    TraceHop empty;
+    memset(&empty.addr, 0, sizeof(empty.addr));
+    empty.error = 0;
+    empty.rtts.assign(size_t(options.queries), NAN);
+    trace->hops.assign(size_t(options.maxHops), empty);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1) return -1;
+
+    std::vector<Slot> slots(size_t(options.maxHops * options.queries), Slot{-1, Timestamp{0, 0}});
+    // Depending on the kernel, a router's time exceeded reaches a connecting TCP socket either through
+    // the error queue or only as connect()'s EHOSTUNREACH without the router's address. TCP therefore
+    // only probes the destination, with a TTL of maxHops, and reports it as the one and only hop.
+    int firstTtl = trace->protocol == PROTOCOL_TCP ? options.maxHops : 1;
+    int lastTtl = options.maxHops;      // lowers as soon as the destination answers
+    int nextTtl = firstTtl;             // of the cycle being sent
+    int inFlight = 0;
+    int cycle = 0;
+    int error = 0;
+    int64_t start = nowNanos();
+    int64_t wait = millisToNanos(options.waitMillis);
+    epoll_event events[MAX_EVENTS];
+
+    for (;;) {
+        // Unanswered probes give up after waitMillis and make room for the ones still to be sent
+        int64_t now = nowNanos();
+        int64_t deadline = INT64_MAX;
+        for (auto &slot : slots) {
+            if (slot.fd == -1) continue;
+            if (now >= slot.sent.monotonicNanos + wait) {
+                close(slot.fd);
+                slot.fd = -1;
+                --inFlight;
+            } else {
+                deadline = std::min(deadline, slot.sent.monotonicNanos + wait);
+            }
+        }
+
+        if (cycle < options.queries && inFlight < MAX_OPEN) {
+            int64_t cycleStart = start + cycle * millisToNanos(options.intervalMillis);
+            if (now >= cycleStart) {
+                int sent = sendCycle(epfd, target, options, trace->protocol, cycle, &nextTtl, lastTtl, inFlight, slots);
+                if (sent == -1) {
+                    error = errno;
+                    break;
+                }
+                inFlight += sent;
+                if (nextTtl > lastTtl) {
+                    ++cycle;
+                    nextTtl = firstTtl;
+                }
+                continue;
+            }
+            deadline = std::min(deadline, cycleStart);
+        }
+        if (cycle == options.queries && inFlight == 0) break;
+
+        int timeout = int(std::max<int64_t>(deadline - now + 999999, 0) / 1000000);
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            error = errno;
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            size_t index = events[i].data.u32;
+            Slot &slot = slots[index];
+            if (slot.fd == -1) continue;
+
+            Reply reply;
+            if (!readReply(trace->protocol, slot.fd, target, &reply)) continue;
+
+            int ttl = int(index) / options.queries + 1;
+            TraceHop &hop = trace->hops[size_t(ttl - 1)];
+            hop.rtts[index % size_t(options.queries)] = double(elapsedNanos(slot.sent, reply)) / 1e6;
+            if (hop.addr.ss_family == AF_UNSPEC) hop.addr = reply.from;
+            if (reply.kind == REPLY_UNREACHABLE) hop.error = reply.error;
+            if (reply.kind == REPLY_DESTINATION || reply.kind == REPLY_UNREACHABLE) lastTtl = std::min(lastTtl, ttl);
+
+            close(slot.fd);     // also drops it from the epoll set
+            slot.fd = -1;
+            --inFlight;
+        }
+    }
+
+    for (auto &slot : slots) if (slot.fd != -1) close(slot.fd);
+    close(epfd);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    trace->hops.resize(size_t(lastTtl));
+    trace->hops.erase(trace->hops.begin(), trace->hops.begin() + (firstTtl - 1));
+    return 0;
+}
+
+}
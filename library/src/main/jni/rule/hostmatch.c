@@ -0,0 +1,424 @@
+#include "hostmatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MARK_START 0x01         /* `^`, fed before the host */
+#define MARK_END 0x03           /* `$`, fed after it */
+#define MAX_EXPANSIONS 64       /* literal strings per rule */
+#define MAX_LITERAL 255
+#define LINEAR_EDGES 8          /* edge lists up to this length are scanned, longer ones bisected */
+
+#define UNSUPPORTED 1
+
+struct expansion {
+    size_t count;
+    uint8_t length[MAX_EXPANSIONS];
+    uint8_t text[MAX_EXPANSIONS][MAX_LITERAL];
+};
+
+struct hostmatch {
+    /* Pending literals until hostmatch_build(), stored reversed */
+    uint8_t *bytes;
+    size_t bytes_size, bytes_capacity;
+    struct literal {
+        size_t offset;
+        uint32_t length;
+        uint32_t id;
+    } *literals;
+    size_t literal_count, literal_capacity;
+
+    /* The automaton, node 0 is the root */
+    uint32_t node_count;
+    uint32_t root_next[256];    /* 0 stays at the root */
+    uint32_t *edge_start;       /* edges of node n are [edge_start[n], edge_start[n + 1]) */
+    uint8_t *edge_label;        /* sorted within a node */
+    uint32_t *edge_child;
+    uint32_t *fail;
+    uint32_t *best;             /* lowest id ending here or at any fail ancestor */
+    int built;
+};
+
+/* Regex subset expansion. All parse functions return 0, UNSUPPORTED or -1 if out of memory. */
+
+static struct expansion *expansion_new(void)
+{
+    struct expansion *expansion = malloc(sizeof(*expansion));
+    if (expansion != NULL) {
+        expansion->count = 1;
+        expansion->length[0] = 0;
+    }
+    return expansion;
+}
+
+/* Concatenates every string of `head` with every string of `tail` into `head` */
+static int product(struct expansion *head, const struct expansion *tail)
+{
+    if (head->count * tail->count > MAX_EXPANSIONS) return UNSUPPORTED;
+    struct expansion *result = malloc(sizeof(*result));
+    if (result == NULL) return -1;
+    result->count = 0;
+    for (size_t i = 0; i < head->count; ++i) {
+        for (size_t j = 0; j < tail->count; ++j) {
+            size_t length = (size_t) head->length[i] + tail->length[j];
+            if (length > MAX_LITERAL) {
+                free(result);
+                return UNSUPPORTED;
+            }
+            uint8_t *text = result->text[result->count];
+            memcpy(text, head->text[i], head->length[i]);
+            memcpy(text + head->length[i], tail->text[j], tail->length[j]);
+            result->length[result->count++] = (uint8_t) length;
+        }
+    }
+    memcpy(head, result, sizeof(*head));
+    free(result);
+    return 0;
+}
+
+static int parse_alternation(const char **pattern, struct expansion *out);
+
+static int parse_atom(const char **pattern, struct expansion *atom)
+{
+    const char *p = *pattern;
+    uint8_t c;
+    atom->count = 1;
+    switch (*p) {
+    case '(':
+        ++p;
+        if (*p == '?') {
+            if (p[1] != ':') return UNSUPPORTED;
+            p += 2;
+        }
+        int ret = parse_alternation(&p, atom);
+        if (ret != 0) return ret;
+        if (*p != ')') return UNSUPPORTED;
+        *pattern = p + 1;
+        return 0;
+    case '\\':
+        c = (uint8_t) p[1];
+        // Escaped letters and digits are classes or back references
+        if (c == '\0' || (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')) return UNSUPPORTED;
+        p += 2;
+        break;
+    case '^':
+        c = MARK_START;
+        ++p;
+        break;
+    case '$':
+        c = MARK_END;
+        ++p;
+        break;
+    case '.': case '[': case ']': case '*': case '+': case '?': case '{': case '}':
+        return UNSUPPORTED;
+    default:
+        c = (uint8_t) *p++;
+        if (c < 0x20 || c >= 0x80) return UNSUPPORTED;
+    }
+    atom->length[0] = 1;
+    atom->text[0][0] = c;
+    *pattern = p;
+    return 0;
+}
+
+static int parse_sequence(const char **pattern, struct expansion *out)
+{
+    struct expansion *atom = expansion_new();
+    if (atom == NULL) return -1;
+    int ret = 0;
+    out->count = 1;
+    out->length[0] = 0;
+    while (ret == 0 && **pattern != '\0' && **pattern != '|' && **pattern != ')') {
+        ret = parse_atom(pattern, atom);
+        if (ret != 0) break;
+        if (**pattern == '?') {
+            ++*pattern;
+            if (atom->count == MAX_EXPANSIONS) {
+                ret = UNSUPPORTED;
+                break;
+            }
+            atom->length[atom->count++] = 0;
+        }
+        ret = product(out, atom);
+    }
+    free(atom);
+    return ret;
+}
+
+static int parse_alternation(const char **pattern, struct expansion *out)
+{
+    struct expansion *branch = expansion_new();
+    if (branch == NULL) return -1;
+    int ret;
+    out->count = 0;
+    for (;;) {
+        ret = parse_sequence(pattern, branch);
+        if (ret != 0) break;
+        if (out->count + branch->count > MAX_EXPANSIONS) {
+            ret = UNSUPPORTED;
+            break;
+        }
+        for (size_t i = 0; i < branch->count; ++i) {
+            memcpy(out->text[out->count], branch->text[i], branch->length[i]);
+            out->length[out->count++] = branch->length[i];
+        }
+        if (**pattern != '|') break;
+        ++*pattern;
+    }
+    free(branch);
+    return ret;
+}
+
+/*
+ * Anchors anywhere but at the ends would need PCRE's exact semantics, and an empty literal would
+ * match every host; both are left to the fallback.
+ */
+static int expand(const char *pattern, struct expansion *out)
+{
+    int ret = parse_alternation(&pattern, out);
+    if (ret != 0) return ret;
+    if (*pattern != '\0') return UNSUPPORTED;
+    for (size_t i = 0; i < out->count; ++i) {
+        size_t length = out->length[i];
+        if (length == 0) return UNSUPPORTED;
+        for (size_t j = 0; j < length; ++j) {
+            uint8_t c = out->text[i][j];
+            if ((c == MARK_START && j != 0) || (c == MARK_END && j != length - 1)) return UNSUPPORTED;
+        }
+    }
+    return 0;
+}
+
+struct hostmatch *hostmatch_new(void)
+{
+    return calloc(1, sizeof(struct hostmatch));
+}
+
+int hostmatch_supported(const char *pattern)
+{
+    struct expansion *expansion = expansion_new();
+    if (expansion == NULL) return 0;
+    int ret = expand(pattern, expansion);
+    free(expansion);
+    return ret == 0;
+}
+
+static int reserve(void **buffer, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity) return 0;
+    size_t grown = *capacity == 0 ? 64 : *capacity;
+    while (grown < needed) grown *= 2;
+    void *resized = realloc(*buffer, grown * size);
+    if (resized == NULL) return -1;
+    *buffer = resized;
+    *capacity = grown;
+    return 0;
+}
+
+int hostmatch_add(struct hostmatch *matcher, const char *pattern, uint32_t id)
+{
+    if (matcher->built || id == HOSTMATCH_NONE) return -1;
+    struct expansion *expansion = expansion_new();
+    if (expansion == NULL) return -1;
+    int ret = expand(pattern, expansion);
+    if (ret != 0) goto done;
+
+    ret = -1;
+    size_t bytes = 0;
+    for (size_t i = 0; i < expansion->count; ++i) bytes += expansion->length[i];
+    if (reserve((void **) &matcher->bytes, &matcher->bytes_capacity, matcher->bytes_size + bytes, 1) == -1 ||
+        reserve((void **) &matcher->literals, &matcher->literal_capacity,
+                matcher->literal_count + expansion->count, sizeof(struct literal)) == -1) {
+        goto done;
+    }
+    for (size_t i = 0; i < expansion->count; ++i) {
+        struct literal *literal = &matcher->literals[matcher->literal_count++];
+        literal->offset = matcher->bytes_size;
+        literal->length = expansion->length[i];
+        literal->id = id;
+        for (size_t j = expansion->length[i]; j-- > 0;) matcher->bytes[matcher->bytes_size++] = expansion->text[i][j];
+    }
+    ret = 0;
+done:
+    free(expansion);
+    return ret;
+}
+
+/* Child of `node` on `label`, 0 if there is none. The root's children are in root_next. */
+static uint32_t child(const struct hostmatch *matcher, uint32_t node, uint8_t label)
+{
+    uint32_t begin = matcher->edge_start[node], end = matcher->edge_start[node + 1];
+    if (end - begin <= LINEAR_EDGES) {
+        for (uint32_t i = begin; i < end; ++i) {
+            if (matcher->edge_label[i] >= label) return matcher->edge_label[i] == label ? matcher->edge_child[i] : 0;
+        }
+        return 0;
+    }
+    while (begin < end) {
+        uint32_t middle = begin + (end - begin) / 2;
+        if (matcher->edge_label[middle] < label) begin = middle + 1;
+        else end = middle;
+    }
+    return begin < matcher->edge_start[node + 1] && matcher->edge_label[begin] == label ? matcher->edge_child[begin] : 0;
+}
+
+static uint32_t step(const struct hostmatch *matcher, uint32_t node, uint8_t label)
+{
+    for (;;) {
+        if (node == 0) return matcher->root_next[label];
+        uint32_t next = child(matcher, node, label);
+        if (next != 0) return next;
+        node = matcher->fail[node];
+    }
+}
+
+/* Open addressing table of trie edges while the literals are inserted */
+struct edge_table {
+    uint64_t *keys;             /* (parent << 8 | label) + 1, 0 for a free slot */
+    uint32_t *children;
+    size_t mask;
+};
+
+static uint32_t *edge_slot(struct edge_table *table, uint32_t parent, uint8_t label, int *found)
+{
+    uint64_t key = ((uint64_t) parent << 8 | label) + 1;
+    size_t slot = (size_t) ((key * 0x9e3779b97f4a7c15ULL) >> 20) & table->mask;
+    while (table->keys[slot] != 0 && table->keys[slot] != key) slot = (slot + 1) & table->mask;
+    *found = table->keys[slot] != 0;
+    table->keys[slot] = key;
+    return &table->children[slot];
+}
+
+int hostmatch_build(struct hostmatch *matcher)
+{
+    if (matcher->built) return -1;
+    size_t max_nodes = matcher->bytes_size + 1, table_size = 16;
+    while (table_size < 2 * max_nodes) table_size *= 2;
+    struct edge_table table = {
+        calloc(table_size, sizeof(uint64_t)), malloc(table_size * sizeof(uint32_t)), table_size - 1,
+    };
+    uint32_t *own = malloc(max_nodes * sizeof(uint32_t));
+    uint32_t *parent = malloc(max_nodes * sizeof(uint32_t));
+    uint8_t *label = malloc(max_nodes);
+    uint32_t *queue = malloc(max_nodes * sizeof(uint32_t));
+    int ret = -1;
+    if (table.keys == NULL || table.children == NULL || own == NULL || parent == NULL || label == NULL ||
+        queue == NULL) {
+        goto done;
+    }
+
+    // Trie of the reversed literals
+    uint32_t nodes = 1;
+    own[0] = HOSTMATCH_NONE;
+    for (size_t i = 0; i < matcher->literal_count; ++i) {
+        const struct literal *literal = &matcher->literals[i];
+        uint32_t node = 0;
+        for (uint32_t j = 0; j < literal->length; ++j) {
+            uint8_t c = matcher->bytes[literal->offset + j];
+            int found;
+            uint32_t *slot = edge_slot(&table, node, c, &found);
+            if (!found) {
+                *slot = nodes;
+                own[nodes] = HOSTMATCH_NONE;
+                parent[nodes] = node;
+                label[nodes] = c;
+                ++nodes;
+            }
+            node = *slot;
+        }
+        if (literal->id < own[node]) own[node] = literal->id;
+    }
+
+    // Edges grouped by parent and sorted by label: children are numbered in insertion order, so a
+    // counting sort by parent keeps them stable and each group only needs sorting by label
+    matcher->edge_start = calloc((size_t) nodes + 1, sizeof(uint32_t));
+    matcher->edge_label = malloc(nodes);
+    matcher->edge_child = malloc((size_t) nodes * sizeof(uint32_t));
+    matcher->fail = calloc(nodes, sizeof(uint32_t));
+    matcher->best = malloc((size_t) nodes * sizeof(uint32_t));
+    if (matcher->edge_start == NULL || matcher->edge_label == NULL || matcher->edge_child == NULL ||
+        matcher->fail == NULL || matcher->best == NULL) {
+        goto done;
+    }
+    for (uint32_t node = 1; node < nodes; ++node) ++matcher->edge_start[parent[node] + 1];
+    for (uint32_t node = 0; node < nodes; ++node) matcher->edge_start[node + 1] += matcher->edge_start[node];
+    uint32_t *fill = queue;     // reused as the next free edge of every node
+    memcpy(fill, matcher->edge_start, (size_t) nodes * sizeof(uint32_t));
+    for (uint32_t node = 1; node < nodes; ++node) {
+        uint32_t at = fill[parent[node]]++;
+        uint32_t begin = matcher->edge_start[parent[node]];
+        while (at > begin && matcher->edge_label[at - 1] > label[node]) {
+            matcher->edge_label[at] = matcher->edge_label[at - 1];
+            matcher->edge_child[at] = matcher->edge_child[at - 1];
+            --at;
+        }
+        matcher->edge_label[at] = label[node];
+        matcher->edge_child[at] = node;
+    }
+    memset(matcher->root_next, 0, sizeof(matcher->root_next));
+    for (uint32_t i = matcher->edge_start[0]; i < matcher->edge_start[1]; ++i) {
+        matcher->root_next[matcher->edge_label[i]] = matcher->edge_child[i];
+    }
+    matcher->node_count = nodes;
+
+    // Failure links breadth first, so every node's link target is finished before the node
+    size_t head = 0, tail = 0;
+    matcher->best[0] = own[0];
+    queue[tail++] = 0;
+    while (head < tail) {
+        uint32_t node = queue[head++];
+        for (uint32_t i = matcher->edge_start[node]; i < matcher->edge_start[node + 1]; ++i) {
+            uint32_t next = matcher->edge_child[i];
+            uint32_t link = node == 0 ? 0 : step(matcher, matcher->fail[node], matcher->edge_label[i]);
+            matcher->fail[next] = link;
+            matcher->best[next] = own[next] < matcher->best[link] ? own[next] : matcher->best[link];
+            queue[tail++] = next;
+        }
+    }
+
+    free(matcher->bytes);
+    free(matcher->literals);
+    matcher->bytes = NULL;
+    matcher->literals = NULL;
+    matcher->bytes_size = matcher->bytes_capacity = matcher->literal_count = matcher->literal_capacity = 0;
+    matcher->built = 1;
+    ret = 0;
+done:
+    free(table.keys);
+    free(table.children);
+    free(own);
+    free(parent);
+    free(label);
+    free(queue);
+    return ret;
+}
+
+uint32_t hostmatch_find(const struct hostmatch *matcher, const char *host, size_t len)
+{
+    if (!matcher->built || matcher->node_count == 1) return HOSTMATCH_NONE;
+    uint32_t node = step(matcher, 0, MARK_END), best = matcher->best[node];
+    for (size_t i = len; i-- > 0;) {
+        node = step(matcher, node, (uint8_t) host[i]);
+        if (matcher->best[node] < best) best = matcher->best[node];
+    }
+    node = step(matcher, node, MARK_START);
+    return matcher->best[node] < best ? matcher->best[node] : best;
+}
+
+size_t hostmatch_states(const struct hostmatch *matcher)
+{
+    return matcher->node_count;
+}
+
+void hostmatch_free(struct hostmatch *matcher)
+{
+    if (matcher == NULL) return;
+    free(matcher->bytes);
+    free(matcher->literals);
+    free(matcher->edge_start);
+    free(matcher->edge_label);
+    free(matcher->edge_child);
+    free(matcher->fail);
+    free(matcher->best);
+    free(matcher);
+}
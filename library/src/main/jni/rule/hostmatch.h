@@ -0,0 +1,50 @@
+#ifndef PATH_HOSTMATCH_H
+#define PATH_HOSTMATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One Aho-Corasick automaton for a whole list of hostname rules.
+ *
+ * ACL hostname rules are regexes, but nearly all of them are literal domains written as
+ * `(^|\.)example\.com$`, `^example\.com$` or a bare keyword. Every rule in that subset (escaped
+ * and plain characters, `^`, `$`, groups with `|`, `?`) is expanded into the literal strings it
+ * matches, with the anchors as marker bytes, and all of them go into a single automaton. A lookup
+ * then runs once over the host, whatever the number of rules. The automaton is built over reversed
+ * strings, so the domains' shared endings (`.com`, `.google.com`) share states.
+ */
+
+#define HOSTMATCH_NONE UINT32_MAX
+
+struct hostmatch;
+
+struct hostmatch *hostmatch_new(void);
+
+/* Returns 1 if `pattern` is in the subset hostmatch_add() takes */
+int hostmatch_supported(const char *pattern);
+
+/* Adds rule `id`. Returns 0, 1 if the pattern is not in the supported subset (nothing is added)
+ * or -1 if out of memory. */
+int hostmatch_add(struct hostmatch *matcher, const char *pattern, uint32_t id);
+
+/* Compiles the added rules, no more can be added afterwards. Returns 0, or -1 if out of memory. */
+int hostmatch_build(struct hostmatch *matcher);
+
+/* Returns the lowest id among the rules matching `host`, HOSTMATCH_NONE if none does */
+uint32_t hostmatch_find(const struct hostmatch *matcher, const char *host, size_t len);
+
+/* Number of automaton states, for diagnostics */
+size_t hostmatch_states(const struct hostmatch *matcher);
+
+void hostmatch_free(struct hostmatch *matcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
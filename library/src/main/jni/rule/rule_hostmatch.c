@@ -0,0 +1,131 @@
+#include "rule.h"
+#include "hostmatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <android/log.h>
+
+#define LOG_TAG "rule"
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+#define MAX_LISTS 8
+
+/*
+ * ss-local is linked with -Wl,--wrap=init_rule,--wrap=add_rule,--wrap=remove_rule,--wrap=lookup_rule.
+ * Rules in hostmatch's literal subset are never compiled by PCRE; every list acl.c looks up gets one
+ * automaton for those, built on the first lookup after the list changed. The remaining rules are
+ * compiled and JIT studied, and only the ones ahead of the automaton's match in list order are run,
+ * so lookup_rule() still returns the first matching rule.
+ */
+
+int __real_init_rule(rule_t *rule);
+void __real_add_rule(struct cork_dllist *rules, rule_t *rule);
+void __real_remove_rule(rule_t *rule);
+rule_t *__real_lookup_rule(const struct cork_dllist *rules, const char *name, size_t name_len);
+
+struct fallback {
+    uint32_t index;
+    rule_t *rule;
+    pcre_extra *extra;
+};
+
+/* ss-local runs a single event loop thread, nothing here needs locking */
+static struct matcher {
+    const struct cork_dllist *rules;
+    unsigned generation;
+    struct hostmatch *automaton;    /* NULL if building failed, every rule is then run through PCRE */
+    rule_t **by_index;
+    struct fallback *fallbacks;
+    size_t fallback_count;
+} matchers[MAX_LISTS];
+static unsigned generation = 1;     /* bumped by every change to any list */
+
+static void clear(struct matcher *matcher)
+{
+    for (size_t i = 0; i < matcher->fallback_count; ++i) pcre_free_study(matcher->fallbacks[i].extra);
+    hostmatch_free(matcher->automaton);
+    free(matcher->by_index);
+    free(matcher->fallbacks);
+    memset(matcher, 0, sizeof(*matcher));
+}
+
+static int rebuild(struct matcher *matcher, const struct cork_dllist *rules)
+{
+    clear(matcher);
+    matcher->rules = rules;
+    matcher->generation = generation;
+    size_t count = cork_dllist_size(rules);
+    matcher->automaton = hostmatch_new();
+    matcher->by_index = malloc((count + 1) * sizeof(rule_t *));
+    matcher->fallbacks = malloc((count + 1) * sizeof(struct fallback));
+    if (matcher->automaton == NULL || matcher->by_index == NULL || matcher->fallbacks == NULL) goto fail;
+
+    uint32_t index = 0;
+    struct cork_dllist_item *item;
+    for (item = cork_dllist_start(rules); !cork_dllist_is_end(rules, item); item = item->next, ++index) {
+        rule_t *rule = cork_container_of(item, rule_t, entries);
+        matcher->by_index[index] = rule;
+        int added = hostmatch_add(matcher->automaton, rule->pattern, index);
+        if (added == -1) goto fail;
+        if (added == 0) continue;
+        if (!__real_init_rule(rule)) continue;  // logged by rule.c, such a rule never matches
+        const char *error = NULL;
+        struct fallback *fallback = &matcher->fallbacks[matcher->fallback_count++];
+        fallback->index = index;
+        fallback->rule = rule;
+        fallback->extra = pcre_study(rule->pattern_re, PCRE_STUDY_JIT_COMPILE, &error);
+        if (error != NULL) LOGW("cannot study \"%s\": %s", rule->pattern, error);
+    }
+    if (hostmatch_build(matcher->automaton) == -1) goto fail;
+    return 0;
+
+fail:
+    LOGW("out of memory, matching %zu rules one by one", count);
+    for (item = cork_dllist_start(rules); !cork_dllist_is_end(rules, item); item = item->next) {
+        __real_init_rule(cork_container_of(item, rule_t, entries));
+    }
+    clear(matcher);
+    matcher->rules = rules;
+    matcher->generation = generation;
+    return -1;
+}
+
+int __wrap_init_rule(rule_t *rule)
+{
+    // Literal rules are matched by the automaton, their regex would only take memory
+    if (rule->pattern_re == NULL && hostmatch_supported(rule->pattern)) return 1;
+    return __real_init_rule(rule);
+}
+
+void __wrap_add_rule(struct cork_dllist *rules, rule_t *rule)
+{
+    __real_add_rule(rules, rule);
+    ++generation;
+}
+
+void __wrap_remove_rule(rule_t *rule)
+{
+    // The automata still point at the rule, they are rebuilt before the next lookup
+    ++generation;
+    __real_remove_rule(rule);
+}
+
+rule_t *__wrap_lookup_rule(const struct cork_dllist *rules, const char *name, size_t name_len)
+{
+    struct matcher *matcher = NULL;
+    for (size_t i = 0; i < MAX_LISTS && matcher == NULL; ++i) {
+        if (matchers[i].rules == rules || matchers[i].rules == NULL) matcher = &matchers[i];
+    }
+    if (matcher == NULL) matcher = &matchers[0];    // more lists than acl.c has, share slot 0
+    if (matcher->rules != rules || matcher->generation != generation) rebuild(matcher, rules);
+    if (matcher->automaton == NULL) return __real_lookup_rule(rules, name, name_len);
+
+    uint32_t best = hostmatch_find(matcher->automaton, name, name_len);
+    for (size_t i = 0; i < matcher->fallback_count && matcher->fallbacks[i].index < best; ++i) {
+        const struct fallback *fallback = &matcher->fallbacks[i];
+        if (pcre_exec(fallback->rule->pattern_re, fallback->extra, name, (int) name_len, 0, 0, NULL, 0) >= 0) {
+            return fallback->rule;
+        }
+    }
+    return best == HOSTMATCH_NONE ? NULL : matcher->by_index[best];
+}
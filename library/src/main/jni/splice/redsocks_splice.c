@@ -0,0 +1,69 @@
+#include <errno.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+
+#include "log.h"
+#include "redsocks.h"
+#include "splice_relay.h"
+
+/*
+ * redsocks is linked with -Wl,--wrap=redsocks_start_relay, which socks4.c, socks5.c and
+ * http-connect.c call once the proxy accepted the connection. From there on redsocks only copies
+ * bytes, so instead of its bufferevents a splice_relay moves them, and the client is dropped when
+ * the relay is done. http-relay.c rewrites requests and keeps its own relay.
+ *
+ * The bufferevents stay in charge when they cannot be handed over cleanly: a side already shut
+ * down, output the handshake left unsent, input that cannot be written on at once, or no pipes.
+ * Everything that can fail is tried before the handshake state is released, so the fallback is
+ * redsocks' own relay as if nothing happened.
+ */
+
+void __real_redsocks_start_relay(redsocks_client *client);
+
+static void relay_done(struct splice_relay *relay, int error, void *arg)
+{
+    redsocks_client *client = arg;
+    if (error != 0) {
+        errno = error;
+        redsocks_log_errno(client, LOG_DEBUG, "splice");
+    }
+    splice_relay_free(relay);
+    redsocks_drop_client(client);
+}
+
+/* Writes what the handshake read ahead on `from` to the other socket, returns 0 if all of it went */
+static int flush_input(struct bufferevent *from, struct bufferevent *to)
+{
+    struct evbuffer *input = bufferevent_get_input(from);
+    while (evbuffer_get_length(input) > 0) {
+        if (evbuffer_write(input, bufferevent_getfd(to)) <= 0) return -1;
+    }
+    return 0;
+}
+
+void __wrap_redsocks_start_relay(redsocks_client *client)
+{
+    struct bufferevent *a = client->client, *b = client->relay;
+    if (client->client_evshut || client->relay_evshut ||
+        evbuffer_get_length(bufferevent_get_output(a)) > 0 || evbuffer_get_length(bufferevent_get_output(b)) > 0 ||
+        flush_input(a, b) == -1 || flush_input(b, a) == -1) {
+        __real_redsocks_start_relay(client);
+        return;
+    }
+    struct splice_relay *relay = splice_relay_new(bufferevent_get_base(a), bufferevent_getfd(a),
+                                                  bufferevent_getfd(b), relay_done, client);
+    if (relay == NULL) {
+        redsocks_log_errno(client, LOG_NOTICE, "splice_relay_new");
+        __real_redsocks_start_relay(client);
+        return;
+    }
+
+    if (client->instance->relay_ss->fini) client->instance->relay_ss->fini(client);
+    // redsocks_drop_client() frees them once the relay is done, until then they only hold the sockets
+    bufferevent_disable(a, EV_READ | EV_WRITE);
+    bufferevent_disable(b, EV_READ | EV_WRITE);
+    bufferevent_setcb(a, NULL, NULL, NULL, NULL);
+    bufferevent_setcb(b, NULL, NULL, NULL, NULL);
+    redsocks_touch_client(client);
+}
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include "splice_relay.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <event2/event.h>
+
+#define SPLICE_CHUNK (64 * 1024)    /* the default pipe capacity */
+#define SPLICE_ROUNDS 16            /* chunks per direction before other connections get a turn */
+#define POOL_PIPES 32
+
+struct direction {
+    struct splice_relay *relay;
+    int from;
+    int to;
+    int pipe[2];
+    size_t pending;             /* bytes in the pipe */
+    int eof;
+    int done;
+    struct event *readable;     /* on from, armed while the pipe is empty */
+    struct event *writable;     /* on to, armed while it is full */
+};
+
+struct splice_relay {
+    struct direction directions[2];
+    splice_relay_done_cb done;
+    void *arg;
+};
+
+/* Emptied pipes of finished relays, all relays run on one thread, nothing here needs locking */
+static int pool[POOL_PIPES][2];
+static size_t pooled;
+
+static int take_pipe(int fds[2])
+{
+    if (pooled == 0) return pipe2(fds, O_NONBLOCK | O_CLOEXEC);
+    --pooled;
+    fds[0] = pool[pooled][0];
+    fds[1] = pool[pooled][1];
+    return 0;
+}
+
+static void give_pipe(int fds[2], size_t pending)
+{
+    if (fds[0] == -1) return;
+    // A pipe with bytes left in it would hand them to the next relay
+    if (pending == 0 && pooled < POOL_PIPES) {
+        pool[pooled][0] = fds[0];
+        pool[pooled][1] = fds[1];
+        ++pooled;
+    } else {
+        close(fds[0]);
+        close(fds[1]);
+    }
+    fds[0] = fds[1] = -1;
+}
+
+static void wait_for(struct direction *d, int writable)
+{
+    event_del(writable ? d->readable : d->writable);
+    event_add(writable ? d->writable : d->readable, NULL);
+}
+
+/* Returns 0, or the errno that ends the relay */
+static int pump(struct direction *d)
+{
+    for (int round = 0; round < SPLICE_ROUNDS; ++round) {
+        while (d->pending > 0) {
+            ssize_t n = splice(d->pipe[0], NULL, d->to, NULL, d->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n == -1) {
+                if (errno != EAGAIN) return errno;
+                // Nothing more is read until the other side takes what is in the pipe
+                wait_for(d, 1);
+                return 0;
+            }
+            d->pending -= (size_t) n;
+        }
+        if (d->eof) {
+            shutdown(d->to, SHUT_WR);
+            event_del(d->readable);
+            event_del(d->writable);
+            d->done = 1;
+            return 0;
+        }
+        ssize_t n = splice(d->from, NULL, d->pipe[1], NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n == 0) {
+            d->eof = 1;
+        } else if (n == -1) {
+            if (errno != EAGAIN) return errno;
+            wait_for(d, 0);
+            return 0;
+        } else {
+            d->pending = (size_t) n;
+        }
+    }
+    // Both events are level triggered, whichever is armed comes back on the next loop iteration
+    wait_for(d, d->pending > 0);
+    return 0;
+}
+
+static void on_event(evutil_socket_t fd, short what, void *arg)
+{
+    (void) fd;
+    (void) what;
+    struct direction *d = arg;
+    struct splice_relay *relay = d->relay;
+    int error = pump(d);
+    if (error == 0 && !(relay->directions[0].done && relay->directions[1].done)) return;
+    for (int i = 0; i < 2; ++i) {
+        event_del(relay->directions[i].readable);
+        event_del(relay->directions[i].writable);
+    }
+    relay->done(relay, error, relay->arg);
+}
+
+struct splice_relay *splice_relay_new(struct event_base *base, int a, int b, splice_relay_done_cb done,
+                                      void *arg)
+{
+    struct splice_relay *relay = calloc(1, sizeof(*relay));
+    if (relay == NULL) return NULL;
+    relay->done = done;
+    relay->arg = arg;
+    for (int i = 0; i < 2; ++i) {
+        struct direction *d = &relay->directions[i];
+        d->relay = relay;
+        d->from = i == 0 ? a : b;
+        d->to = i == 0 ? b : a;
+        d->pipe[0] = d->pipe[1] = -1;
+    }
+    for (int i = 0; i < 2; ++i) {
+        struct direction *d = &relay->directions[i];
+        if (take_pipe(d->pipe) == -1) goto fail;
+        d->readable = event_new(base, d->from, EV_READ | EV_PERSIST, on_event, d);
+        d->writable = event_new(base, d->to, EV_WRITE | EV_PERSIST, on_event, d);
+        if (d->readable == NULL || d->writable == NULL) {
+            errno = ENOMEM;
+            goto fail;
+        }
+    }
+    for (int i = 0; i < 2; ++i) event_add(relay->directions[i].readable, NULL);
+    return relay;
+
+fail:;
+    int saved = errno;
+    splice_relay_free(relay);
+    errno = saved;
+    return NULL;
+}
+
+void splice_relay_free(struct splice_relay *relay)
+{
+    for (int i = 0; i < 2; ++i) {
+        struct direction *d = &relay->directions[i];
+        if (d->readable != NULL) event_free(d->readable);
+        if (d->writable != NULL) event_free(d->writable);
+        give_pipe(d->pipe, d->pending);
+    }
+    free(relay);
+}
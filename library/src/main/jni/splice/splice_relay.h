@@ -0,0 +1,36 @@
+#ifndef PATH_SPLICE_RELAY_H
+#define PATH_SPLICE_RELAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Relays two connected, non-blocking sockets with splice(): every direction moves the bytes from
+ * one socket into a pipe and out of it into the other, so they never leave the kernel. The pipes
+ * come from a pool, one pipe per direction, and go back to it when the relay is freed.
+ *
+ * EOF on one socket shuts down writing on the other once everything before it went out, the other
+ * direction carries on. When both are finished, or either fails, the relay stops and `done` runs
+ * with 0 or the errno. It is the owner's to free the relay and close the sockets then, from the
+ * callback if it likes.
+ *
+ * The pool is not thread-safe: all relays have to run on one event loop thread.
+ */
+
+struct event_base;
+struct splice_relay;
+
+typedef void (*splice_relay_done_cb)(struct splice_relay *relay, int error, void *arg);
+
+/* Returns NULL, with errno set, if no pipes or events could be had */
+struct splice_relay *splice_relay_new(struct event_base *base, int a, int b, splice_relay_done_cb done,
+                                      void *arg);
+
+void splice_relay_free(struct splice_relay *relay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
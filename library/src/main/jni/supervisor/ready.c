@@ -0,0 +1,49 @@
+#include "ready.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * ss-local and obfs-local are linked with -Wl,--wrap=listen. Both call listen() once for their local
+ * port, so the first one that succeeds is the event to report.
+ *
+ * The helpers are single-threaded, nothing here needs locking.
+ */
+
+int __real_listen(int fd, int backlog);
+
+static int ready_fd = -1;
+static int reported;
+
+/* The variable stays in the environment, but the descriptor is kept from plugins and other
+ * children, so only the helper itself reports. */
+__attribute__((constructor))
+static void ready_init(void)
+{
+    const char *env = getenv(READY_FD_ENV);
+    struct stat st;
+    if (env == NULL) return;
+    int fd = atoi(env);
+    if (fd > 2 && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode) && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0)
+        ready_fd = fd;
+}
+
+void ready_report(int event)
+{
+    if (ready_fd == -1 || (reported & event)) return;
+    reported |= event;
+    unsigned char byte = (unsigned char) event;
+    ssize_t n;
+    do n = write(ready_fd, &byte, 1); while (n == -1 && errno == EINTR);
+}
+
+int __wrap_listen(int fd, int backlog)
+{
+    int ret = __real_listen(fd, backlog);
+    if (ret == 0) ready_report(READY_LISTENING);
+    return ret;
+}
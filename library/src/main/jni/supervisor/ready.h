@@ -0,0 +1,28 @@
+#ifndef PATH_SUPERVISOR_READY_H
+#define PATH_SUPERVISOR_READY_H
+
+/*
+ * Readiness events a helper reports to the supervisor that spawned it, see supervisor.h.
+ *
+ * The supervisor hands every child the write end of a pipe and names its descriptor in the
+ * READY_FD_ENV environment variable. Each event is a single byte holding one READY_ bit and goes
+ * out at most once per process, so the app can wait for it instead of probing the helper's port.
+ */
+
+#define READY_FD_ENV "PATH_READY_FD"
+
+#define READY_LISTENING 1   /* the first listen() succeeded, clients can connect */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Helper side: reports `event` unless it went out already or the helper was not spawned by the
+ * supervisor. */
+void ready_report(int event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,495 @@
+#include "supervisor.h"
+#include "ready.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <android/log.h>
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434     // same number on every architecture
+#endif
+
+#define LOG_TAG "supervisor"
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+namespace supervisor {
+
+static const int64_t QUICK_EXIT_NANOS = 1000000000LL;   // what the Java guard threads called "exit too fast"
+static const int64_t MIN_BACKOFF_NANOS = 250000000LL;   // doubled for every further quick exit
+static const int MAX_QUICK_EXITS = 5;
+static const int64_t SWEEP_NANOS = 1000000000LL;  // without pidfds, SIGCHLD may be taken by any other thread of the app
+static const int64_t SOON_SWEEP_NANOS = 10000000LL;     // after a kill or a hangup, when an exit is expected
+static const size_t MAX_LINE_LENGTH = 1024;
+static const int MAX_EVENTS = 16;
+static const int READY_FD = 3;          // where children find the write end of their readiness pipe
+
+enum Source {
+    SOURCE_WAKE = 0,
+    SOURCE_SIGCHLD,
+    SOURCE_PIDFD,
+    SOURCE_OUTPUT,
+    SOURCE_READY,
+};
+
+struct Child {
+    std::vector<std::string> argv;
+    std::string tag;
+    State state = STATE_STARTING;
+    pid_t pid = 0;
+    int pidfd = -1;
+    int output = -1;        // read end of the pipe behind the child's stdout and stderr
+    int ready = -1;         // read end of the pipe the child reports readiness events through
+    unsigned events = 0;    // READY_ bits reported since the last spawn
+    int error = 0;          // why the first spawn failed, reported by start()
+    int restarts = 0;
+    int quickExits = 0;
+    int exitCode = -1;
+    int64_t startedNanos = 0;
+    int64_t deadlineNanos = 0;  // respawn in STATE_BACKOFF, SIGKILL in STATE_STOPPING
+    std::string line;
+};
+
+// Guarded by `mutex`, which the supervisor thread only lets go of while it sits in epoll_wait()
+static std::mutex mutex;
+static std::condition_variable changed;
+static std::map<int, Child> children;
+static int nextHandle = 1;
+static int epfd = -1, wakefd = -1, sigfd = -1;
+static bool pidfds;
+static int64_t sweepNanos;  // next waitpid() round over all children when pidfds are not available
+
+static int64_t nowNanos() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Android's app seccomp filter kills the process on syscalls it does not know, pidfd_open() is allowed from 12 on
+static bool pidfdAllowed() {
+#ifdef __ANDROID__
+    char sdk[PROP_VALUE_MAX] = "";
+    __system_property_get("ro.build.version.sdk", sdk);
+    return atoi(sdk) >= 31;
+#else
+    return true;
+#endif
+}
+
+static void watch(int fd, int handle, Source source) {
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = uint64_t(handle) << 3 | source;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void closeFd(int &fd) {
+    if (fd == -1) return;
+    close(fd);              // also drops it from the epoll set
+    fd = -1;
+}
+
+static void wake() {
+    uint64_t one = 1;
+    write(wakefd, &one, sizeof(one));
+}
+
+// Called on the supervisor thread: SIGCHLD has to be blocked there for signalfd() to see it
+static void watchSigchld() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    sigfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigfd != -1) watch(sigfd, 0, SOURCE_SIGCHLD);
+}
+
+static void flushLine(Child &child) {
+    if (child.line.empty()) return;
+    __android_log_print(ANDROID_LOG_INFO, child.tag.c_str(), "%s", child.line.c_str());
+    child.line.clear();
+}
+
+static void drainOutput(Child &child) {
+    char buffer[4096];
+    for (;;) {
+        ssize_t length = read(child.output, buffer, sizeof(buffer));
+        if (length > 0) {
+            for (ssize_t i = 0; i < length; ++i) {
+                if (buffer[i] == '\n') flushLine(child); else {
+                    child.line += buffer[i];
+                    if (child.line.size() >= MAX_LINE_LENGTH) flushLine(child);
+                }
+            }
+            continue;
+        }
+        if (length == -1 && errno == EINTR) continue;
+        if (length == 0 || errno != EAGAIN) {
+            flushLine(child);
+            closeFd(child.output);
+        }
+        return;
+    }
+}
+
+static void readEvents(Child &child) {
+    uint8_t events[16];
+    ssize_t length;
+    while ((length = read(child.ready, events, sizeof(events))) > 0) {
+        for (ssize_t i = 0; i < length; ++i) child.events |= events[i];
+        changed.notify_all();
+    }
+    if (length == 0 || (errno != EAGAIN && errno != EINTR)) closeFd(child.ready);
+}
+
+// Descriptors a child would inherit: whatever the app opened without O_CLOEXEC
+static std::vector<int> inheritableFds() {
+    std::vector<int> fds;
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == nullptr) return fds;
+    while (dirent *entry = readdir(dir)) {
+        int fd = atoi(entry->d_name);
+        if (fd > 2 && fd != dirfd(dir) && fcntl(fd, F_GETFD) == 0) fds.push_back(fd);
+    }
+    closedir(dir);
+    return fds;
+}
+
+// posix_spawn() only made it into bionic with API 28, so do what it does underneath: vfork() lends the child our
+// memory until execve(), which leaves it to async-signal-safe calls only, with everything prepared up front and a
+// failed exec reported back through `error`. All signals stay blocked in between so that none of the app's handlers
+// runs on the borrowed stack.
+static pid_t spawn(const Child &child, int output, int ready) {
+    int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (devnull == -1) return -1;
+    std::vector<char *> argv;
+    for (auto &arg : child.argv) argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+    char readyEnv[32];
+    snprintf(readyEnv, sizeof(readyEnv), READY_FD_ENV "=%d", READY_FD);
+    std::vector<char *> envp;
+    for (char **env = environ; *env != nullptr; ++env) {
+        if (strncmp(*env, readyEnv, sizeof(READY_FD_ENV)) != 0) envp.push_back(*env);
+    }
+    envp.push_back(readyEnv);
+    envp.push_back(nullptr);
+    std::vector<int> inherited = inheritableFds();
+    struct sigaction dfl;
+    memset(&dfl, 0, sizeof(dfl));
+    dfl.sa_handler = SIG_DFL;
+    sigset_t all, none, old;
+    sigfillset(&all);
+    sigemptyset(&none);
+    volatile int error = 0;
+
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pid_t pid = vfork();
+    if (pid == 0) {
+        for (int sig = 1; sig < NSIG; ++sig) sigaction(sig, &dfl, nullptr);
+        for (int fd : inherited) close(fd);
+        // Killed along with the supervisor thread, which lives as long as the app process
+        // dup2() onto itself would keep FD_CLOEXEC
+        if (dup2(devnull, 0) == -1 || dup2(output, 1) == -1 || dup2(output, 2) == -1 ||
+            (ready == READY_FD ? fcntl(ready, F_SETFD, 0) : dup2(ready, READY_FD)) == -1 ||
+            prctl(PR_SET_PDEATHSIG, SIGKILL) == -1) {
+            error = errno;
+            _exit(127);
+        }
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        execve(argv[0], argv.data(), envp.data());
+        error = errno;
+        _exit(127);
+    }
+    int err = pid == -1 ? errno : error;
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    close(devnull);
+    if (err == 0) return pid;
+    if (pid != -1) waitpid(pid, nullptr, 0);
+    errno = err;
+    return -1;
+}
+
+static bool respawn(int handle, Child &child) {
+    int pipefd[2], readyfd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1) return false;
+    if (pipe2(readyfd, O_CLOEXEC) == -1) {
+        int err = errno;
+        close(pipefd[0]);
+        close(pipefd[1]);
+        errno = err;
+        return false;
+    }
+    pid_t pid = spawn(child, pipefd[1], readyfd[1]);
+    int err = errno;
+    close(pipefd[1]);
+    close(readyfd[1]);
+    if (pid == -1) {
+        close(pipefd[0]);
+        close(readyfd[0]);
+        errno = err;
+        return false;
+    }
+    child.pid = pid;
+    child.startedNanos = nowNanos();
+    child.events = 0;
+    child.output = pipefd[0];
+    fcntl(child.output, F_SETFL, O_NONBLOCK);
+    watch(child.output, handle, SOURCE_OUTPUT);
+    child.ready = readyfd[0];
+    fcntl(child.ready, F_SETFL, O_NONBLOCK);
+    watch(child.ready, handle, SOURCE_READY);
+    if (pidfds) {
+        child.pidfd = int(syscall(__NR_pidfd_open, pid, 0));
+        if (child.pidfd != -1) watch(child.pidfd, handle, SOURCE_PIDFD); else if (errno == ENOSYS) {
+            LOGW("pidfd_open() not supported, falling back to SIGCHLD");
+            pidfds = false;
+            watchSigchld();
+        }
+    }
+    return true;
+}
+
+static void exited(Child &child, int status) {
+    if (child.output != -1) drainOutput(child);
+    flushLine(child);
+    closeFd(child.output);  // a forked grandchild may still hold the pipe open
+    closeFd(child.ready);
+    closeFd(child.pidfd);
+    child.pid = 0;
+    child.events = 0;
+    child.exitCode = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    changed.notify_all();
+    if (child.state == STATE_STOPPING) {
+        child.state = STATE_STOPPED;
+        return;
+    }
+    int64_t now = nowNanos();
+    child.quickExits = now - child.startedNanos < QUICK_EXIT_NANOS ? child.quickExits + 1 : 0;
+    if (child.quickExits >= MAX_QUICK_EXITS) {
+        __android_log_print(ANDROID_LOG_WARN, child.tag.c_str(), "exit too fast %d times in a row, giving up",
+                            child.quickExits);
+        child.state = STATE_FAILED;
+        return;
+    }
+    int64_t delay = child.quickExits == 0 ? 0 : MIN_BACKOFF_NANOS << (child.quickExits - 1);
+    __android_log_print(ANDROID_LOG_WARN, child.tag.c_str(), "exited with %d, restarting in %d ms",
+                        child.exitCode, int(delay / 1000000));
+    child.state = STATE_BACKOFF;
+    child.deadlineNanos = now + delay;
+}
+
+static void reap(Child &child) {
+    if (child.pid == 0) return;
+    int status;
+    pid_t pid;
+    do pid = waitpid(child.pid, &status, WNOHANG); while (pid == -1 && errno == EINTR);
+    if (pid == child.pid) exited(child, status);
+    else if (pid == -1 && errno == ECHILD) exited(child, 0);     // reaped behind our back
+}
+
+// Spawns what is due and escalates overdue stops. Returns the epoll_wait() timeout until the next deadline.
+static int advance() {
+    int64_t now = nowNanos(), next = INT64_MAX;
+    bool running = false;
+    for (auto &entry : children) {
+        Child &child = entry.second;
+        switch (child.state) {
+            case STATE_BACKOFF:
+                if (now < child.deadlineNanos) {
+                    next = std::min(next, child.deadlineNanos);
+                    break;
+                }
+                // fall through
+            case STATE_STARTING:
+                if (respawn(entry.first, child)) {
+                    if (child.state == STATE_BACKOFF) ++child.restarts;
+                    child.state = STATE_RUNNING;
+                } else {
+                    child.error = errno;
+                    __android_log_print(ANDROID_LOG_ERROR, child.tag.c_str(), "spawn %s: %s", child.argv[0].c_str(),
+                                        strerror(errno));
+                    child.state = STATE_FAILED;
+                }
+                changed.notify_all();
+                break;
+            case STATE_STOPPING:
+                if (now >= child.deadlineNanos) {
+                    kill(child.pid, SIGKILL);
+                    child.deadlineNanos = INT64_MAX;
+                    sweepNanos = std::min(sweepNanos, now + SOON_SWEEP_NANOS);
+                } else next = std::min(next, child.deadlineNanos);
+                break;
+            default:
+                break;
+        }
+        if (child.pid != 0) running = true;
+    }
+    if (running && !pidfds) next = std::min(next, sweepNanos);
+    return next == INT64_MAX ? -1 : int((next - now + 999999) / 1000000);
+}
+
+static void *loop(void *) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!pidfds) watchSigchld();
+    epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int timeout = advance();
+        lock.unlock();
+        int count = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        lock.lock();
+        if (!pidfds && nowNanos() >= sweepNanos) {
+            sweepNanos = nowNanos() + SWEEP_NANOS;
+            for (auto &entry : children) reap(entry.second);
+        }
+        for (int i = 0; i < count; ++i) {
+            auto source = Source(events[i].data.u64 & 7);
+            if (source == SOURCE_WAKE) {
+                uint64_t value;
+                read(wakefd, &value, sizeof(value));
+                continue;
+            }
+            if (source == SOURCE_SIGCHLD) {
+                signalfd_siginfo info;
+                while (read(sigfd, &info, sizeof(info)) > 0) {}
+                for (auto &entry : children) reap(entry.second);
+                continue;
+            }
+            // Events may be stale by now: the child could have been respawned or stopped in the meantime
+            auto it = children.find(int(events[i].data.u64 >> 3));
+            if (it == children.end()) continue;
+            Child &child = it->second;
+            if (source == SOURCE_PIDFD) reap(child);
+            else if (source == SOURCE_READY) {
+                if (child.ready != -1) readEvents(child);
+            } else if (child.output != -1) {
+                drainOutput(child);
+                if (child.output == -1 && !pidfds) {   // hung up, most likely exiting
+                    reap(child);
+                    sweepNanos = std::min(sweepNanos, nowNanos() + SOON_SWEEP_NANOS);
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
+static bool ensureStarted() {
+    if (epfd != -1) return true;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pthread_t thread;
+    int err = errno;
+    if (epfd != -1 && wakefd != -1) {
+        watch(wakefd, 0, SOURCE_WAKE);
+        pidfds = pidfdAllowed();
+        err = pthread_create(&thread, nullptr, loop, nullptr);
+        if (err == 0) {
+            pthread_detach(thread);
+            return true;
+        }
+    }
+    closeFd(epfd);
+    closeFd(wakefd);
+    errno = err;
+    return false;
+}
+
+int start(const std::vector<std::string> &argv, const std::string &tag) {
+    if (argv.empty()) {
+        errno = EINVAL;
+        return -1;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!ensureStarted()) return -1;
+    int handle = nextHandle++;
+    Child &child = children[handle];
+    child.argv = argv;
+    child.tag = tag;
+    wake();
+    changed.wait(lock, [&child] { return child.state != STATE_STARTING; });
+    if (child.state == STATE_FAILED) {
+        int err = child.error;
+        children.erase(handle);
+        errno = err;
+        return -1;
+    }
+    return handle;
+}
+
+void stop(const std::vector<int> &handles, int graceMillis) {
+    std::unique_lock<std::mutex> lock(mutex);
+    int64_t deadline = nowNanos() + graceMillis * 1000000LL;
+    for (int handle : handles) {
+        auto it = children.find(handle);
+        if (it == children.end()) continue;
+        Child &child = it->second;
+        if (child.state == STATE_RUNNING) {
+            kill(child.pid, SIGTERM);
+            child.state = STATE_STOPPING;
+            child.deadlineNanos = deadline;
+            sweepNanos = std::min(sweepNanos, nowNanos() + SOON_SWEEP_NANOS);
+        } else if (child.state != STATE_STOPPING) child.state = STATE_STOPPED;
+    }
+    wake();
+    changed.wait(lock, [&handles] {
+        for (int handle : handles) {
+            auto it = children.find(handle);
+            if (it != children.end() && it->second.state != STATE_STOPPED) return false;
+        }
+        return true;
+    });
+    for (int handle : handles) children.erase(handle);
+}
+
+bool status(int handle, Status *status) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = children.find(handle);
+    if (it == children.end()) return false;
+    const Child &child = it->second;
+    status->state = child.state;
+    status->pid = child.pid;
+    status->restarts = child.restarts;
+    status->exitCode = child.exitCode;
+    status->events = child.events;
+    return true;
+}
+
+bool await(int handle, unsigned events, int timeoutMillis) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMillis);
+    bool ready = false;
+    changed.wait_until(lock, deadline, [handle, events, &ready] {
+        auto it = children.find(handle);
+        if (it == children.end()) return true;
+        const Child &child = it->second;
+        ready = (child.events & events) == events;
+        return ready || child.state == STATE_STOPPING || child.state == STATE_STOPPED || child.state == STATE_FAILED;
+    });
+    return ready;
+}
+
+}
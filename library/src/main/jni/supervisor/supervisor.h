@@ -0,0 +1,52 @@
+#ifndef PATH_SUPERVISOR_SUPERVISOR_H
+#define PATH_SUPERVISOR_SUPERVISOR_H
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// Keeps the native helpers running from a single thread: children are spawned with vfork() + execve(),
+// their exits are noticed through pidfds (signalfd(SIGCHLD) and a periodic waitpid() sweep before Android 12
+// or on kernels older than 5.3), their merged stdout/stderr is forwarded to logcat line by line and their
+// readiness events (see ready.h) are collected, all from one epoll loop. Children get PR_SET_PDEATHSIG, so
+// nothing outlives the app process.
+
+namespace supervisor {
+
+enum State {
+    STATE_STARTING = 0,     // queued for the supervisor thread to spawn
+    STATE_RUNNING,
+    STATE_BACKOFF,          // exited on its own, respawned once the backoff delay elapses
+    STATE_STOPPING,         // SIGTERM sent, SIGKILL follows after the grace period
+    STATE_STOPPED,
+    STATE_FAILED,           // kept exiting right after being spawned, given up on
+};
+
+struct Status {
+    State state;
+    pid_t pid;              // 0 unless running or stopping
+    int restarts;           // respawns after the child exited on its own
+    int exitCode;           // last exit: status, 128 + signal number if killed, -1 if it has not exited yet
+    unsigned events;        // READY_ bits the running child reported
+};
+
+// Spawns `argv` (argv[0] is an absolute path) and respawns it whenever it exits, with a backoff that grows
+// while it keeps exiting within a second. Output lines are logged under `tag`.
+// Returns a handle or -1 with errno set, to the exec failure if the child could not be started.
+int start(const std::vector<std::string> &argv, const std::string &tag);
+
+// Sends SIGTERM to every child in `handles` at once, SIGKILL to those still around after `graceMillis`,
+// and returns once all of them are reaped. The handles are invalid afterwards.
+void stop(const std::vector<int> &handles, int graceMillis);
+
+// Returns false if `handle` is unknown.
+bool status(int handle, Status *status);
+
+// Waits up to `timeoutMillis` for the child behind `handle` to report all READY_ bits in `events`, across respawns.
+// Returns false on timeout, once the child is being stopped or was given up on, or if `handle` is unknown.
+bool await(int handle, unsigned events, int timeoutMillis);
+
+}
+
+#endif
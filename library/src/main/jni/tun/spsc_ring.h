@@ -0,0 +1,63 @@
+#ifndef PATH_SPSC_RING_H
+#define PATH_SPSC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*
+ * Single producer, single consumer packet ring. It lives in memory shared between tun2socks shards,
+ * so it is a plain struct of fixed size without pointers, and the indices are only ever touched
+ * through atomic builtins, which stay lock-free across processes.
+ */
+
+#define SPSC_RING_SLOTS 256     /* power of two */
+#define SPSC_RING_SLOT 2048     /* holds a 1500 byte MTU packet with room to spare */
+
+struct spsc_slot {
+    uint16_t len;
+    unsigned char data[SPSC_RING_SLOT - sizeof(uint16_t)];
+};
+
+struct spsc_ring {
+    uint32_t head;              /* next slot the producer fills */
+    char pad0[60];
+    uint32_t tail;              /* next slot the consumer takes */
+    char pad1[60];
+    struct spsc_slot slots[SPSC_RING_SLOTS];
+};
+
+/* Returns 0 if `len` does not fit a slot or the ring is full */
+static inline int spsc_ring_push(struct spsc_ring *ring, const void *data, size_t len)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    if (len > sizeof(ring->slots[0].data) ||
+        head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == SPSC_RING_SLOTS) {
+        return 0;
+    }
+    struct spsc_slot *slot = &ring->slots[head % SPSC_RING_SLOTS];
+    memcpy(slot->data, data, len);
+    slot->len = (uint16_t) len;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Returns the packet length, truncated to `len` like a read() would, or -1 if the ring is empty */
+static inline ssize_t spsc_ring_pop(struct spsc_ring *ring, void *buf, size_t len)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) return -1;
+    const struct spsc_slot *slot = &ring->slots[tail % SPSC_RING_SLOTS];
+    size_t copied = slot->len < len ? slot->len : len;
+    memcpy(buf, slot->data, copied);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return (ssize_t) copied;
+}
+
+static inline size_t spsc_ring_size(struct spsc_ring *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/if_tun.h>
+#include <android/log.h>
+
+#include "tun_offload.h"
+#include "tun_shard.h"
+
+#define LOG_TAG "tun-batch"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+#ifdef __BIONIC__
+typedef int ioctl_request;
+#else
+typedef unsigned long ioctl_request;
+#endif
+
+/*
+ * tun2socks is linked with -Wl,--wrap=ioctl,--wrap=read,--wrap=write,--wrap=epoll_wait, which puts
+ * a TUN device that BTap.c opens itself (--tundev) in IFF_VNET_HDR mode with TCP segmentation
+ * offload, behind BTap's back:
+ *
+ * - ioctl(TUNSETIFF) asks for IFF_VNET_HDR and TUN_F_CSUM|TUN_F_TSO4|TUN_F_TSO6, and falls back to
+ *   the plain device the caller asked for if the kernel refuses.
+ * - read() takes one packet from the kernel, up to 64 KiB of coalesced TCP, and hands it out one MTU
+ *   sized segment per call. BTap reads until EAGAIN, so lwIP gets the whole super-segment before
+ *   the reactor polls again.
+ * - write() queues lwIP's TCP data segments while they continue one flow and sends them as one
+ *   super-segment, anything else flushes the queue and goes out behind an empty header.
+ * - epoll_wait() flushes the queue before BReactor blocks.
+ *
+ * A descriptor from VpnService (--sock-path) is attached without IFF_VNET_HDR and cannot be
+ * switched, it keeps the packet per call path and only pays a compare here. In a sharded tun2socks
+ * the same calls go to the shard's rings instead, see tun_shard.c.
+ */
+
+int __real_ioctl(int fd, ioctl_request request, ...);
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+/* tun2socks runs BTap on the reactor thread only, nothing here needs locking */
+static int tun_fd = -1;
+static struct virtio_net_hdr rx_hdr;
+static unsigned char *rx_packet;        /* super-segment being handed out */
+static size_t rx_len;
+static size_t rx_count;
+static size_t rx_next;
+static struct tun_coalescer *tx;
+
+static void enable_offload(int fd, struct ifreq *ifr, ioctl_request request)
+{
+    if ((rx_packet == NULL && (rx_packet = malloc(TUN_MAX_PACKET)) == NULL) ||
+        (tx == NULL && (tx = calloc(1, sizeof(*tx))) == NULL)) {
+        return;
+    }
+    struct ifreq vnet = *ifr;
+    vnet.ifr_flags |= IFF_VNET_HDR;
+    if (__real_ioctl(fd, request, &vnet) == -1) return;
+    // 10 bytes is the default, set in case something else changed it
+    int hdr_size = sizeof(struct virtio_net_hdr);
+    __real_ioctl(fd, TUNSETVNETHDRSZ, &hdr_size);
+    if (__real_ioctl(fd, TUNSETOFFLOAD, (unsigned long) (TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6)) == -1) {
+        // Still fine, the kernel then segments and checksums everything itself
+        LOGW("no segmentation offload on %s: %s", vnet.ifr_name, strerror(errno));
+    } else {
+        LOGI("segmentation offload on %s", vnet.ifr_name);
+    }
+    memcpy(ifr->ifr_name, vnet.ifr_name, sizeof(ifr->ifr_name));
+    tun_fd = fd;
+}
+
+int __wrap_ioctl(int fd, ioctl_request request, ...)
+{
+    va_list args;
+    va_start(args, request);
+    void *arg = va_arg(args, void *);
+    va_end(args);
+    if (request == (ioctl_request) TUNSETIFF && tun_fd == -1) {
+        struct ifreq *ifr = arg;
+        if ((ifr->ifr_flags & (IFF_TUN | IFF_TAP | IFF_VNET_HDR)) == IFF_TUN) {
+            enable_offload(fd, ifr, request);
+            if (tun_fd == fd) return 0;
+        }
+    }
+    return __real_ioctl(fd, request, arg);
+}
+
+static ssize_t next_segment(void *buf, size_t count)
+{
+    return (ssize_t) tun_gso_segment(&rx_hdr, rx_packet, rx_len, rx_next++, buf, count);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+    if ((fd != tun_fd && fd != tun_shard_fd) || fd < 0) return __real_read(fd, buf, count);
+    if (fd == tun_shard_fd) return tun_shard_read(buf, count);
+    if (rx_next < rx_count) return next_segment(buf, count);
+
+    for (;;) {
+        // Plain packets land in the caller's buffer, a super-segment continues in rx_packet
+        size_t head = count < TUN_MAX_PACKET ? count : TUN_MAX_PACKET;
+        struct iovec iov[3] = {
+            {&rx_hdr, sizeof(rx_hdr)},
+            {buf, head},
+            {rx_packet + head, TUN_MAX_PACKET - head},
+        };
+        ssize_t ret = readv(fd, iov, iov[2].iov_len > 0 ? 3 : 2);
+        if (ret < (ssize_t) sizeof(rx_hdr)) return ret < 0 ? ret : 0;
+        size_t len = (size_t) ret - sizeof(rx_hdr);
+        if ((rx_hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) == VIRTIO_NET_HDR_GSO_NONE) {
+            if (len > head) return (ssize_t) head;
+            return (ssize_t) tun_gso_segment(&rx_hdr, buf, len, 0, buf, count);
+        }
+        memcpy(rx_packet, buf, len < head ? len : head);
+        rx_len = len;
+        rx_count = tun_gso_count(&rx_hdr, rx_packet, len);
+        rx_next = 0;
+        if (rx_count > 0) return next_segment(buf, count);
+        LOGW("dropping a malformed super-segment of %zu bytes", len);
+    }
+}
+
+static void flush(void)
+{
+    struct virtio_net_hdr hdr;
+    size_t len = tun_coalesce_finish(tx, &hdr);
+    struct iovec iov[2] = {{&hdr, sizeof(hdr)}, {tx->packet, len}};
+    // write() already reported these as sent, a failure loses them like any dropped packet
+    if (writev(tun_fd, iov, 2) == -1 && errno != EAGAIN && errno != ENOBUFS) {
+        LOGW("writev: %s", strerror(errno));
+    }
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+    if ((fd != tun_fd && fd != tun_shard_fd) || fd < 0) return __real_write(fd, buf, count);
+    if (fd == tun_shard_fd) return tun_shard_write(buf, count);
+    if (tun_coalesce(tx, buf, count)) return (ssize_t) count;
+    if (tx->len > 0) {
+        flush();
+        if (tun_coalesce(tx, buf, count)) return (ssize_t) count;
+    }
+    struct virtio_net_hdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    struct iovec iov[2] = {{&hdr, sizeof(hdr)}, {(void *) buf, count}};
+    ssize_t ret = writev(fd, iov, 2);
+    return ret < (ssize_t) sizeof(hdr) ? (ret < 0 ? ret : 0) : ret - (ssize_t) sizeof(hdr);
+}
+
+int __wrap_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    if (tx != NULL && tx->len > 0) flush();
+    tun_shard_flush();
+    return __real_epoll_wait(epfd, events, maxevents, timeout);
+}
@@ -0,0 +1,247 @@
+#include "tun_offload.h"
+
+#include <string.h>
+
+#include "csum.h"
+
+#define IPV4_HEADER 20
+#define IPV6_HEADER 40
+#define PROTO_TCP 6
+#define PROTO_UDP 17
+#define TCP_CHECK 16            /* offset of the TCP checksum */
+#define UDP_CHECK 6
+
+#define TCP_FIN 0x01
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+#define TCP_CWR 0x80
+
+static uint16_t load16(const unsigned char *p)
+{
+    return (uint16_t) (p[0] << 8 | p[1]);
+}
+
+static uint32_t load32(const unsigned char *p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static void store16(unsigned char *p, uint16_t v)
+{
+    p[0] = (unsigned char) (v >> 8);
+    p[1] = (unsigned char) v;
+}
+
+static void store32(unsigned char *p, uint32_t v)
+{
+    store16(p, (uint16_t) (v >> 16));
+    store16(p + 2, (uint16_t) v);
+}
+
+/* Stores ~`sum`, which is in memory order, so the field ends up in network order */
+static void store_check(unsigned char *p, uint16_t sum)
+{
+    sum = (uint16_t) ~sum;
+    memcpy(p, &sum, sizeof(sum));
+}
+
+struct headers {
+    size_t ip_len;              /* 0 if the packet is not TCP over IPv4 without options or plain IPv6 */
+    size_t tcp_len;
+    int v6;
+};
+
+static void parse_tcp(const unsigned char *packet, size_t len, struct headers *h)
+{
+    h->ip_len = 0;
+    if (len < IPV4_HEADER) return;
+    switch (packet[0] >> 4) {
+    case 4:
+        // No options, no fragments
+        if (packet[0] != 0x45 || packet[9] != PROTO_TCP || (load16(packet + 6) & 0x3fff) != 0) return;
+        if (load16(packet + 2) != len) return;
+        h->v6 = 0;
+        h->ip_len = IPV4_HEADER;
+        break;
+    case 6:
+        if (len < IPV6_HEADER || packet[6] != PROTO_TCP || load16(packet + 4) + IPV6_HEADER != len) return;
+        h->v6 = 1;
+        h->ip_len = IPV6_HEADER;
+        break;
+    default:
+        return;
+    }
+    if (len < h->ip_len + 20) {
+        h->ip_len = 0;
+        return;
+    }
+    h->tcp_len = (size_t) (packet[h->ip_len + 12] >> 4) * 4;
+    if (h->tcp_len < 20 || h->ip_len + h->tcp_len > len) h->ip_len = 0;
+}
+
+/* Sum of the TCP pseudo header for `l4_len` bytes of segment */
+static uint16_t pseudo_sum(const unsigned char *packet, int v6, size_t l4_len)
+{
+    unsigned char pseudo[IPV6_HEADER];
+    if (v6) {
+        memcpy(pseudo, packet + 8, 32);
+        store32(pseudo + 32, (uint32_t) l4_len);
+        store32(pseudo + 36, PROTO_TCP);
+        return csum(pseudo, 40);
+    }
+    memcpy(pseudo, packet + 12, 8);
+    store16(pseudo + 8, PROTO_TCP);
+    store16(pseudo + 10, (uint16_t) l4_len);
+    return csum(pseudo, 12);
+}
+
+static void ipv4_check(unsigned char *ip)
+{
+    memset(ip + 10, 0, 2);
+    store_check(ip + 10, csum(ip, IPV4_HEADER));
+}
+
+size_t tun_gso_count(const struct virtio_net_hdr *hdr, const unsigned char *packet, size_t len)
+{
+    int type = hdr->gso_type & ~VIRTIO_NET_HDR_GSO_ECN;
+    if (type == VIRTIO_NET_HDR_GSO_NONE) return 1;
+    if (type != VIRTIO_NET_HDR_GSO_TCPV4 && type != VIRTIO_NET_HDR_GSO_TCPV6) return 0;
+    struct headers h;
+    parse_tcp(packet, len, &h);
+    if (h.ip_len == 0 || h.v6 != (type == VIRTIO_NET_HDR_GSO_TCPV6) || hdr->gso_size == 0) return 0;
+    size_t payload = len - h.ip_len - h.tcp_len;
+    return payload == 0 ? 1 : (payload + hdr->gso_size - 1) / hdr->gso_size;
+}
+
+/* The kernel leaves the pseudo header sum in the field, summing from csum_start completes it */
+static void complete_check(const struct virtio_net_hdr *hdr, unsigned char *packet, size_t len)
+{
+    size_t start = hdr->csum_start, field = start + hdr->csum_offset;
+    if (field + 2 > len) return;
+    uint16_t sum = csum(packet + start, len - start);
+    // UDP sends a checksum of 0 as all ones, 0 means none
+    if (hdr->csum_offset == UDP_CHECK && sum == 0xffff) sum = 0;
+    store_check(packet + field, sum);
+}
+
+size_t tun_gso_segment(const struct virtio_net_hdr *hdr, const unsigned char *packet, size_t len, size_t index,
+                       unsigned char *out, size_t out_len)
+{
+    if ((hdr->gso_type & ~VIRTIO_NET_HDR_GSO_ECN) == VIRTIO_NET_HDR_GSO_NONE) {
+        size_t copied = len < out_len ? len : out_len;
+        if (out != packet) memcpy(out, packet, copied);
+        if (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM && copied == len) complete_check(hdr, out, len);
+        return copied;
+    }
+
+    struct headers h;
+    parse_tcp(packet, len, &h);
+    size_t header_len = h.ip_len + h.tcp_len;
+    size_t offset = header_len + index * hdr->gso_size;
+    if (h.ip_len == 0 || offset > len || out_len < header_len) return 0;
+    size_t payload = len - offset < hdr->gso_size ? len - offset : hdr->gso_size;
+    int last = offset + payload == len;
+
+    memcpy(out, packet, header_len);
+    if (h.v6) {
+        store16(out + 4, (uint16_t) (h.tcp_len + payload));
+    } else {
+        store16(out + 2, (uint16_t) (header_len + payload));
+        store16(out + 4, (uint16_t) (load16(packet + 4) + index));
+        ipv4_check(out);
+    }
+    unsigned char *tcp = out + h.ip_len;
+    store32(tcp + 4, load32(packet + h.ip_len + 4) + (uint32_t) (index * hdr->gso_size));
+    if (!last) tcp[13] &= (unsigned char) ~(TCP_FIN | TCP_PSH);
+    if (index > 0) tcp[13] &= (unsigned char) ~TCP_CWR;
+
+    // Copied while summed, what does not fit is cut off like a short read() would
+    size_t copied = payload < out_len - header_len ? payload : out_len - header_len;
+    uint16_t sum = csum_copy(out + header_len, packet + offset, copied);
+    memset(tcp + TCP_CHECK, 0, 2);
+    sum = csum_add(sum, csum(tcp, h.tcp_len));
+    store_check(tcp + TCP_CHECK, csum_add(sum, pseudo_sum(out, h.v6, h.tcp_len + payload)));
+    return header_len + copied;
+}
+
+/* Whether `packet` continues the flow in `c`: same headers but for lengths, IDs, sequence and PSH */
+static int continues(const struct tun_coalescer *c, const unsigned char *packet, const struct headers *h)
+{
+    const unsigned char *first = c->packet;
+    if (h->v6) {
+        if ((first[0] >> 4) != 6 || memcmp(first, packet, 4) != 0 || memcmp(first + 6, packet + 6, 34) != 0) {
+            return 0;
+        }
+    } else {
+        if ((first[0] >> 4) != 4 || first[1] != packet[1] || memcmp(first + 6, packet + 6, 4) != 0 ||
+            memcmp(first + 12, packet + 12, 8) != 0 || load16(packet + 4) != c->next_id) {
+            return 0;
+        }
+    }
+    const unsigned char *a = first + h->ip_len, *b = packet + h->ip_len;
+    return memcmp(a, b, 4) == 0 && load32(b + 4) == c->next_seq && memcmp(a + 8, b + 8, 5) == 0 &&
+           (a[13] & ~TCP_PSH) == (b[13] & ~TCP_PSH) && memcmp(a + 14, b + 14, 2) == 0 &&
+           memcmp(a + 20, b + 20, h->tcp_len - 20) == 0;
+}
+
+int tun_coalesce(struct tun_coalescer *c, const unsigned char *packet, size_t len)
+{
+    struct headers h;
+    parse_tcp(packet, len, &h);
+    if (h.ip_len == 0) return 0;
+    size_t header_len = h.ip_len + h.tcp_len, payload = len - header_len;
+    unsigned char flags = packet[h.ip_len + 13];
+    // Data segments only, whatever else is in flight goes out as it is
+    if (payload == 0 || (flags & ~TCP_PSH) != TCP_ACK) return 0;
+
+    if (c->len == 0) {
+        memcpy(c->packet, packet, len);
+        c->len = len;
+        c->header_len = header_len;
+        c->segment_size = payload;
+        c->segments = 1;
+        c->closed = (flags & TCP_PSH) != 0;
+    } else {
+        if (c->closed || header_len != c->header_len || payload > c->segment_size ||
+            c->len + payload > TUN_MAX_PACKET || !continues(c, packet, &h)) {
+            return 0;
+        }
+        memcpy(c->packet + c->len, packet + header_len, payload);
+        c->len += payload;
+        ++c->segments;
+        // The kernel cuts segment_size chunks, a shorter one can only be the last
+        if (payload < c->segment_size || (flags & TCP_PSH)) c->closed = 1;
+        c->packet[h.ip_len + 13] |= flags & TCP_PSH;
+    }
+    c->next_seq = load32(packet + h.ip_len + 4) + (uint32_t) payload;
+    if (!h.v6) c->next_id = (uint16_t) (load16(packet + 4) + 1);
+    return 1;
+}
+
+size_t tun_coalesce_finish(struct tun_coalescer *c, struct virtio_net_hdr *hdr)
+{
+    size_t len = c->len;
+    memset(hdr, 0, sizeof(*hdr));
+    c->len = 0;
+    if (c->segments <= 1) return len;
+
+    int v6 = (c->packet[0] >> 4) == 6;
+    size_t ip_len = v6 ? IPV6_HEADER : IPV4_HEADER;
+    if (v6) {
+        store16(c->packet + 4, (uint16_t) (len - IPV6_HEADER));
+    } else {
+        store16(c->packet + 2, (uint16_t) len);
+        ipv4_check(c->packet);
+    }
+    // GSO wants the pseudo header sum over the whole super-segment, not complemented
+    uint16_t pseudo = pseudo_sum(c->packet, v6, len - ip_len);
+    memcpy(c->packet + ip_len + TCP_CHECK, &pseudo, sizeof(pseudo));
+
+    hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    hdr->gso_type = v6 ? VIRTIO_NET_HDR_GSO_TCPV6 : VIRTIO_NET_HDR_GSO_TCPV4;
+    hdr->hdr_len = (uint16_t) c->header_len;
+    hdr->gso_size = (uint16_t) c->segment_size;
+    hdr->csum_start = (uint16_t) ip_len;
+    hdr->csum_offset = TCP_CHECK;
+    return len;
+}
@@ -0,0 +1,73 @@
+#ifndef PATH_TUN_OFFLOAD_H
+#define PATH_TUN_OFFLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+// A struct in virtio_net.h has a field named class
+#define class virtio_class
+#include <linux/virtio_net.h>
+#undef class
+#else
+#include <linux/virtio_net.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Packet side of tun2socks' IFF_VNET_HDR mode, see tun_batch.c for the device side.
+ *
+ * With TUN_F_TSO4/TUN_F_TSO6 the kernel hands over TCP super-segments of up to 64 KiB (GRO, or its
+ * own TSO output) behind a struct virtio_net_hdr, and accepts the same on write (GSO). lwIP only
+ * deals in MTU sized packets, so reads are cut back into segments here, and consecutive segments of
+ * one flow that lwIP writes are merged into one super-segment.
+ */
+
+#define TUN_MAX_PACKET 65535    /* IP total length limit, also what a super-segment can hold */
+
+/*
+ * Number of packets that `packet` (`len` bytes, as read after `hdr`) stands for: 1 for anything but
+ * a well formed TCP super-segment, 0 if it cannot be taken apart.
+ */
+size_t tun_gso_count(const struct virtio_net_hdr *hdr, const unsigned char *packet, size_t len);
+
+/*
+ * Writes packet `index` of `packet` to `out`, which holds `out_len` bytes, and returns its length,
+ * truncated to `out_len` like a read() would be. Segments get their own IP length, IPv4 ID, sequence
+ * number and flags, and every checksum the kernel left to us is filled in, of plain packets too.
+ */
+size_t tun_gso_segment(const struct virtio_net_hdr *hdr, const unsigned char *packet, size_t len, size_t index,
+                       unsigned char *out, size_t out_len);
+
+struct tun_coalescer {
+    size_t len;                 /* 0 while empty */
+    size_t header_len;          /* IP and TCP headers */
+    size_t segment_size;        /* payload of the first segment, the GSO size */
+    size_t segments;
+    int closed;                 /* a short or PSH segment went in, nothing may follow */
+    uint32_t next_seq;
+    uint16_t next_id;
+    unsigned char packet[TUN_MAX_PACKET];
+};
+
+/*
+ * Appends `packet` if it continues the flow of the packets already in `c`, or starts over with it
+ * if `c` is empty. Returns 0 if it does not fit, the caller then flushes `c` and tries again or
+ * writes the packet on its own.
+ */
+int tun_coalesce(struct tun_coalescer *c, const unsigned char *packet, size_t len);
+
+/*
+ * Fixes up the headers of what `c` holds, fills in `hdr` and returns the length to write after it.
+ * A single packet is left as it is behind an empty header. `c` is empty afterwards.
+ */
+size_t tun_coalesce_finish(struct tun_coalescer *c, struct virtio_net_hdr *hdr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+#include "tun_shard.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <android/log.h>
+
+#include "ancillary.h"
+#include "spsc_ring.h"
+
+#define LOG_TAG "tun-shard"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+#define DISPATCH_BATCH 64       /* packets moved per direction before the other gets a turn */
+#define CONNECT_ATTEMPTS 100    /* 10 s for a shard to start listening on its socket */
+
+/*
+ * tun2socks is linked with -Wl,--wrap=main,--wrap=ancil_recv_fd. Started with --shards N (0 for
+ * one per core), main() forks N - 1 more tun2socks processes before any of them sets up a reactor,
+ * each with its own lwIP stack and SOCKS connections, and each listening on --sock-path with
+ * ".<shard>" appended. The first process keeps the original path:
+ *
+ * - When the app hands it the TUN descriptor, a dispatcher thread takes the device over. It sends
+ *   every packet to the shard its addresses and ports hash to, through a lock-free ring in shared
+ *   memory, and writes what the shards put in their outbound rings back to the device.
+ * - Every shard, the first included, gets an eventfd instead of the device. BTap.c polls it like the
+ *   device, and read() and write() on it go to the shard's rings, see tun_batch.c.
+ *
+ * Flows stay with one shard, so lwIP never sees a connection move. A shard that dies takes the rest
+ * down with it, and the others follow the first process through PR_SET_PDEATHSIG.
+ *
+ * The app does not pass --shards yet. tun_shard_handover in the host bench runs this file with an echo
+ * in place of tun2socks' main.
+ */
+
+int __real_main(int argc, char **argv);
+int __real_ancil_recv_fd(int sock, int *fd);
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+struct shard {
+    struct spsc_ring *in;       /* dispatcher to shard */
+    struct spsc_ring *out;      /* shard to dispatcher */
+    int in_bell;                /* eventfd, what the shard's BTap polls */
+    int alive;                  /* pipe read end, hangs up when the shard exits */
+    char *sock_path;
+};
+
+static struct shard shards[TUN_SHARDS_MAX];
+static unsigned shard_count = 1;
+static int shard_index = -1;    /* this process' shard, -1 when not sharded */
+static int out_bell = -1;       /* eventfd, wakes the dispatcher */
+static size_t out_pending;      /* packets written since the dispatcher was woken */
+static int tun = -1;            /* the device, in the first process */
+int tun_shard_fd = -1;
+
+static uint32_t mix(uint32_t h, const unsigned char *p, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) h = (h ^ p[i]) * 0x01000193u;
+    return h;
+}
+
+unsigned tun_shard_of(const unsigned char *packet, size_t len, unsigned shards)
+{
+    uint32_t h = 0x811c9dc5u;
+    if (len >= 20 && packet[0] >> 4 == 4) {
+        size_t ihl = (size_t) (packet[0] & 0xf) * 4;
+        int proto = packet[9];
+        h = mix(h, packet + 9, 1);
+        h = mix(h, packet + 12, 8);
+        // Fragments carry no ports, all of a datagram's fragments go by addresses alone
+        int fragment = (packet[6] & 0x3f) != 0 || packet[7] != 0;
+        if (!fragment && (proto == 6 || proto == 17) && len >= ihl + 4) h = mix(h, packet + ihl, 4);
+    } else if (len >= 40 && packet[0] >> 4 == 6) {
+        int next = packet[6];
+        h = mix(h, packet + 6, 1);
+        h = mix(h, packet + 8, 32);
+        if ((next == 6 || next == 17) && len >= 44) h = mix(h, packet + 40, 4);
+    }
+    h ^= h >> 16;
+    return (unsigned) (((uint64_t) h * shards) >> 32);
+}
+
+ssize_t tun_shard_read(void *buf, size_t count)
+{
+    struct shard *shard = &shards[shard_index];
+    ssize_t len = spsc_ring_pop(shard->in, buf, count);
+    if (len >= 0) return len;
+    // Clears the doorbell, then looks again for what was pushed before it was rung
+    uint64_t rings;
+    __real_read(tun_shard_fd, &rings, sizeof(rings));
+    len = spsc_ring_pop(shard->in, buf, count);
+    if (len >= 0) return len;
+    errno = EAGAIN;
+    return -1;
+}
+
+void tun_shard_flush(void)
+{
+    if (out_pending == 0) return;
+    uint64_t ring = 1;
+    __real_write(out_bell, &ring, sizeof(ring));
+    out_pending = 0;
+}
+
+ssize_t tun_shard_write(const void *buf, size_t count)
+{
+    struct shard *shard = &shards[shard_index];
+    // A full ring drops the packet, like a full device queue would
+    if (spsc_ring_push(shard->out, buf, count)) ++out_pending;
+    if (out_pending >= SPSC_RING_SLOTS / 2) tun_shard_flush();
+    return (ssize_t) count;
+}
+
+static void ring_bell(int bell)
+{
+    uint64_t ring = 1;
+    __real_write(bell, &ring, sizeof(ring));
+}
+
+static void dispatch_in(void)
+{
+    unsigned char packet[SPSC_RING_SLOT];
+    unsigned rung = 0;
+    for (int i = 0; i < DISPATCH_BATCH; ++i) {
+        ssize_t len = __real_read(tun, packet, sizeof(packet));
+        if (len <= 0) break;
+        unsigned k = tun_shard_of(packet, (size_t) len, shard_count);
+        if (spsc_ring_push(shards[k].in, packet, (size_t) len)) rung |= 1u << k;
+    }
+    for (unsigned k = 0; k < shard_count; ++k) {
+        if (rung & 1u << k) ring_bell(shards[k].in_bell);
+    }
+}
+
+/* Returns 1 if a ring still holds packets */
+static int dispatch_out(void)
+{
+    unsigned char packet[SPSC_RING_SLOT];
+    int more = 0;
+    for (unsigned k = 0; k < shard_count; ++k) {
+        for (int i = 0; i < DISPATCH_BATCH; ++i) {
+            ssize_t len = spsc_ring_pop(shards[k].out, packet, sizeof(packet));
+            if (len < 0) break;
+            if (__real_write(tun, packet, (size_t) len) == -1 && errno != EAGAIN && errno != ENOBUFS) {
+                LOGW("write: %s", strerror(errno));
+            }
+        }
+        if (spsc_ring_size(shards[k].out) > 0) more = 1;
+    }
+    return more;
+}
+
+static void *dispatcher(void *arg)
+{
+    (void) arg;
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = {.events = EPOLLIN, .data.u32 = TUN_SHARDS_MAX};
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tun, &event);
+    event.data.u32 = TUN_SHARDS_MAX + 1;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, out_bell, &event);
+    for (unsigned k = 1; k < shard_count; ++k) {
+        event.data.u32 = k;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, shards[k].alive, &event);
+    }
+
+    int more = 0;
+    for (;;) {
+        struct epoll_event events[TUN_SHARDS_MAX + 2];
+        // Outbound rings that were left with packets get another turn before anything blocks
+        int n = __real_epoll_wait(epfd, events, TUN_SHARDS_MAX + 2, more ? 0 : -1);
+        if (n == -1 && errno != EINTR) {
+            LOGW("epoll_wait: %s", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint32_t what = events[i].data.u32;
+            if (what == TUN_SHARDS_MAX) {
+                dispatch_in();
+            } else if (what == TUN_SHARDS_MAX + 1) {
+                uint64_t rings;
+                __real_read(out_bell, &rings, sizeof(rings));
+            } else {
+                LOGW("shard %u exited", what);
+                kill(getpid(), SIGTERM);
+                return NULL;
+            }
+        }
+        more = dispatch_out();
+    }
+    kill(getpid(), SIGTERM);
+    return NULL;
+}
+
+/* Sends shard `k` its doorbell once it listens on its socket */
+static int hand_over(unsigned k)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, shards[k].sock_path, sizeof(addr.sun_path) - 1);
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; ++attempt) {
+        int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock == -1) return -1;
+        if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+            int ret = ancil_send_fd(sock, shards[k].in_bell);
+            close(sock);
+            return ret;
+        }
+        close(sock);
+        usleep(100 * 1000);
+    }
+    return -1;
+}
+
+int __wrap_ancil_recv_fd(int sock, int *fd)
+{
+    int ret = __real_ancil_recv_fd(sock, fd);
+    if (ret != 0 || shard_index < 0) return ret;
+    if (shard_index > 0) {
+        tun_shard_fd = *fd;
+        return 0;
+    }
+
+    tun = *fd;
+    fcntl(tun, F_SETFL, fcntl(tun, F_GETFL) | O_NONBLOCK);
+    pthread_t thread;
+    if ((errno = pthread_create(&thread, NULL, dispatcher, NULL)) != 0) {
+        LOGW("cannot start the dispatcher: %s", strerror(errno));
+        return -1;
+    }
+    pthread_detach(thread);
+    for (unsigned k = 1; k < shard_count; ++k) {
+        if (hand_over(k) == -1) LOGW("cannot reach shard %u at %s", k, shards[k].sock_path);
+    }
+    LOGI("dispatching to %u shards", shard_count);
+    *fd = tun_shard_fd = shards[0].in_bell;
+    return 0;
+}
+
+static int setup(const char *sock_path)
+{
+    size_t rings = 2 * shard_count * sizeof(struct spsc_ring);
+    // Shared with the shards, pages are only backed once a ring reaches them
+    struct spsc_ring *mapped = mmap(NULL, rings, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) return -1;
+    if ((out_bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) return -1;
+    for (unsigned k = 0; k < shard_count; ++k) {
+        struct shard *shard = &shards[k];
+        shard->in = &mapped[2 * k];
+        shard->out = &mapped[2 * k + 1];
+        shard->alive = -1;
+        if ((shard->in_bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) return -1;
+        if (k == 0) {
+            shard->sock_path = strdup(sock_path);
+        } else if (asprintf(&shard->sock_path, "%s.%u", sock_path, k) == -1) {
+            return -1;
+        }
+        if (shard->sock_path == NULL) return -1;
+    }
+    return 0;
+}
+
+static pid_t start_shard(unsigned k, int argc, char **argv, int sock_path_arg)
+{
+    int alive[2];
+    if (pipe2(alive, O_CLOEXEC) == -1) return -1;
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid != 0) {
+        close(alive[1]);
+        shards[k].alive = alive[0];
+        return pid;
+    }
+
+    shard_index = (int) k;
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != parent) _exit(EXIT_FAILURE);
+    close(alive[0]);
+    for (unsigned i = 1; i < k; ++i) close(shards[i].alive);
+    argv[sock_path_arg] = shards[k].sock_path;
+    exit(__real_main(argc, argv));
+}
+
+int __wrap_main(int argc, char **argv)
+{
+    // --shards is ours, tun2socks never sees it
+    long shards_arg = 1;
+    int sock_path_arg = -1, kept = 0;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shards_arg = strtol(argv[++i], NULL, 10);
+            continue;
+        }
+        if (strcmp(argv[i], "--sock-path") == 0 && i + 1 < argc) sock_path_arg = kept + 1;
+        argv[kept++] = argv[i];
+    }
+    argv[kept] = NULL;
+    argc = kept;
+
+    if (shards_arg == 0) shards_arg = sysconf(_SC_NPROCESSORS_ONLN);
+    if (shards_arg > TUN_SHARDS_MAX) shards_arg = TUN_SHARDS_MAX;
+    if (shards_arg <= 1) return __real_main(argc, argv);
+    if (sock_path_arg < 0 || sock_path_arg >= argc) {
+        LOGW("sharding needs --sock-path, running a single stack");
+        return __real_main(argc, argv);
+    }
+
+    shard_count = (unsigned) shards_arg;
+    if (setup(argv[sock_path_arg]) == -1) {
+        LOGW("cannot set up %u shards: %s", shard_count, strerror(errno));
+        return __real_main(argc, argv);
+    }
+    for (unsigned k = 1; k < shard_count; ++k) {
+        if (start_shard(k, argc, argv, sock_path_arg) == -1) {
+            LOGW("cannot start shard %u: %s", k, strerror(errno));
+            shard_count = k;
+            break;
+        }
+    }
+    shard_index = 0;
+    return __real_main(argc, argv);
+}
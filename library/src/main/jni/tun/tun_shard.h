@@ -0,0 +1,35 @@
+#ifndef PATH_TUN_SHARD_H
+#define PATH_TUN_SHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sharded tun2socks, see tun_shard.c. tun_batch.c's read(), write() and epoll_wait() wraps hand a
+ * shard's calls on its TUN descriptor over to these.
+ */
+
+#define TUN_SHARDS_MAX 8
+
+/* Descriptor BTap.c took for the TUN device in a shard, -1 when not sharded */
+extern int tun_shard_fd;
+
+ssize_t tun_shard_read(void *buf, size_t count);
+ssize_t tun_shard_write(const void *buf, size_t count);
+
+/* Wakes the dispatcher for the packets written since the last call, before the reactor blocks */
+void tun_shard_flush(void);
+
+/* Shard a packet read from the TUN device belongs to, by the hash of its addresses and ports */
+unsigned tun_shard_of(const unsigned char *packet, size_t len, unsigned shards);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+#include "session_cache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <android/log.h>
+
+#include "ev.h"
+
+#define LOG_TAG "session-cache"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+
+#define SLAB_ENTRIES 64
+#define MIN_BUCKETS 16
+
+struct entry {
+    void *data;
+    ev_tstamp ts;               /* last use, loop time */
+    uint32_t hash;
+    uint32_t next_free;         /* index + 1 of the next free entry, while not used */
+    uint8_t key_len;
+    uint8_t used;
+    uint8_t referenced;         /* clock bit, set on every use */
+    char key[CACHE_KEY_MAX + 1];    /* NUL terminated like cache.c's copies */
+};
+
+struct bucket {
+    uint32_t hash;              /* compared before the entry is touched */
+    uint32_t entry;             /* index + 1, 0 for an empty bucket */
+};
+
+struct cache {
+    size_t max_entries;
+    void (*free_cb)(void *key, void *element);
+    struct bucket *buckets;
+    size_t mask;
+    struct entry **slabs;
+    size_t slab_count;
+    uint32_t allocated;         /* entries taken from the slabs so far */
+    uint32_t free_list;         /* index + 1 */
+    uint32_t hand;              /* clock position */
+    struct cache_stats stats;
+};
+
+static uint64_t load64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Word at a time, udprelay.c keys are mostly the zero padding of a sockaddr_storage */
+static uint32_t hash_key(const char *key, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) key;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    for (; len >= 8; p += 8, len -= 8) {
+        h ^= load64(p);
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 29;
+    }
+    for (; len > 0; ++p, --len) h = (h ^ *p) * 0x100000001b3ULL;
+    h ^= h >> 32;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 29;
+    return (uint32_t) h;
+}
+
+static struct entry *entry_at(const struct cache *cache, uint32_t index)
+{
+    return &cache->slabs[index / SLAB_ENTRIES][index % SLAB_ENTRIES];
+}
+
+/* Bucket holding `key`, or -1 */
+static ssize_t find_bucket(const struct cache *cache, const char *key, size_t len, uint32_t hash)
+{
+    for (size_t i = hash & cache->mask;; i = (i + 1) & cache->mask) {
+        const struct bucket *bucket = &cache->buckets[i];
+        if (bucket->entry == 0) return -1;
+        if (bucket->hash != hash) continue;
+        const struct entry *entry = entry_at(cache, bucket->entry - 1);
+        if (entry->key_len == len && memcmp(entry->key, key, len) == 0) return (ssize_t) i;
+    }
+}
+
+/* Backward shift deletion, keeps every probe sequence intact without tombstones */
+static void delete_bucket(struct cache *cache, size_t hole)
+{
+    for (size_t i = (hole + 1) & cache->mask; cache->buckets[i].entry != 0; i = (i + 1) & cache->mask) {
+        size_t home = cache->buckets[i].hash & cache->mask;
+        // Moves back unless its home lies cyclically in (hole, i]
+        int stays = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+        if (stays) continue;
+        cache->buckets[hole] = cache->buckets[i];
+        hole = i;
+    }
+    cache->buckets[hole].entry = 0;
+}
+
+static void release(struct cache *cache, size_t bucket, int keep_data)
+{
+    uint32_t index = cache->buckets[bucket].entry - 1;
+    struct entry *entry = entry_at(cache, index);
+    delete_bucket(cache, bucket);
+    --cache->stats.entries;
+    if (!keep_data && entry->data != NULL) {
+        if (cache->free_cb != NULL) cache->free_cb(entry->key, entry->data);
+        else free(entry->data);
+    }
+    entry->used = 0;
+    entry->data = NULL;
+    entry->next_free = cache->free_list;
+    cache->free_list = index + 1;
+}
+
+static void release_entry(struct cache *cache, struct entry *entry, int keep_data)
+{
+    ssize_t bucket = find_bucket(cache, entry->key, entry->key_len, entry->hash);
+    if (bucket >= 0) release(cache, (size_t) bucket, keep_data);
+}
+
+static struct entry *take_entry(struct cache *cache, uint32_t *index)
+{
+    if (cache->free_list != 0) {
+        *index = cache->free_list - 1;
+        struct entry *entry = entry_at(cache, *index);
+        cache->free_list = entry->next_free;
+        return entry;
+    }
+    if (cache->allocated == cache->slab_count * SLAB_ENTRIES) {
+        struct entry **slabs = realloc(cache->slabs, (cache->slab_count + 1) * sizeof(*slabs));
+        if (slabs == NULL) return NULL;
+        cache->slabs = slabs;
+        cache->slabs[cache->slab_count] = calloc(SLAB_ENTRIES, sizeof(struct entry));
+        if (cache->slabs[cache->slab_count] == NULL) return NULL;
+        ++cache->slab_count;
+    }
+    *index = cache->allocated++;
+    return entry_at(cache, *index);
+}
+
+/* Second chance clock: recently used entries lose their bit, the first one without goes */
+static void evict(struct cache *cache)
+{
+    for (;;) {
+        if (cache->hand >= cache->allocated) cache->hand = 0;
+        struct entry *entry = entry_at(cache, cache->hand++);
+        if (!entry->used) continue;
+        if (entry->referenced) {
+            entry->referenced = 0;
+            continue;
+        }
+        release_entry(cache, entry, 0);
+        ++cache->stats.evictions;
+        return;
+    }
+}
+
+static struct entry *touch(struct cache *cache, char *key, size_t key_len)
+{
+    ++cache->stats.lookups;
+    if (key_len > CACHE_KEY_MAX) return NULL;
+    ssize_t bucket = find_bucket(cache, key, key_len, hash_key(key, key_len));
+    if (bucket < 0) return NULL;
+    struct entry *entry = entry_at(cache, cache->buckets[bucket].entry - 1);
+    entry->referenced = 1;
+    entry->ts = ev_now(EV_DEFAULT);
+    ++cache->stats.hits;
+    return entry;
+}
+
+int cache_create(struct cache **dst, const size_t capacity, void (*free_cb)(void *key, void *element))
+{
+    if (dst == NULL || capacity == 0 || capacity > UINT32_MAX / 4) return EINVAL;
+    struct cache *cache = calloc(1, sizeof(*cache));
+    if (cache == NULL) return ENOMEM;
+    size_t buckets = MIN_BUCKETS;
+    while (buckets < 2 * capacity) buckets *= 2;
+    cache->buckets = calloc(buckets, sizeof(struct bucket));
+    if (cache->buckets == NULL) {
+        free(cache);
+        return ENOMEM;
+    }
+    cache->mask = buckets - 1;
+    cache->max_entries = capacity;
+    cache->free_cb = free_cb;
+    *dst = cache;
+    return 0;
+}
+
+int cache_delete(struct cache *cache, int keep_data)
+{
+    if (cache == NULL) return EINVAL;
+    if (cache->stats.lookups > 0) {
+        LOGI("%llu lookups, %.1f%% hits, %llu evictions", (unsigned long long) cache->stats.lookups,
+             100.0 * cache->stats.hits / cache->stats.lookups, (unsigned long long) cache->stats.evictions);
+    }
+    for (uint32_t i = 0; i < cache->allocated; ++i) {
+        struct entry *entry = entry_at(cache, i);
+        if (entry->used) release_entry(cache, entry, keep_data);
+    }
+    for (size_t i = 0; i < cache->slab_count; ++i) free(cache->slabs[i]);
+    free(cache->slabs);
+    free(cache->buckets);
+    free(cache);
+    return 0;
+}
+
+int cache_clear(struct cache *cache, double age)
+{
+    if (cache == NULL) return EINVAL;
+    ev_tstamp now = ev_time();
+    for (uint32_t i = 0; i < cache->allocated; ++i) {
+        struct entry *entry = entry_at(cache, i);
+        if (entry->used && now - entry->ts > age) {
+            release_entry(cache, entry, 0);
+            ++cache->stats.expirations;
+        }
+    }
+    return 0;
+}
+
+int cache_lookup(struct cache *cache, char *key, size_t key_len, void *result)
+{
+    if (cache == NULL || key == NULL || result == NULL) return EINVAL;
+    struct entry *entry = touch(cache, key, key_len);
+    *(void **) result = entry != NULL ? entry->data : NULL;
+    return 0;
+}
+
+int cache_key_exist(struct cache *cache, char *key, size_t key_len)
+{
+    if (cache == NULL || key == NULL) return 0;
+    return touch(cache, key, key_len) != NULL;
+}
+
+int cache_insert(struct cache *cache, char *key, size_t key_len, void *data)
+{
+    if (cache == NULL || key == NULL) return EINVAL;
+    if (key_len > CACHE_KEY_MAX) return EINVAL;
+    uint32_t hash = hash_key(key, key_len);
+    // cache.c would keep both, the older one could never be found again
+    ssize_t existing = find_bucket(cache, key, key_len, hash);
+    if (existing >= 0) release(cache, (size_t) existing, 0);
+    if (cache->stats.entries >= cache->max_entries) evict(cache);
+
+    uint32_t index;
+    struct entry *entry = take_entry(cache, &index);
+    if (entry == NULL) return ENOMEM;
+    memcpy(entry->key, key, key_len);
+    entry->key[key_len] = '\0';
+    entry->key_len = (uint8_t) key_len;
+    entry->hash = hash;
+    entry->data = data;
+    entry->ts = ev_now(EV_DEFAULT);
+    entry->used = 1;
+    entry->referenced = 1;
+
+    size_t i = hash & cache->mask;
+    while (cache->buckets[i].entry != 0) i = (i + 1) & cache->mask;
+    cache->buckets[i].hash = hash;
+    cache->buckets[i].entry = index + 1;
+    ++cache->stats.entries;
+    ++cache->stats.inserts;
+    return 0;
+}
+
+int cache_remove(struct cache *cache, char *key, size_t key_len)
+{
+    if (cache == NULL || key == NULL) return EINVAL;
+    if (key_len > CACHE_KEY_MAX) return 0;
+    ssize_t bucket = find_bucket(cache, key, key_len, hash_key(key, key_len));
+    if (bucket >= 0) release(cache, (size_t) bucket, 0);
+    return 0;
+}
+
+void cache_get_stats(const struct cache *cache, struct cache_stats *stats)
+{
+    *stats = cache->stats;
+}
@@ -0,0 +1,46 @@
+#ifndef PATH_SESSION_CACHE_H
+#define PATH_SESSION_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Drop-in replacement for shadowsocks-libev's cache.c, which udprelay.c uses to map a client
+ * address to its remote UDP context. The functions keep cache.h's signatures and return values,
+ * but the table is open-addressed over inline keys, entries come from slabs instead of one malloc
+ * each, and eviction runs a clock over the slabs rather than a linked LRU list. cache.h is not
+ * included, udprelay.c only ever handles struct cache through a pointer.
+ */
+
+#define CACHE_KEY_MAX 144       /* udprelay.c keys are a sockaddr_storage and an int */
+
+struct cache;
+
+struct cache_stats {
+    uint64_t lookups;           /* cache_lookup() and cache_key_exist() */
+    uint64_t hits;
+    uint64_t inserts;
+    uint64_t evictions;         /* entries pushed out by inserts into a full cache */
+    uint64_t expirations;       /* entries dropped by cache_clear() */
+    size_t entries;
+};
+
+int cache_create(struct cache **dst, const size_t capacity, void (*free_cb)(void *key, void *element));
+int cache_delete(struct cache *cache, int keep_data);
+int cache_clear(struct cache *cache, double age);
+int cache_lookup(struct cache *cache, char *key, size_t key_len, void *result);
+int cache_insert(struct cache *cache, char *key, size_t key_len, void *data);
+int cache_remove(struct cache *cache, char *key, size_t key_len);
+int cache_key_exist(struct cache *cache, char *key, size_t key_len);
+
+void cache_get_stats(const struct cache *cache, struct cache_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
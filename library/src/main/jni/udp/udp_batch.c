@@ -0,0 +1,264 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <android/log.h>
+
+#include "ev.h"
+
+#define LOG_TAG "udp-batch"
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+#ifndef UDP_BATCH_SIZE
+#define UDP_BATCH_SIZE 16       /* datagrams per recvmmsg/sendmmsg */
+#endif
+#define UDP_BATCH_SLOT 4096     /* above udprelay.c's packet buffer, larger sends bypass the queue */
+#define UDP_BATCH_POOL 16       /* batches shared by all sockets, mapped once */
+
+/*
+ * ss-local is linked with -Wl,--wrap=recvfrom,--wrap=sendto,--wrap=ev_io_stop, which batches
+ * udprelay.c's one-datagram-per-callback I/O at the system call boundary:
+ *
+ * - recvfrom() drains up to UDP_BATCH_SIZE datagrams with one recvmmsg(), hands out the first and
+ *   feeds the watcher another read event while more are queued, so libev calls udprelay.c back in
+ *   the same loop iteration without polling again.
+ * - sendto() queues the datagram and returns its length at once; a prepare watcher sends all queues
+ *   with one sendmmsg() per socket before the loop blocks, as does a full queue.
+ * - ev_io_stop() on a socket flushes its queued sends and drops its queued receives, udprelay.c
+ *   always stops the watcher before it closes the socket, so nothing leaks into a reused fd.
+ *
+ * Only calls without flags are batched, those with flags (TCP fast open) and everything on a socket
+ * the pool has no batch for go straight through. Queued datagrams are in batches taken from a fixed
+ * pool and given back as soon as they are drained.
+ */
+
+ssize_t __real_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *addr, socklen_t *addr_len);
+ssize_t __real_sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *addr,
+                      socklen_t addr_len);
+void __real_ev_io_stop(struct ev_loop *loop, ev_io *watcher);
+
+struct batch {
+    struct mmsghdr messages[UDP_BATCH_SIZE];
+    struct iovec iovs[UDP_BATCH_SIZE];
+    struct sockaddr_storage addrs[UDP_BATCH_SIZE];
+    unsigned char data[UDP_BATCH_SIZE][UDP_BATCH_SLOT];
+    struct batch *next_free;
+};
+
+struct udp_socket {
+    struct batch *received;     /* datagrams read ahead */
+    unsigned received_count;
+    unsigned received_next;
+    struct batch *sending;      /* datagrams not sent yet */
+    unsigned sending_count;
+    struct udp_socket *next_sending;
+    int fd;
+};
+
+/* ss-local runs a single event loop thread, nothing here needs locking */
+static struct batch *pool;
+static struct batch *free_batches;
+static int pool_failed;
+static struct udp_socket **sockets;
+static size_t n_sockets;
+static struct udp_socket *sending;  /* sockets with queued sends */
+static ev_prepare flusher;
+
+static struct batch *take_batch(void)
+{
+    if (pool == NULL && !pool_failed) {
+        // Pages stay unbacked until a batch is first used
+        void *mapped = mmap(NULL, UDP_BATCH_POOL * sizeof(struct batch), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) {
+            LOGW("cannot map batches: %s", strerror(errno));
+            pool_failed = 1;
+            return NULL;
+        }
+        pool = mapped;
+        for (int i = UDP_BATCH_POOL; i-- > 0;) {
+            pool[i].next_free = free_batches;
+            free_batches = &pool[i];
+        }
+    }
+    struct batch *batch = free_batches;
+    if (batch != NULL) free_batches = batch->next_free;
+    return batch;
+}
+
+static void give_batch(struct batch *batch)
+{
+    batch->next_free = free_batches;
+    free_batches = batch;
+}
+
+static struct udp_socket *find_socket(int fd)
+{
+    return fd >= 0 && (size_t) fd < n_sockets ? sockets[fd] : NULL;
+}
+
+static struct udp_socket *add_socket(int fd)
+{
+    struct udp_socket *socket = find_socket(fd);
+    if (socket != NULL || fd < 0) return socket;
+    if ((size_t) fd >= n_sockets) {
+        size_t size = n_sockets == 0 ? 64 : n_sockets;
+        while (size <= (size_t) fd) size *= 2;
+        struct udp_socket **grown = realloc(sockets, size * sizeof(*sockets));
+        if (grown == NULL) return NULL;
+        memset(grown + n_sockets, 0, (size - n_sockets) * sizeof(*sockets));
+        sockets = grown;
+        n_sockets = size;
+    }
+    sockets[fd] = calloc(1, sizeof(struct udp_socket));
+    if (sockets[fd] != NULL) sockets[fd]->fd = fd;
+    return sockets[fd];
+}
+
+static void flush(struct udp_socket *socket)
+{
+    struct batch *batch = socket->sending;
+    if (batch == NULL) return;
+    unsigned sent = 0;
+    while (sent < socket->sending_count) {
+        int ret = sendmmsg(socket->fd, batch->messages + sent, socket->sending_count - sent, 0);
+        if (ret > 0) {
+            sent += (unsigned) ret;
+        } else if (ret == -1 && errno == EINTR) {
+            continue;
+        } else {
+            // sendto() already reported these as sent, they are lost like any datagram
+            if (errno != EAGAIN && errno != EWOULDBLOCK) LOGW("sendmmsg: %s", strerror(errno));
+            ++sent;
+        }
+    }
+    give_batch(batch);
+    socket->sending = NULL;
+    socket->sending_count = 0;
+
+    struct udp_socket **link = &sending;
+    while (*link != NULL && *link != socket) link = &(*link)->next_sending;
+    if (*link != NULL) *link = socket->next_sending;
+    socket->next_sending = NULL;
+}
+
+static void flush_all(struct ev_loop *loop, ev_prepare *watcher, int revents)
+{
+    (void) revents;
+    while (sending != NULL) flush(sending);
+    ev_prepare_stop(loop, watcher);
+}
+
+static void drop_received(struct udp_socket *socket)
+{
+    if (socket->received != NULL) give_batch(socket->received);
+    socket->received = NULL;
+    socket->received_count = socket->received_next = 0;
+}
+
+ssize_t __wrap_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *addr, socklen_t *addr_len)
+{
+    if (flags != 0) return __real_recvfrom(fd, buf, len, flags, addr, addr_len);
+    struct udp_socket *socket = find_socket(fd);
+    if (socket != NULL && socket->received != NULL) {
+        struct batch *batch = socket->received;
+        struct mmsghdr *message = &batch->messages[socket->received_next];
+        size_t copied = message->msg_len < len ? message->msg_len : len;
+        memcpy(buf, batch->data[socket->received_next], copied);
+        if (addr != NULL && addr_len != NULL) {
+            socklen_t name_len = message->msg_hdr.msg_namelen;
+            memcpy(addr, &batch->addrs[socket->received_next], name_len < *addr_len ? name_len : *addr_len);
+            *addr_len = name_len;
+        }
+        if (++socket->received_next == socket->received_count) drop_received(socket);
+        else ev_feed_fd_event(EV_DEFAULT, fd, EV_READ);
+        return (ssize_t) copied;
+    }
+
+    struct batch *batch = (socket = add_socket(fd)) != NULL ? take_batch() : NULL;
+    if (batch == NULL) return __real_recvfrom(fd, buf, len, flags, addr, addr_len);
+    // The first datagram goes straight into the caller's buffer, the rest into the batch
+    memset(batch->messages, 0, sizeof(batch->messages));
+    batch->iovs[0].iov_base = buf;
+    batch->iovs[0].iov_len = len;
+    batch->messages[0].msg_hdr.msg_name = addr_len != NULL ? addr : NULL;
+    batch->messages[0].msg_hdr.msg_namelen = addr_len != NULL ? *addr_len : 0;
+    for (unsigned i = 0; i < UDP_BATCH_SIZE; ++i) {
+        if (i > 0) {
+            batch->iovs[i].iov_base = batch->data[i];
+            batch->iovs[i].iov_len = UDP_BATCH_SLOT;
+            batch->messages[i].msg_hdr.msg_name = &batch->addrs[i];
+            batch->messages[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+        }
+        batch->messages[i].msg_hdr.msg_iov = &batch->iovs[i];
+        batch->messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count = recvmmsg(fd, batch->messages, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (count <= 0) {
+        give_batch(batch);
+        return count == 0 ? 0 : -1;
+    }
+    if (addr_len != NULL) *addr_len = batch->messages[0].msg_hdr.msg_namelen;
+    ssize_t first = (ssize_t) batch->messages[0].msg_len;
+    if (count == 1) {
+        give_batch(batch);
+        return first;
+    }
+    // Slots start at 1, the caller's buffer took the first datagram
+    socket->received = batch;
+    socket->received_count = (unsigned) count;
+    socket->received_next = 1;
+    ev_feed_fd_event(EV_DEFAULT, fd, EV_READ);
+    return first;
+}
+
+ssize_t __wrap_sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *addr,
+                      socklen_t addr_len)
+{
+    struct udp_socket *socket = flags == 0 && len <= UDP_BATCH_SLOT && addr_len <= sizeof(struct sockaddr_storage)
+            ? add_socket(fd) : NULL;
+    if (socket != NULL && socket->sending == NULL) {
+        socket->sending = take_batch();
+        if (socket->sending != NULL) {
+            socket->next_sending = sending;
+            sending = socket;
+            if (!ev_is_active(&flusher)) {
+                ev_prepare_init(&flusher, flush_all);
+                ev_prepare_start(EV_DEFAULT, &flusher);
+            }
+        }
+    }
+    if (socket == NULL || socket->sending == NULL) {
+        // Keeps the order with datagrams queued earlier
+        if (socket == NULL && (socket = find_socket(fd)) != NULL) flush(socket);
+        return __real_sendto(fd, buf, len, flags, addr, addr_len);
+    }
+
+    struct batch *batch = socket->sending;
+    unsigned i = socket->sending_count++;
+    memcpy(batch->data[i], buf, len);
+    batch->iovs[i].iov_base = batch->data[i];
+    batch->iovs[i].iov_len = len;
+    memset(&batch->messages[i], 0, sizeof(batch->messages[i]));
+    batch->messages[i].msg_hdr.msg_iov = &batch->iovs[i];
+    batch->messages[i].msg_hdr.msg_iovlen = 1;
+    if (addr != NULL) {
+        memcpy(&batch->addrs[i], addr, addr_len);
+        batch->messages[i].msg_hdr.msg_name = &batch->addrs[i];
+        batch->messages[i].msg_hdr.msg_namelen = addr_len;
+    }
+    if (socket->sending_count == UDP_BATCH_SIZE) flush(socket);
+    return (ssize_t) len;
+}
+
+void __wrap_ev_io_stop(struct ev_loop *loop, ev_io *watcher)
+{
+    struct udp_socket *socket = find_socket(watcher->fd);
+    if (socket != NULL) {
+        flush(socket);
+        drop_received(socket);
+    }
+    __real_ev_io_stop(loop, watcher);
+}
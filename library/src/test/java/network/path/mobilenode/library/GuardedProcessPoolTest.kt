@@ -0,0 +1,103 @@
+package network.path.mobilenode.library
+
+import network.path.mobilenode.library.utils.GuardedProcessPool
+import network.path.mobilenode.library.utils.JniHelper
+import network.path.mobilenode.library.utils.ProcessSupervisor
+import org.junit.jupiter.api.Assertions
+import org.junit.jupiter.api.Test
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.CopyOnWriteArrayList
+
+class GuardedProcessPoolTest {
+    companion object {
+        private const val NEVER = Long.MAX_VALUE
+        private const val TIMEOUT_MILLIS = 300L
+    }
+
+    /**
+     * Stands in for the native supervisor: every process started reports READY_LISTENING after the next entry of
+     * `readyMillis`, counted from its start.
+     */
+    private class MockSupervisor(vararg readyMillis: Long) : ProcessSupervisor {
+        private val readyIn = readyMillis.toMutableList()
+        private val startedAt = ConcurrentHashMap<Int, Long>()
+        private val ready = ConcurrentHashMap<Int, Long>()
+        val commands = CopyOnWriteArrayList<List<String>>()
+        val timeouts = CopyOnWriteArrayList<Int>()
+        val stopped = CopyOnWriteArrayList<Int>()
+
+        override fun startProcess(cmd: Array<String>, tag: String): Int {
+            val handle = commands.size
+            commands.add(cmd.toList())
+            startedAt[handle] = System.currentTimeMillis()
+            ready[handle] = readyIn.removeAt(0)
+            return handle
+        }
+
+        override fun stopProcesses(handles: IntArray, graceMillis: Int) {
+            handles.forEach { stopped.add(it) }
+        }
+
+        override fun processStatus(handle: Int): IntArray? =
+                if (startedAt.containsKey(handle)) intArrayOf(JniHelper.PROCESS_RUNNING, 100 + handle, 0, -1, 0) else null
+
+        override fun awaitProcess(handle: Int, events: Int, timeoutMillis: Int): Boolean {
+            timeouts.add(timeoutMillis)
+            val delay = ready.getValue(handle)
+            val left = if (delay == NEVER) NEVER else startedAt.getValue(handle) + delay - System.currentTimeMillis()
+            Thread.sleep(minOf(left, timeoutMillis.toLong()).coerceAtLeast(0))
+            return events == JniHelper.READY_LISTENING && left <= timeoutMillis
+        }
+    }
+
+    @Test
+    fun testAwaitAllReady() {
+        val supervisor = MockSupervisor(0, 50)
+        val pool = GuardedProcessPool(supervisor).start(listOf("obfs-local")).start(listOf("ss-local"))
+
+        Assertions.assertTrue(pool.await(JniHelper.READY_LISTENING, TIMEOUT_MILLIS))
+        Assertions.assertEquals(2, supervisor.timeouts.size)
+    }
+
+    @Test
+    fun testAwaitSharesOneDeadline() {
+        val supervisor = MockSupervisor(150, NEVER)
+        val pool = GuardedProcessPool(supervisor).start(listOf("obfs-local")).start(listOf("ss-local"))
+
+        val start = System.currentTimeMillis()
+        Assertions.assertFalse(pool.await(JniHelper.READY_LISTENING, TIMEOUT_MILLIS))
+        val elapsed = System.currentTimeMillis() - start
+
+        // The second process only gets what the first one left of the timeout
+        Assertions.assertTrue(elapsed < 2 * TIMEOUT_MILLIS)
+        Assertions.assertEquals(2, supervisor.timeouts.size)
+        Assertions.assertTrue(supervisor.timeouts[1] <= TIMEOUT_MILLIS - 150)
+    }
+
+    @Test
+    fun testAwaitStopsAtTheDeadline() {
+        val supervisor = MockSupervisor(NEVER, 0)
+        val pool = GuardedProcessPool(supervisor).start(listOf("obfs-local")).start(listOf("ss-local"))
+
+        Assertions.assertFalse(pool.await(JniHelper.READY_LISTENING, TIMEOUT_MILLIS))
+        // Nothing is left for the second process, it is not waited for at all
+        Assertions.assertEquals(1, supervisor.timeouts.size)
+        Assertions.assertTrue(supervisor.timeouts[0] <= TIMEOUT_MILLIS)
+    }
+
+    @Test
+    fun testStatusAndKillAll() {
+        val supervisor = MockSupervisor(0)
+        val pool = GuardedProcessPool(supervisor).start(listOf("/data/app/lib/libss-local.so", "-u"))
+
+        val status = pool.status().single()
+        Assertions.assertEquals("libss-local", status.cmdName)
+        Assertions.assertEquals(JniHelper.PROCESS_RUNNING, status.state)
+        Assertions.assertEquals(100, status.pid)
+
+        pool.killAll()
+        Assertions.assertEquals(listOf(0), supervisor.stopped.toList())
+        Assertions.assertTrue(pool.status().isEmpty())
+        Assertions.assertTrue(pool.await(JniHelper.READY_LISTENING, 0))
+    }
+}
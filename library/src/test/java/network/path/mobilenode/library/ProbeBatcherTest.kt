@@ -0,0 +1,196 @@
+package network.path.mobilenode.library
+
+import network.path.mobilenode.library.data.runner.Status
+import network.path.mobilenode.library.data.runner.probe.BatchLoop
+import network.path.mobilenode.library.data.runner.probe.NativeProbe
+import network.path.mobilenode.library.data.runner.probe.ProbeBatcher
+import network.path.mobilenode.library.data.runner.probe.ProbeOutcome
+import network.path.mobilenode.library.data.runner.probe.ProbeTarget
+import network.path.mobilenode.library.data.runner.probe.ResultFuture
+import network.path.mobilenode.library.domain.entity.JobRequest
+import network.path.mobilenode.library.domain.entity.JobType
+import org.junit.jupiter.api.Assertions
+import org.junit.jupiter.api.Test
+import java.util.concurrent.CancellationException
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.LinkedBlockingQueue
+import java.util.concurrent.RejectedExecutionException
+import java.util.concurrent.TimeUnit
+import java.util.concurrent.TimeoutException
+
+class ProbeBatcherTest {
+    companion object {
+        private const val DUMMY_UUID = "DUMMY_UUID"
+        private const val WAIT_SECONDS = 5L
+        private const val STOP = -1
+    }
+
+    /**
+     * Stands in for the native loop: `answer` decides every target's outcome, null keeps it in flight until the
+     * loop is stopped.
+     */
+    private class MockBatchLoop(private val answer: (ProbeTarget) -> ProbeOutcome?) : BatchLoop {
+        val targets = ConcurrentHashMap<Int, ProbeTarget>()
+        private val inFlight = ConcurrentHashMap.newKeySet<Int>()
+        private val outcomes = LinkedBlockingQueue<Pair<Int, ProbeOutcome?>>()
+        @Volatile
+        private var stopping = false
+        @Volatile
+        var freed = false
+            private set
+
+        override fun newBatchLoop() = 1L
+
+        override fun submitProbe(loop: Long, id: Int, target: ProbeTarget): Boolean {
+            if (stopping) return false
+            targets[id] = target
+            inFlight.add(id)
+            answer(target)?.let { outcomes.put(id to it) }
+            return true
+        }
+
+        override fun runBatchLoop(loop: Long, batcher: ProbeBatcher) {
+            while (true) {
+                val (id, outcome) = outcomes.take()
+                if (id == STOP) break
+                inFlight.remove(id)
+                batcher.onProbeOutcome(id, outcome!!)
+            }
+            inFlight.forEach { batcher.onProbeOutcome(it, outcome(NativeProbe.STATUS_CANCELLED)) }
+        }
+
+        override fun stopBatchLoop(loop: Long) {
+            stopping = true
+            outcomes.put(STOP to null)
+        }
+
+        override fun freeBatchLoop(loop: Long) {
+            freed = true
+        }
+    }
+
+    @Test
+    fun testTcpJobResult() {
+        val loop = MockBatchLoop {
+            outcome(NativeProbe.STATUS_OK, connectMillis = 12, handshakeMillis = 5, totalMillis = 20)
+        }
+        val batcher = ProbeBatcher(loop).apply { start() }
+
+        val result = batcher.submit(tcpRequest(), JobType.TCP).get(WAIT_SECONDS, TimeUnit.SECONDS)
+        batcher.stop()
+
+        Assertions.assertEquals(JobType.TCP, result.checkType)
+        Assertions.assertEquals(DUMMY_UUID, result.executionUuid)
+        // When connect() completed, not the kernel's SYN/SYN-ACK round trip
+        Assertions.assertEquals(12L, result.responseTime)
+        Assertions.assertEquals("TCP connection established successfully", result.responseBody)
+        Assertions.assertEquals(Status.OK, result.status)
+
+        val target = loop.targets.values.single()
+        Assertions.assertEquals(NativeProbe.PROTOCOL_TCP, target.protocol)
+        Assertions.assertEquals("example.com", target.host)
+        Assertions.assertEquals(1234, target.port)
+        Assertions.assertEquals(Constants.TCP_UDP_READ_WRITE_TIMEOUT_MILLIS.toInt(), target.readTimeoutMillis)
+        Assertions.assertEquals(Constants.JOB_TIMEOUT_MILLIS.toInt(), target.timeoutMillis)
+    }
+
+    @Test
+    fun testTimeout() {
+        val loop = MockBatchLoop { outcome(NativeProbe.STATUS_TIMEOUT, totalMillis = Constants.JOB_TIMEOUT_MILLIS) }
+        val batcher = ProbeBatcher(loop).apply { start() }
+
+        val result = batcher.submit(tcpRequest("GET"), JobType.TCP).get(WAIT_SECONDS, TimeUnit.SECONDS)
+        batcher.stop()
+
+        Assertions.assertTrue(result.responseBody.startsWith("java.net.SocketTimeoutException"))
+        Assertions.assertEquals(Constants.JOB_TIMEOUT_MILLIS, result.responseTime)
+        Assertions.assertEquals(Status.UNKNOWN, result.status)
+    }
+
+    @Test
+    fun testJobsJoinWhileOthersAreInFlight() {
+        val loop = MockBatchLoop {
+            if (it.payload == null) outcome(NativeProbe.STATUS_OK, connectMillis = 1, totalMillis = 1) else null
+        }
+        val batcher = ProbeBatcher(loop).apply { start() }
+
+        val slow = batcher.submit(tcpRequest("GET"), JobType.TCP)
+        val fast = batcher.submit(tcpRequest(), JobType.TCP).get(WAIT_SECONDS, TimeUnit.SECONDS)
+        Assertions.assertEquals(Status.OK, fast.status)
+        Assertions.assertFalse(slow.isDone)
+        batcher.stop()
+    }
+
+    @Test
+    fun testStopCancelsJobsInFlight() {
+        val loop = MockBatchLoop { null }
+        val batcher = ProbeBatcher(loop).apply { start() }
+
+        val future = batcher.submit(tcpRequest(), JobType.TCP)
+        batcher.stop()
+
+        val result = future.get(WAIT_SECONDS, TimeUnit.SECONDS)
+        Assertions.assertTrue(result.responseBody.startsWith("java.lang.InterruptedException"))
+        Assertions.assertEquals(Status.UNKNOWN, result.status)
+        Assertions.assertTrue(loop.freed)
+        Assertions.assertThrows(RejectedExecutionException::class.java) {
+            batcher.submit(tcpRequest(), JobType.TCP)
+        }
+    }
+
+    @Test
+    fun testMissingEndpoint() {
+        val loop = MockBatchLoop { outcome(NativeProbe.STATUS_OK) }
+        val batcher = ProbeBatcher(loop).apply { start() }
+
+        val request = JobRequest(protocol = "tcp", jobUuid = DUMMY_UUID, executionUuid = DUMMY_UUID)
+        val result = batcher.submit(request, JobType.TCP).get(WAIT_SECONDS, TimeUnit.SECONDS)
+        batcher.stop()
+
+        Assertions.assertTrue(result.responseBody.startsWith("java.io.IOException"))
+        Assertions.assertTrue(loop.targets.isEmpty())
+    }
+
+    @Test
+    fun testResultFutureTimeout() {
+        val future = ResultFuture<String>()
+        Assertions.assertThrows(TimeoutException::class.java) { future.get(10, TimeUnit.MILLISECONDS) }
+        Assertions.assertFalse(future.isDone)
+
+        Assertions.assertTrue(future.set("value"))
+        Assertions.assertEquals("value", future.get(0, TimeUnit.MILLISECONDS))
+        Assertions.assertFalse(future.cancel(true))
+        Assertions.assertFalse(future.isCancelled)
+    }
+
+    @Test
+    fun testResultFutureCancel() {
+        val future = ResultFuture<String>()
+        Assertions.assertTrue(future.cancel(false))
+        Assertions.assertTrue(future.isCancelled)
+        Assertions.assertTrue(future.isDone)
+        Assertions.assertFalse(future.set("value"))
+        Assertions.assertThrows(CancellationException::class.java) { future.get() }
+        Assertions.assertThrows(CancellationException::class.java) { future.get(0, TimeUnit.MILLISECONDS) }
+    }
+
+    private fun tcpRequest(payload: String? = null) = JobRequest(
+        protocol = "tcp",
+        payload = payload,
+        endpointAddress = "tcp://example.com",
+        endpointPort = 1234,
+        jobUuid = DUMMY_UUID,
+        executionUuid = DUMMY_UUID
+    )
+}
+
+private fun outcome(status: Int, connectMillis: Long = 0, handshakeMillis: Long = 0, totalMillis: Long = 0) = ProbeOutcome(
+    status = status,
+    errno = 0,
+    resolveNanos = 0,
+    connectNanos = connectMillis * 1_000_000L,
+    handshakeNanos = handshakeMillis * 1_000_000L,
+    firstByteNanos = 0,
+    totalNanos = totalMillis * 1_000_000L,
+    response = null
+)
@@ -0,0 +1,22 @@
+package network.path.mobilenode.library
+
+import network.path.mobilenode.library.data.http.PathNativeProcessesImpl
+import org.junit.jupiter.api.Assertions
+import org.junit.jupiter.api.Test
+
+class ProxyMethodTest {
+    @Test
+    fun testConfiguredMethod() {
+        val method = PathNativeProcessesImpl.proxyMethod("aes-256-cfb") {
+            Assertions.fail<String>("no AEAD choice for a configured method")
+        }
+        Assertions.assertEquals("aes-256-cfb", method)
+    }
+
+    @Test
+    fun testAutoMethod() {
+        Assertions.assertEquals("aes-256-gcm", PathNativeProcessesImpl.proxyMethod("auto") { "aes-256-gcm" })
+        Assertions.assertEquals("chacha20-ietf-poly1305",
+                PathNativeProcessesImpl.proxyMethod("auto") { "chacha20-ietf-poly1305" })
+    }
+}
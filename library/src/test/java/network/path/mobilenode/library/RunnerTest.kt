@@ -1,6 +1,5 @@
 package network.path.mobilenode.library
 
-import android.content.Context
 import com.google.gson.FieldNamingPolicy
 import com.google.gson.Gson
 import com.google.gson.GsonBuilder
@@ -174,12 +173,48 @@ class RunnerTest {
         Assertions.assertNull(result.hops.last().rtts)
     }
 
+    @Test
+    fun testTraceResultJson() {
+        val gson = GsonBuilder()
+            .setFieldNamingPolicy(FieldNamingPolicy.LOWER_CASE_WITH_UNDERSCORES)
+            .create()
+        val result = TraceResult(
+            target = "path.net",
+            targetIp = "13.35.146.35",
+            maxHops = 30,
+            packetSize = 60,
+            probesPerHop = 2,
+            hops = listOf(
+                Hop(ip = "*", rtts = listOf(), lost = 2),
+                Hop(ip = "13.35.146.35", rtts = listOf(13.876), lost = 1)
+            )
+        )
+
+        // The field names the server expects, the same the old traceroute output had
+        val json = gson.toJsonTree(result).asJsonObject
+        Assertions.assertEquals(
+            setOf("target", "target_ip", "max_hops", "packet_size", "probes_per_hop", "hops"),
+            json.keySet()
+        )
+        Assertions.assertEquals("13.35.146.35", json["target_ip"].asString)
+        Assertions.assertEquals(30, json["max_hops"].asInt)
+        Assertions.assertEquals(60, json["packet_size"].asInt)
+        Assertions.assertEquals(2, json["probes_per_hop"].asInt)
+
+        val hop = json["hops"].asJsonArray[1].asJsonObject
+        Assertions.assertEquals(setOf("ip", "rtts", "lost"), hop.keySet())
+        Assertions.assertEquals("13.35.146.35", hop["ip"].asString)
+        Assertions.assertEquals(13.876, hop["rtts"].asJsonArray[0].asDouble)
+        Assertions.assertEquals(1, hop["lost"].asInt)
+
+        Assertions.assertEquals(result, gson.fromJson(gson.toJson(result), TraceResult::class.java))
+    }
+
     @Test
     fun testJobRequestFindRunner() {
         val executor = PathJobExecutorImpl(
             Mockito.mock(OkHttpClient::class.java),
             Mockito.mock(PathStorage::class.java),
-            Mockito.mock(Context::class.java),
             Mockito.mock(Gson::class.java),
             MockTimeSource
         )